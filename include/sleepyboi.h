@@ -0,0 +1,133 @@
+#ifndef SLEEPYBOI_H
+#define SLEEPYBOI_H
+
+/*
+ * libsleepyboi : C interface to the emulator core.
+ *
+ * Every function takes an opaque sb_gameboy handle. A handle may be used from any
+ * thread, but only from one thread at a time. Functions that can fail return an
+ * sb_result and leave a message for sb_last_error().
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+    #if defined(SLEEPYBOI_BUILD_SHARED)
+        #define SLEEPYBOI_API __declspec(dllexport)
+    #elif defined(SLEEPYBOI_USE_SHARED)
+        #define SLEEPYBOI_API __declspec(dllimport)
+    #else
+        #define SLEEPYBOI_API
+    #endif
+#else
+    #define SLEEPYBOI_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SB_API_VERSION 2
+
+#define SB_SCREEN_WIDTH 160
+#define SB_SCREEN_HEIGHT 144
+
+/* Bits of sb_set_input() */
+#define SB_BUTTON_RIGHT  (1 << 0)
+#define SB_BUTTON_LEFT   (1 << 1)
+#define SB_BUTTON_UP     (1 << 2)
+#define SB_BUTTON_DOWN   (1 << 3)
+#define SB_BUTTON_A      (1 << 4)
+#define SB_BUTTON_B      (1 << 5)
+#define SB_BUTTON_SELECT (1 << 6)
+#define SB_BUTTON_START  (1 << 7)
+
+/* Framebuffer pixels, one byte each */
+#define SB_SHADE_OFF        0
+#define SB_SHADE_WHITE      1
+#define SB_SHADE_LIGHT_GRAY 2
+#define SB_SHADE_DARK_GRAY  3
+#define SB_SHADE_BLACK      4
+
+typedef enum sb_result {
+    SB_OK = 0,
+    SB_ERROR_INVALID_ARGUMENT = -1,
+    SB_ERROR_ROM = -2,              /* not a ROM this core can run */
+    SB_ERROR_STATE = -3,            /* corrupt state, or taken with another ROM/build */
+    SB_ERROR_BUFFER_TOO_SMALL = -4,
+    SB_ERROR_INTERNAL = -5
+} sb_result;
+
+typedef struct sb_gameboy sb_gameboy;
+
+/* SB_API_VERSION the library was built with */
+SLEEPYBOI_API int sb_api_version(void);
+
+SLEEPYBOI_API sb_gameboy* sb_create(void);
+SLEEPYBOI_API void sb_destroy(sb_gameboy* gb);
+/* Independent copy sharing the ROM, NULL on failure */
+SLEEPYBOI_API sb_gameboy* sb_clone(const sb_gameboy* gb);
+
+/* The bytes are copied once; clones of this handle share that copy */
+SLEEPYBOI_API sb_result sb_load_rom(sb_gameboy* gb, const uint8_t* data, size_t size);
+
+/* Runs `frames` frames; with rendering off no pixels are drawn */
+SLEEPYBOI_API sb_result sb_run_frames(sb_gameboy* gb, int frames);
+SLEEPYBOI_API void sb_set_rendering(sb_gameboy* gb, int enabled);
+/* SB_BUTTON_* bits, set = pressed. Takes effect immediately. */
+SLEEPYBOI_API void sb_set_input(sb_gameboy* gb, uint8_t buttons);
+
+/* SB_SCREEN_WIDTH * SB_SCREEN_HEIGHT SB_SHADE_* bytes, row-major. Points into the
+ * emulator, valid until the next sb_run_frames/sb_load_state on this handle. */
+SLEEPYBOI_API const uint8_t* sb_framebuffer(sb_gameboy* gb);
+/* Same frame expanded to RGB888, `rgb` must hold SB_SCREEN_WIDTH * SB_SCREEN_HEIGHT * 3 bytes */
+SLEEPYBOI_API void sb_framebuffer_rgb(sb_gameboy* gb, uint8_t* rgb);
+
+/* Size of a save state for the loaded ROM */
+SLEEPYBOI_API size_t sb_state_size(const sb_gameboy* gb);
+SLEEPYBOI_API sb_result sb_save_state(const sb_gameboy* gb, uint8_t* buffer, size_t size);
+SLEEPYBOI_API sb_result sb_load_state(sb_gameboy* gb, const uint8_t* data, size_t size);
+
+/* Bytes written to the serial port so far, not NUL-terminated */
+SLEEPYBOI_API const char* sb_serial_output(const sb_gameboy* gb, size_t* size);
+
+/* Message for the last failed call on `gb`, "" if none. Valid until the next call. */
+SLEEPYBOI_API const char* sb_last_error(const sb_gameboy* gb);
+
+/*
+ * Vectorized environment: `num_envs` clones of one Gameboy stepped together on a thread
+ * pool. Observations are num_envs * obs_height * obs_width bytes, RAM features are
+ * num_envs * num_ram_addresses bytes; both stay owned by the environment.
+ */
+typedef struct sb_vec_env sb_vec_env;
+
+typedef struct sb_vec_env_config {
+    int num_envs;
+    int frame_skip;                 /* frames per step, the action is held for all of them */
+    int max_pool;                   /* observation = darker of the last two frames, per pixel */
+    int downsample;                 /* 1, 2 or 4 */
+    int grayscale;                  /* 0 = raw SB_SHADE_* values, pooled by luminance all the same */
+    const uint16_t* ram_addresses;
+    size_t num_ram_addresses;
+    size_t threads;                 /* 0 = one per core */
+} sb_vec_env_config;
+
+/* NULL on failure, the reason is left in sb_last_error(start) */
+SLEEPYBOI_API sb_vec_env* sb_vec_env_create(const sb_gameboy* start, const sb_vec_env_config* config);
+SLEEPYBOI_API void sb_vec_env_destroy(sb_vec_env* env);
+/* `actions` holds num_envs SB_BUTTON_* masks. When an environment fails, the others still
+ * finish the step; reset the failed one (or all) before stepping on. */
+SLEEPYBOI_API sb_result sb_vec_env_step(sb_vec_env* env, const uint8_t* actions);
+/* index < 0 resets every environment */
+SLEEPYBOI_API sb_result sb_vec_env_reset(sb_vec_env* env, int index);
+/* Message for the last failed call on `env`, "" if none. Valid until the next call. */
+SLEEPYBOI_API const char* sb_vec_env_last_error(const sb_vec_env* env);
+SLEEPYBOI_API const uint8_t* sb_vec_env_observations(const sb_vec_env* env, int* width, int* height);
+SLEEPYBOI_API const uint8_t* sb_vec_env_ram_features(const sb_vec_env* env);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SLEEPYBOI_H */
@@ -0,0 +1,89 @@
+#ifndef SLEEPYBOI_PROTOCOL_H
+#define SLEEPYBOI_PROTOCOL_H
+
+/*
+ * Wire format of sleepy_boi_server (src/server_main.cpp), spoken over a Unix domain
+ * stream socket. Everything is little endian and packed as the structs below.
+ *
+ * A client sends batches:
+ *   sb_proto_batch_header          (magic SB_PROTO_REQUEST_MAGIC, size = bytes that follow)
+ *   count x { sb_proto_command, command.payload_size bytes of payload }
+ *
+ * and gets exactly one response per batch, in the order the batches were sent:
+ *   sb_proto_batch_header          (magic SB_PROTO_RESPONSE_MAGIC, same batch_id and count)
+ *   count x { sb_proto_result, result.payload_size bytes of payload }
+ *
+ * Batches may be pipelined: send as many as you like before reading any response.
+ * Within a batch the outcome is as if the commands ran in order, but commands on
+ * different instances between two "global" commands (CREATE, CLONE, DESTROY, SNAPSHOT,
+ * DROP_SNAPSHOT) run in parallel. A failed command does not stop the rest of the batch;
+ * its result carries a negative status and the error message as payload.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SB_PROTO_REQUEST_MAGIC  0x51524253 /* "SBRQ" */
+#define SB_PROTO_RESPONSE_MAGIC 0x53524253 /* "SBRS" */
+#define SB_PROTO_VERSION 1
+/* Larger batches close the connection */
+#define SB_PROTO_MAX_BATCH_SIZE (64u << 20)
+
+typedef struct sb_proto_batch_header {
+    uint32_t magic;
+    uint32_t size;
+    uint32_t batch_id;          /* echoed back, free for the client to use */
+    uint32_t count;
+} sb_proto_batch_header;
+
+typedef struct sb_proto_command {
+    uint8_t op;                 /* sb_proto_op */
+    uint8_t reserved[3];
+    uint32_t instance;
+    uint32_t arg0;
+    uint32_t arg1;
+    uint32_t payload_size;
+} sb_proto_command;
+
+typedef struct sb_proto_result {
+    int32_t status;             /* sb_proto_status */
+    uint32_t payload_size;
+} sb_proto_result;
+
+/*                                  arguments                       result payload */
+typedef enum sb_proto_op {
+    SB_OP_VERSION = 0,          /*                                  uint32 SB_PROTO_VERSION */
+    SB_OP_CREATE = 1,           /* payload: ROM path                uint32 instance */
+    SB_OP_CLONE = 2,            /* instance                         uint32 new instance */
+    SB_OP_DESTROY = 3,          /* instance */
+    SB_OP_RUN_FRAMES = 4,       /* instance, arg0: frames */
+    SB_OP_SET_INPUT = 5,        /* instance, arg0: SB_BUTTON_* */
+    SB_OP_SET_RENDERING = 6,    /* instance, arg0: 0/1 (off after CREATE) */
+    SB_OP_READ_MEMORY = 7,      /* instance, arg0: address, arg1: length   the bytes */
+    SB_OP_FRAMEBUFFER = 8,      /* instance                         160*144 SB_SHADE_* bytes */
+    SB_OP_SAVE_STATE = 9,       /* instance                         save state bytes */
+    SB_OP_LOAD_STATE = 10,      /* instance, payload: save state */
+    SB_OP_SNAPSHOT = 11,        /* instance                         uint32 snapshot, kept in the server */
+    SB_OP_RESTORE = 12,         /* instance, arg0: snapshot */
+    SB_OP_DROP_SNAPSHOT = 13,   /* arg0: snapshot */
+    SB_OP_SERIAL = 14           /* instance                         serial output so far */
+} sb_proto_op;
+
+typedef enum sb_proto_status {
+    SB_STATUS_OK = 0,
+    SB_STATUS_INVALID_ARGUMENT = -1,
+    SB_STATUS_ROM = -2,         /* ROM missing or not runnable */
+    SB_STATUS_STATE = -3,       /* corrupt state, or taken with another ROM/build */
+    SB_STATUS_NO_INSTANCE = -4, /* unknown instance or snapshot */
+    SB_STATUS_UNKNOWN_OP = -5,
+    SB_STATUS_INTERNAL = -6
+} sb_proto_status;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SLEEPYBOI_PROTOCOL_H */
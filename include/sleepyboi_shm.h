@@ -0,0 +1,111 @@
+#ifndef SLEEPYBOI_SHM_H
+#define SLEEPYBOI_SHM_H
+
+/*
+ * Layout of the shared-memory frame ring written by FrameExporter (src/frame_export.h).
+ * Readers only need this header: shm_open("/<name>", O_RDWR), mmap the whole object
+ * read-write, then follow write_sequence. Readers that poll instead of calling
+ * sb_shm_wait can open and map it read-only. The object is created with mode 0644 unless
+ * the emulator is told otherwise (SLEEPY_BOI_SHM_MODE), so by default only its own
+ * user can wait; other users have to poll.
+ *
+ *   sb_shm_header                  (header_size bytes)
+ *   slot 0 .. slot_count-1         (slot_size bytes each: sb_shm_slot, then the pixels)
+ *
+ * Frame n (counting from 1) lives in slot (n - 1) % slot_count until it is overwritten
+ * slot_count frames later. Pixels are width * height SB_SHADE_* bytes (see sleepyboi.h),
+ * row by row. Each slot is a seqlock: read `seqlock`, read the data, read `seqlock`
+ * again; the data is good if both reads returned 2n. Readers never write to the slots,
+ * so any number of them can follow the ring without slowing the emulator down. The one
+ * word they do write is `waiters`, which tells the writer whether a frame needs a
+ * FUTEX_WAKE at all.
+ *
+ * sb_shm_wait uses syscall(2), which strict -std=c99/c11 builds on glibc only declare
+ * with _DEFAULT_SOURCE defined.
+ */
+
+#include <stdint.h>
+
+#if defined(__linux__)
+    #include <linux/futex.h>
+    #include <sys/syscall.h>
+    #include <time.h>
+    #include <unistd.h>
+#elif defined(__unix__) || defined(__APPLE__)
+    #include <time.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SB_SHM_MAGIC 0x58464253 /* "SBFX" */
+#define SB_SHM_VERSION 2
+
+typedef struct sb_shm_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;       /* offset of slot 0 */
+    uint32_t slot_count;
+    uint32_t slot_size;
+    uint32_t width;
+    uint32_t height;
+    uint32_t writer_alive;      /* cleared when the emulator shuts the exporter down */
+    uint32_t notify;            /* futex word, bumped after every published frame */
+    uint32_t waiters;           /* readers asleep on `notify`, no wake-up is sent while 0 */
+    uint64_t write_sequence;    /* frames published so far, 0 = none yet */
+} sb_shm_header;
+
+typedef struct sb_shm_slot {
+    uint64_t seqlock;           /* 2n once frame n is complete, odd while it is written */
+    uint64_t frame;             /* emulator frame number */
+    uint64_t cycle;             /* PPU cycle count when the frame was finished */
+    uint16_t pc;                /* CPU state right after the frame */
+    uint8_t ly;
+    uint8_t buttons;            /* SB_BUTTON_* held during the frame */
+    uint32_t reserved;
+} sb_shm_slot;
+
+static inline uint64_t sb_shm_latest(const sb_shm_header* header) {
+    return __atomic_load_n(&header->write_sequence, __ATOMIC_ACQUIRE);
+}
+
+static inline const sb_shm_slot* sb_shm_slot_of(const sb_shm_header* header, uint64_t n) {
+    const uint8_t* base = (const uint8_t*)header + header->header_size;
+    return (const sb_shm_slot*)(base + ((n - 1) % header->slot_count) * header->slot_size);
+}
+
+static inline const uint8_t* sb_shm_pixels(const sb_shm_slot* slot) {
+    return (const uint8_t*)(slot + 1);
+}
+
+/* True if frame n is (still) in its slot. Call before and after reading it. */
+static inline int sb_shm_valid(const sb_shm_slot* slot, uint64_t n) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&slot->seqlock, __ATOMIC_ACQUIRE) == 2 * n;
+}
+
+/* Sleeps until `notify` moves past `seen` (a value read from header->notify earlier)
+ * or `timeout_ms` passes. Uses a futex on Linux and a short sleep elsewhere. The header
+ * has to be mapped writable, the reader counts itself in `waiters` while it sleeps. */
+static inline void sb_shm_wait(sb_shm_header* header, uint32_t seen, int timeout_ms) {
+#if defined(__linux__)
+    struct timespec timeout = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+    /* Counted before notify is checked: either the writer sees the count, or this sees
+     * the new notify value (both sides use sequentially consistent atomics) */
+    __atomic_add_fetch(&header->waiters, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&header->notify, __ATOMIC_SEQ_CST) == seen)
+        syscall(SYS_futex, &header->notify, FUTEX_WAIT, seen, &timeout, NULL, 0);
+    __atomic_sub_fetch(&header->waiters, 1, __ATOMIC_SEQ_CST);
+#elif defined(__unix__) || defined(__APPLE__)
+    struct timespec pause = {0, 1000000L};
+    for (int waited = 0; waited < timeout_ms && __atomic_load_n(&header->notify, __ATOMIC_ACQUIRE) == seen; waited++)
+        nanosleep(&pause, NULL);
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SLEEPYBOI_SHM_H */
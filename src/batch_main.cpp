@@ -0,0 +1,246 @@
+// sleepy_boi_batch : runs many headless Gameboy instances across all cores
+//
+// usage: sleepy_boi_batch <jobfile> [threads]
+//
+// Every non-empty line of the job file that does not start with '#' is one job:
+//   <rom> [frames=N] [until_serial=TEXT] [movie=PATH] [instances=K]
+//         [dataset=PREFIX] [pixels=shades|rgb|none] [ram=ADDR:SIZE,...]
+//
+//   frames        stop after N frames (default 3600, or the movie length with movie=)
+//   until_serial  stop as soon as the serial output contains TEXT
+//   movie         start from the movie's initial state and feed its per-frame input
+//   instances     run K identical copies of the job
+//   dataset       record every frame into .npy shards starting with PREFIX (see dataset.h),
+//                 instances get PREFIX_<k>
+//   pixels        what dataset= stores of the screen (default shades)
+//   ram           RAM regions dataset= stores, hex, e.g. ram=C000:100,FF80:7F
+
+#include "dataset.h"
+#include "gameboy.h"
+#include "movie.h"
+#include "savestate.h"
+#include "thread_pool.h"
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+struct JobSpec {
+    std::string rom;
+    uint64_t frames = 0;
+    std::string until_serial;
+    std::string movie_path;
+    int instances = 1;
+    DatasetConfig dataset;
+};
+
+struct Job {
+    Job(const JobSpec* spec, std::shared_ptr<const RomImage> rom, std::shared_ptr<const Movie> movie, int instance)
+        : spec(spec), rom(std::move(rom)), movie(std::move(movie)), instance(instance) {}
+
+    const JobSpec* spec;
+    std::shared_ptr<const RomImage> rom;
+    std::shared_ptr<const Movie> movie;
+    int instance;
+    std::unique_ptr<Gameboy> gb;
+    std::unique_ptr<DatasetWriter> dataset;
+    uint64_t frames_run = 0;
+    uint64_t frame_limit = 0;
+    std::string result;
+};
+
+// Frames a job runs before going back to the pool, small enough for idle threads to steal
+// work near the end of a batch, big enough that scheduling costs nothing
+static constexpr uint64_t SLICE_FRAMES = 60;
+static constexpr uint64_t DEFAULT_FRAMES = 3600;
+
+static DatasetConfig::Pixels parse_pixels(const std::string& value) {
+    if (value == "shades") return DatasetConfig::Pixels::SHADES;
+    if (value == "rgb") return DatasetConfig::Pixels::RGB;
+    if (value == "none") return DatasetConfig::Pixels::NONE;
+    throw std::runtime_error("pixels must be shades, rgb or none");
+}
+
+static std::vector<DatasetConfig::RamRegion> parse_ram_regions(const std::string& value) {
+    std::vector<DatasetConfig::RamRegion> regions;
+    std::istringstream list(value);
+    std::string region;
+    while (std::getline(list, region, ',')) {
+        size_t colon = region.find(':');
+        if (colon == std::string::npos)
+            throw std::runtime_error("ram regions are ADDR:SIZE");
+        regions.push_back({static_cast<uint16_t>(std::stoul(region.substr(0, colon), nullptr, 16)),
+                           static_cast<uint16_t>(std::stoul(region.substr(colon + 1), nullptr, 16))});
+    }
+    return regions;
+}
+
+static std::vector<JobSpec> parse_jobs(const std::string& path) {
+    std::ifstream file(path);
+    if (!file)
+        throw std::runtime_error("could not open " + path);
+
+    std::vector<JobSpec> specs;
+    std::string line;
+    for (int line_number = 1; std::getline(file, line); line_number++) {
+        std::istringstream words(line);
+        JobSpec spec;
+        if (!(words >> spec.rom) || spec.rom[0] == '#') continue;
+
+        std::string option;
+        while (words >> option) {
+            size_t eq = option.find('=');
+            std::string key = option.substr(0, eq);
+            std::string value = eq == std::string::npos ? "" : option.substr(eq + 1);
+            if (key == "frames")
+                spec.frames = std::stoull(value);
+            else if (key == "until_serial")
+                spec.until_serial = value;
+            else if (key == "movie")
+                spec.movie_path = value;
+            else if (key == "instances")
+                spec.instances = std::stoi(value);
+            else if (key == "dataset")
+                spec.dataset.prefix = value;
+            else if (key == "pixels")
+                spec.dataset.pixels = parse_pixels(value);
+            else if (key == "ram")
+                spec.dataset.ram = parse_ram_regions(value);
+            else
+                throw std::runtime_error(path + ":" + std::to_string(line_number) + ": unknown option " + key);
+        }
+        specs.push_back(spec);
+    }
+    return specs;
+}
+
+static void start_job(Job& job) {
+    job.gb = std::make_unique<Gameboy>();
+    job.gb->LoadROM(job.rom);
+    job.gb->SetSerialCapture(true);
+    job.gb->SetRendering(false);
+    job.gb->SetRunning(true);
+
+    if (!job.spec->dataset.prefix.empty()) {
+        DatasetConfig config = job.spec->dataset;
+        if (job.spec->instances > 1)
+            config.prefix += "_" + std::to_string(job.instance);
+        job.dataset = std::make_unique<DatasetWriter>(config);
+        job.gb->SetRendering(config.pixels != DatasetConfig::Pixels::NONE);
+    }
+
+    job.frame_limit = job.spec->frames;
+    if (job.movie) {
+        if (!job.movie->initial_state.empty()) {
+            GameboyState state;
+            deserialize_state(job.movie->initial_state.data(), job.movie->initial_state.size(), state);
+            job.gb->LoadState(state);
+        }
+        if (job.frame_limit == 0)
+            job.frame_limit = job.movie->frames();
+    }
+    if (job.frame_limit == 0)
+        job.frame_limit = DEFAULT_FRAMES;
+}
+
+// Runs one slice, returns true once the job has hit its stop condition
+static bool run_slice(Job& job) {
+    Gameboy& gb = *job.gb;
+    for (uint64_t i = 0; i < SLICE_FRAMES; i++) {
+        if (job.frames_run >= job.frame_limit) {
+            job.result = "frame limit";
+            return true;
+        }
+        if (job.movie && job.frames_run < job.movie->frames())
+            job.movie->apply_frame(job.frames_run, gb);
+
+        gb.Update();
+        job.frames_run++;
+        if (job.dataset)
+            job.dataset->record(gb);
+
+        if (!job.spec->until_serial.empty() && gb.GetSerialOutput().find(job.spec->until_serial) != std::string::npos) {
+            job.result = "serial matched";
+            return true;
+        }
+    }
+    return false;
+}
+
+static void schedule(ThreadPool& pool, Job& job) {
+    pool.submit([&pool, &job] {
+        try {
+            if (!job.gb) start_job(job);
+            if (!run_slice(job)) {
+                schedule(pool, job);
+                return;
+            }
+            if (job.dataset) {
+                job.dataset->close();
+                job.result += ", " + std::to_string(job.dataset->shards()) + " shards ("
+                              + std::to_string(job.dataset->stalls()) + " waits on disk)";
+            }
+        } catch (const std::exception& e) {
+            job.result = std::string("error: ") + e.what();
+        }
+        // Finished, give the memory back while the rest of the batch runs
+        job.gb.reset();
+        job.dataset.reset();
+    });
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " <jobfile> [threads]" << std::endl;
+        return 1;
+    }
+
+    std::vector<JobSpec> specs;
+    std::vector<Job> jobs;
+    try {
+        specs = parse_jobs(argv[1]);
+        // Every instance of a job runs off the same ROM image and movie
+        for (const JobSpec& spec : specs) {
+            std::shared_ptr<const RomImage> rom = RomImage::from_file(spec.rom);
+            std::shared_ptr<const Movie> movie;
+            if (!spec.movie_path.empty())
+                movie = std::make_shared<const Movie>(Movie::load(spec.movie_path));
+            for (int k = 0; k < spec.instances; k++)
+                jobs.emplace_back(&spec, rom, movie, k);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    const size_t threads = argc > 2 ? std::stoul(argv[2]) : std::thread::hardware_concurrency();
+    ThreadPool pool(threads);
+
+    auto start = std::chrono::steady_clock::now();
+    for (Job& job : jobs)
+        schedule(pool, job);
+    pool.wait();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    uint64_t total_frames = 0;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const Job& job = jobs[i];
+        total_frames += job.frames_run;
+        std::cout << "#" << i << " " << job.spec->rom << ": " << job.frames_run << " frames, " << job.result << std::endl;
+    }
+
+    const double fps = total_frames / elapsed.count();
+    std::cout << std::fixed << std::setprecision(1)
+              << jobs.size() << " instances, " << total_frames << " frames in " << elapsed.count() << " s on "
+              << pool.size() << " threads: " << fps << " fps (" << fps / (4194304.0 / 70224.0) << "x real time)" << std::endl;
+
+    for (const Job& job : jobs) {
+        if (job.result.rfind("error", 0) == 0) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,441 @@
+// sleepy_boi_bench : microbenchmarks for the emulator's hot paths
+//
+// usage: sleepy_boi_bench [--filter TEXT] [--samples N] [--sample-ms MS] [--out PATH]
+//
+//   --filter     only run benchmarks whose name contains TEXT
+//   --samples    timed samples per benchmark (default 25)
+//   --sample-ms  minimum length of one sample, the op count is calibrated to it (default 5)
+//   --out        write the JSON report to PATH instead of stdout
+//
+// Every benchmark is a loop over one operation (an instruction, a memory access, a
+// scanline, a frame). Each sample times enough iterations to last --sample-ms, and the
+// report gives the per-op median and p99 over all samples, which hold still across runs
+// far better than a single mean. Everything runs on ROMs generated here, so the numbers
+// do not depend on what happens to be lying around.
+
+#include "cartridge.h"
+#include "gameboy.h"
+#include "mmu.h"
+#include "rom_image.h"
+#include "test_util.h"
+#include "video/ppu_renderer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+struct Options {
+    std::string filter;
+    int samples = 25;
+    double sample_ms = 5.0;
+    std::string out_path;
+};
+
+struct Report {
+    std::string name;
+    std::string unit;
+    std::vector<double> ns_per_op;  // one entry per sample, sorted
+};
+
+// Keeps the compiler from dropping reads whose result is otherwise unused
+static volatile uint64_t g_sink;
+
+class Bench
+{
+public:
+    explicit Bench(const Options& options)
+        : m_options(options) {}
+
+    // `body(n)` performs n operations of the benchmark
+    void run(const std::string& name, const std::string& unit, const std::function<void(uint64_t)>& body) {
+        if (!m_options.filter.empty() && name.find(m_options.filter) == std::string::npos) return;
+
+        using clock = std::chrono::steady_clock;
+        auto time_ns = [&](uint64_t ops) {
+            auto start = clock::now();
+            body(ops);
+            return std::chrono::duration<double, std::nano>(clock::now() - start).count();
+        };
+
+        // Grow the op count until one sample lasts long enough, this also warms up caches
+        uint64_t ops = 1;
+        const double target_ns = m_options.sample_ms * 1e6;
+        for (double elapsed = time_ns(ops); elapsed < target_ns; elapsed = time_ns(ops)) {
+            const double scale = elapsed > 0 ? target_ns / elapsed : 100.0;
+            ops = std::max<uint64_t>(ops + 1, ops * std::min(100.0, scale * 1.1));
+        }
+
+        Report report {name, unit, {}};
+        for (int i = 0; i < m_options.samples; i++)
+            report.ns_per_op.push_back(time_ns(ops) / ops);
+        std::sort(report.ns_per_op.begin(), report.ns_per_op.end());
+        std::cerr << std::left << std::setw(36) << name << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(12) << percentile(report.ns_per_op, 0.5) << " ns/" << unit << std::endl;
+        m_reports.push_back(std::move(report));
+    }
+
+    void write_json(std::ostream& out) const {
+        out << "{\n  \"samples\": " << m_options.samples << ",\n  \"sample_ms\": " << m_options.sample_ms
+            << ",\n  \"benchmarks\": [\n";
+        out << std::fixed << std::setprecision(3);
+        for (size_t i = 0; i < m_reports.size(); i++) {
+            const Report& report = m_reports[i];
+            const double median = percentile(report.ns_per_op, 0.5);
+            out << "    {\"name\": \"" << report.name << "\", \"unit\": \"" << report.unit << "\""
+                << ", \"median_ns\": " << median
+                << ", \"p99_ns\": " << percentile(report.ns_per_op, 0.99)
+                << ", \"min_ns\": " << report.ns_per_op.front()
+                << ", \"max_ns\": " << report.ns_per_op.back()
+                << ", \"per_second\": " << (median > 0 ? 1e9 / median : 0.0) << "}"
+                << (i + 1 < m_reports.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n}\n";
+    }
+
+private:
+    // Nearest-rank percentile of sorted samples
+    static double percentile(const std::vector<double>& sorted, double p) {
+        size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+        return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+    }
+
+    Options m_options;
+    std::vector<Report> m_reports;
+};
+
+// Synthetic ROMs, numbered banks and a VBLANK handler that just returns
+static std::vector<uint8_t> make_rom(const std::vector<uint8_t>& program, uint8_t type = 0x00, uint8_t rom_size = 0) {
+    std::vector<uint8_t> handlers(0x41, 0x00);
+    handlers[0x40] = 0xD9;  // reti
+    return make_test_rom(program, handlers, type, rom_size, 0, true);
+}
+
+// Register-heavy busy loop
+static const std::vector<uint8_t> ALU_PROGRAM = {
+    0x80,               // add a, b
+    0x04,               // inc b
+    0xA9,               // xor c
+    0x0D,               // dec c
+    0x57,               // ld d, a
+    0xCB, 0x37,         // swap a
+    0x18, 0xF7          // jr -9
+};
+
+// Fills VRAM over and over and scrolls, so every frame draws something new
+static const std::vector<uint8_t> VRAM_PROGRAM = {
+    0x21, 0x00, 0x80,   // ld hl, 8000
+    0x06, 0x00,         // ld b, 0
+    0x78,               // loop: ld a, b
+    0x22,               // ld (hl+), a
+    0x04,               // inc b
+    0x7C,               // ld a, h
+    0xFE, 0x98,         // cp 98
+    0x20, 0xF8,         // jr nz, loop
+    0x21, 0x00, 0x80,   // ld hl, 8000
+    0xF0, 0x43,         // ldh a, (SCX)
+    0x3C,               // inc a
+    0xE0, 0x43,         // ldh (SCX), a
+    0x18, 0xEE          // jr loop
+};
+
+// Sleeps in HALT between VBLANK interrupts, like most games do most of the time
+static const std::vector<uint8_t> HALT_PROGRAM = {
+    0x3E, 0x01,         // ld a, 01
+    0xE0, 0xFF,         // ldh (IE), a
+    0xFB,               // ei
+    0x76,               // halt
+    0x18, 0xFD          // jr -3
+};
+
+// Switches MBC1 ROM banks as fast as it can and reads from each
+static const std::vector<uint8_t> BANKING_PROGRAM = {
+    0x78,               // ld a, b
+    0xEA, 0x00, 0x20,   // ld (2000), a
+    0xFA, 0x00, 0x40,   // ld a, (4000)
+    0x04,               // inc b
+    0x18, 0xF6          // jr -10
+};
+
+// CPU, MMU, timer, PPU and joypad wired together the way Gameboy does it, but with the
+// parts reachable from the benchmarks
+struct Rig {
+    MMU mmu;
+    CPU cpu;
+    Timer timer;
+    Video video;
+    Joypad joypad;
+    std::unique_ptr<Cartridge> cartridge;
+
+    explicit Rig(std::shared_ptr<const RomImage> rom)
+        : cpu(mmu), timer(mmu), video(mmu), joypad(mmu) {
+        mmu.connect_cpu(&cpu);
+        mmu.connect_timer(&timer);
+        mmu.connect_video(&video);
+        mmu.connect_joypad(&joypad);
+        if (rom->header().type == CartridgeType::MBC1)
+            cartridge = std::make_unique<CartridgeMBC1>(rom);
+        else
+            cartridge = std::make_unique<CartridgeNoMBC>(rom);
+        mmu.connect_cartridge(cartridge.get());
+        mmu.write_byte(0xFF50, 1);  // unmap the boot ROM
+    }
+
+    void set_registers(uint16_t pc, uint16_t sp, uint16_t hl) {
+        CPU::State state;
+        cpu.save_state(state);
+        state.pc = pc;
+        state.sp = sp;
+        state.h = hl >> 8;
+        state.l = hl & 0xFF;
+        cpu.load_state(state);
+    }
+};
+
+// Instructions are repeated through C000 - CFFF with a jump back at the end, so the
+// loop overhead is one jp per few thousand instructions
+static void bench_opcodes(Bench& bench, const std::shared_ptr<const RomImage>& rom) {
+    struct OpcodeClass {
+        const char* name;
+        std::vector<uint8_t> code;
+    };
+    const std::vector<OpcodeClass> classes = {
+        {"nop", {0x00}},
+        {"ld_r_r", {0x41}},
+        {"ld_r_n", {0x06, 0x12}},
+        {"ld_r_(hl)", {0x7E}},
+        {"ld_(hl)_r", {0x70}},
+        {"ldh_a_(n)", {0xF0, 0x44}},
+        {"alu_a_r", {0x80}},
+        {"alu_a_n", {0xC6, 0x01}},
+        {"inc_dec_r", {0x04}},
+        {"inc_dec_rr", {0x03}},
+        {"add_hl_rr", {0x09}},
+        {"push_pop", {0xC5, 0xC1}},
+        {"jr", {0x18, 0x00}},
+        {"jp_nn", {}},
+        {"cb_shift", {0xCB, 0x37}},
+        {"cb_bit", {0xCB, 0x40}},
+    };
+
+    for (const OpcodeClass& op : classes) {
+        Rig rig(rom);
+        uint16_t address = 0xC000;
+        const uint16_t end = 0xD000 - 3;
+        if (op.code.empty()) {
+            // jp to the next instruction, over and over
+            for (; address + 3 <= end; address += 3) {
+                rig.mmu.write_byte(address, 0xC3);
+                rig.mmu.write_byte(address + 1, (address + 3) & 0xFF);
+                rig.mmu.write_byte(address + 2, (address + 3) >> 8);
+            }
+        } else {
+            for (; address + op.code.size() <= end; address += op.code.size()) {
+                for (size_t i = 0; i < op.code.size(); i++)
+                    rig.mmu.write_byte(address + i, op.code[i]);
+            }
+        }
+        rig.mmu.write_byte(address, 0xC3);
+        rig.mmu.write_byte(address + 1, 0x00);
+        rig.mmu.write_byte(address + 2, 0xC0);
+        // (hl) points at a scratch area past the code, the stack sits at the top of WRAM
+        rig.set_registers(0xC000, 0xDFF0, 0xD800);
+
+        bench.run(std::string("cpu/") + op.name, "instr", [&rig](uint64_t n) {
+            uint64_t cycles = 0;
+            for (uint64_t i = 0; i < n; i++)
+                cycles += rig.cpu.execute_next_opcode();
+            g_sink = cycles;
+        });
+    }
+}
+
+static void bench_mmu(Bench& bench, const std::shared_ptr<const RomImage>& rom) {
+    struct Region {
+        const char* name;
+        uint16_t base;
+        uint16_t size;
+    };
+    const std::vector<Region> reads = {
+        {"rom0", 0x0100, 0x3F00},
+        {"romx", 0x4000, 0x4000},
+        {"vram", 0x8000, 0x2000},
+        {"wram", 0xC000, 0x2000},
+        {"echo", 0xE000, 0x1E00},
+        {"oam", 0xFE00, 0x00A0},
+        {"io", 0xFF40, 0x000C},
+        {"hram", 0xFF80, 0x007F},
+    };
+    const std::vector<Region> writes = {
+        {"vram", 0x8000, 0x2000},
+        {"wram", 0xC000, 0x2000},
+        {"oam", 0xFE00, 0x00A0},
+        {"io_scy", 0xFF42, 0x0001},
+        {"hram", 0xFF80, 0x007F},
+    };
+
+    Rig rig(rom);
+    for (const Region& region : reads) {
+        bench.run(std::string("mmu/read/") + region.name, "read", [&rig, region](uint64_t n) {
+            uint64_t sum = 0;
+            uint16_t offset = 0;
+            for (uint64_t i = 0; i < n; i++) {
+                sum += rig.mmu.read_byte(region.base + offset);
+                if (++offset == region.size) offset = 0;
+            }
+            g_sink = sum;
+        });
+    }
+    for (const Region& region : writes) {
+        bench.run(std::string("mmu/write/") + region.name, "write", [&rig, region](uint64_t n) {
+            uint16_t offset = 0;
+            for (uint64_t i = 0; i < n; i++) {
+                rig.mmu.write_byte(region.base + offset, i & 0xFF);
+                if (++offset == region.size) offset = 0;
+            }
+        });
+    }
+}
+
+static void bench_ppu(Bench& bench) {
+    struct Variant {
+        const char* name;
+        uint8_t lcd_control;
+    };
+    // 0x91: BG on, tiles at 8000, 0x81: signed tile indices at 8800, 0xF1: plus the window
+    const std::vector<Variant> variants = {{"bg", 0x91}, {"bg_signed", 0x81}, {"bg_window", 0xF1}};
+
+    std::vector<uint8_t> vram(0x2000);
+    for (size_t i = 0; i < vram.size(); i++) vram[i] = (i * 37) & 0xFF;
+    std::vector<uint8_t> oam(0xA0, 0);
+    Framebuffer framebuffer;
+
+    for (const Variant& variant : variants) {
+        PPURegisters regs;
+        regs.lcd_control = variant.lcd_control;
+        regs.winy = 40;
+        regs.winx = 47;
+        regs.bg_pallet = 0xE4;
+        bench.run(std::string("ppu/scanline/") + variant.name, "line", [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; i++) {
+                regs.ly = i % Framebuffer::HEIGHT;
+                regs.scroll_x = i / Framebuffer::HEIGHT;
+                PPURenderer::draw_scanline(vram.data(), oam.data(), regs, framebuffer);
+            }
+            g_sink = framebuffer.get_buffer_ptr()[0];
+        });
+    }
+}
+
+static void bench_cartridge(Bench& bench, const std::shared_ptr<const RomImage>& rom_32k, const std::shared_ptr<const RomImage>& rom_1m) {
+    CartridgeNoMBC no_mbc(rom_32k);
+    bench.run("cartridge/nombc/read", "read", [&no_mbc](uint64_t n) {
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < n; i++)
+            sum += no_mbc.read(i & 0x7FFF);
+        g_sink = sum;
+    });
+
+    CartridgeMBC1 mbc1(rom_1m);
+    bench.run("cartridge/mbc1/read_romx", "read", [&mbc1](uint64_t n) {
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < n; i++)
+            sum += mbc1.read(0x4000 | (i & 0x3FFF));
+        g_sink = sum;
+    });
+    bench.run("cartridge/mbc1/switch_and_read", "switch", [&mbc1](uint64_t n) {
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < n; i++) {
+            mbc1.write(0x2000, (i & 0x1F) | 1);
+            sum += mbc1.read(0x4000 | ((i * 7) & 0x3FFF));
+        }
+        g_sink = sum;
+    });
+}
+
+static void bench_frames(Bench& bench) {
+    struct Workload {
+        const char* name;
+        const std::vector<uint8_t>& program;
+        uint8_t type;
+        uint8_t rom_size;
+        bool rendering;
+    };
+    const std::vector<Workload> workloads = {
+        {"alu", ALU_PROGRAM, 0x00, 0, true},
+        {"alu_norender", ALU_PROGRAM, 0x00, 0, false},
+        {"vram", VRAM_PROGRAM, 0x00, 0, true},
+        {"vram_norender", VRAM_PROGRAM, 0x00, 0, false},
+        {"halt", HALT_PROGRAM, 0x00, 0, true},
+        {"mbc1_banking", BANKING_PROGRAM, 0x01, 5, false},
+    };
+
+    for (const Workload& workload : workloads) {
+        Gameboy gb;
+        gb.LoadROM(RomImage::from_bytes(make_rom(workload.program, workload.type, workload.rom_size)));
+        gb.SetRunning(true);
+        gb.SetRendering(workload.rendering);
+        // Get through the boot ROM's logo scroll first
+        for (int i = 0; i < BOOT_FRAMES; i++)
+            gb.Update();
+
+        bench.run(std::string("frame/") + workload.name, "frame", [&gb](uint64_t n) {
+            for (uint64_t i = 0; i < n; i++)
+                gb.Update();
+        });
+    }
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "usage: " << argv[0] << " [--filter TEXT] [--samples N] [--sample-ms MS] [--out PATH]" << std::endl;
+            return 1;
+        }
+        const std::string value = argv[++i];
+        try {
+            if (arg == "--filter") options.filter = value;
+            else if (arg == "--samples") options.samples = std::max(1, std::stoi(value));
+            else if (arg == "--sample-ms") options.sample_ms = std::stod(value);
+            else if (arg == "--out") options.out_path = value;
+            else {
+                std::cerr << "unknown option " << arg << std::endl;
+                return 1;
+            }
+        } catch (const std::logic_error&) {
+            std::cerr << "invalid argument. " << arg << " needs a number, got " << value << std::endl;
+            return 1;
+        }
+    }
+
+    const auto rom_32k = RomImage::from_bytes(make_rom(ALU_PROGRAM));
+    const auto rom_1m = RomImage::from_bytes(make_rom(BANKING_PROGRAM, 0x01, 5));
+
+    Bench bench(options);
+    bench_opcodes(bench, rom_32k);
+    bench_mmu(bench, rom_32k);
+    bench_ppu(bench);
+    bench_cartridge(bench, rom_32k, rom_1m);
+    bench_frames(bench);
+
+    if (options.out_path.empty()) {
+        bench.write_json(std::cout);
+    } else {
+        std::ofstream out(options.out_path);
+        bench.write_json(out);
+        if (!out) {
+            std::cerr << "could not write " << options.out_path << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
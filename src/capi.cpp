@@ -0,0 +1,230 @@
+#include "sleepyboi.h"
+#include "gameboy.h"
+#include "savestate.h"
+#include "vec_env.h"
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+struct sb_gameboy {
+    std::unique_ptr<Gameboy> gb;
+    mutable std::string error;
+    // scratch for sb_save_state/sb_state_size, so saving every frame doesn't allocate
+    mutable GameboyState state;
+    mutable std::vector<uint8_t> bytes;
+};
+
+struct sb_vec_env {
+    std::unique_ptr<VecEnv> env;
+    mutable std::string error;
+};
+
+static_assert(SB_BUTTON_START == (1 << Joypad::START), "SB_BUTTON_* must match Joypad::Button");
+static_assert(SB_SHADE_BLACK == static_cast<int>(FB_COLOR::FB_BLACK), "SB_SHADE_* must match FB_COLOR");
+static_assert(SB_SCREEN_WIDTH == Framebuffer::WIDTH && SB_SCREEN_HEIGHT == Framebuffer::HEIGHT, "screen size mismatch");
+
+// Runs `f`, turning exceptions into an sb_result (and `handle->error`) so nothing unwinds into C code
+template<typename Handle, typename F>
+static sb_result guarded(const Handle* handle, F f) {
+    try {
+        handle->error.clear();
+        return f();
+    } catch (const std::invalid_argument& e) {
+        handle->error = e.what();
+        return SB_ERROR_INVALID_ARGUMENT;
+    } catch (const std::exception& e) {
+        handle->error = e.what();
+        return SB_ERROR_INTERNAL;
+    } catch (...) {
+        handle->error = "unknown error";
+        return SB_ERROR_INTERNAL;
+    }
+}
+
+static void serialize(const sb_gameboy* handle) {
+    handle->gb->SaveState(handle->state);
+    serialize_state(handle->state, handle->bytes);
+}
+
+int sb_api_version(void) {
+    return SB_API_VERSION;
+}
+
+sb_gameboy* sb_create(void) {
+    try {
+        auto handle = std::make_unique<sb_gameboy>();
+        handle->gb = std::make_unique<Gameboy>();
+        handle->gb->SetSerialCapture(true);
+        handle->gb->SetRunning(true);
+        return handle.release();
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void sb_destroy(sb_gameboy* gb) {
+    delete gb;
+}
+
+sb_gameboy* sb_clone(const sb_gameboy* gb) {
+    if (!gb) return nullptr;
+    try {
+        auto handle = std::make_unique<sb_gameboy>();
+        handle->gb = gb->gb->clone();
+        return handle.release();
+    } catch (const std::exception& e) {
+        gb->error = e.what();
+        return nullptr;
+    }
+}
+
+sb_result sb_load_rom(sb_gameboy* gb, const uint8_t* data, size_t size) {
+    if (!gb || !data) return SB_ERROR_INVALID_ARGUMENT;
+    return guarded(gb, [&] {
+        try {
+            gb->gb->LoadROM(RomImage::from_bytes(std::vector<uint8_t>(data, data + size)));
+        } catch (const std::invalid_argument& e) {
+            gb->error = e.what();
+            return SB_ERROR_ROM;
+        }
+        return SB_OK;
+    });
+}
+
+sb_result sb_run_frames(sb_gameboy* gb, int frames) {
+    if (!gb || frames < 0) return SB_ERROR_INVALID_ARGUMENT;
+    return guarded(gb, [&] {
+        for (int i = 0; i < frames; i++)
+            gb->gb->Update();
+        return SB_OK;
+    });
+}
+
+void sb_set_rendering(sb_gameboy* gb, int enabled) {
+    if (gb) gb->gb->SetRendering(enabled != 0);
+}
+
+void sb_set_input(sb_gameboy* gb, uint8_t buttons) {
+    if (gb) gb->gb->SetButtons(buttons);
+}
+
+const uint8_t* sb_framebuffer(sb_gameboy* gb) {
+    return gb ? gb->gb->GetFramebuffer() : nullptr;
+}
+
+void sb_framebuffer_rgb(sb_gameboy* gb, uint8_t* rgb) {
+    if (gb && rgb) gb->gb->GetFrame().framebuffer.to_rgb(rgb);
+}
+
+size_t sb_state_size(const sb_gameboy* gb) {
+    if (!gb) return 0;
+    sb_result result = guarded(gb, [&] {
+        serialize(gb);
+        return SB_OK;
+    });
+    return result == SB_OK ? gb->bytes.size() : 0;
+}
+
+sb_result sb_save_state(const sb_gameboy* gb, uint8_t* buffer, size_t size) {
+    if (!gb || !buffer) return SB_ERROR_INVALID_ARGUMENT;
+    return guarded(gb, [&] {
+        serialize(gb);
+        if (size < gb->bytes.size()) {
+            gb->error = "buffer is smaller than sb_state_size()";
+            return SB_ERROR_BUFFER_TOO_SMALL;
+        }
+        std::memcpy(buffer, gb->bytes.data(), gb->bytes.size());
+        return SB_OK;
+    });
+}
+
+sb_result sb_load_state(sb_gameboy* gb, const uint8_t* data, size_t size) {
+    if (!gb || !data) return SB_ERROR_INVALID_ARGUMENT;
+    return guarded(gb, [&] {
+        try {
+            deserialize_state(data, size, gb->state);
+            gb->gb->LoadState(gb->state);
+        } catch (const std::exception& e) {
+            gb->error = e.what();
+            return SB_ERROR_STATE;
+        }
+        return SB_OK;
+    });
+}
+
+const char* sb_serial_output(const sb_gameboy* gb, size_t* size) {
+    if (!gb) {
+        if (size) *size = 0;
+        return "";
+    }
+    const std::string& output = gb->gb->GetSerialOutput();
+    if (size) *size = output.size();
+    return output.data();
+}
+
+const char* sb_last_error(const sb_gameboy* gb) {
+    return gb ? gb->error.c_str() : "invalid handle";
+}
+
+sb_vec_env* sb_vec_env_create(const sb_gameboy* start, const sb_vec_env_config* config) {
+    if (!start || !config) return nullptr;
+    try {
+        VecEnvConfig cfg;
+        cfg.num_envs = config->num_envs;
+        cfg.frame_skip = config->frame_skip;
+        cfg.max_pool = config->max_pool != 0;
+        cfg.downsample = config->downsample;
+        cfg.grayscale = config->grayscale != 0;
+        if (config->ram_addresses)
+            cfg.ram_addresses.assign(config->ram_addresses, config->ram_addresses + config->num_ram_addresses);
+        if (config->threads != 0)
+            cfg.threads = config->threads;
+
+        auto handle = std::make_unique<sb_vec_env>();
+        handle->env = std::make_unique<VecEnv>(*start->gb, cfg);
+        return handle.release();
+    } catch (const std::exception& e) {
+        start->error = e.what();
+        return nullptr;
+    }
+}
+
+void sb_vec_env_destroy(sb_vec_env* env) {
+    delete env;
+}
+
+sb_result sb_vec_env_step(sb_vec_env* env, const uint8_t* actions) {
+    if (!env || !actions) return SB_ERROR_INVALID_ARGUMENT;
+    return guarded(env, [&] {
+        env->env->step(actions);
+        return SB_OK;
+    });
+}
+
+sb_result sb_vec_env_reset(sb_vec_env* env, int index) {
+    if (!env || index >= env->env->num_envs()) return SB_ERROR_INVALID_ARGUMENT;
+    return guarded(env, [&] {
+        if (index < 0)
+            env->env->reset();
+        else
+            env->env->reset(index);
+        return SB_OK;
+    });
+}
+
+const char* sb_vec_env_last_error(const sb_vec_env* env) {
+    return env ? env->error.c_str() : "invalid handle";
+}
+
+const uint8_t* sb_vec_env_observations(const sb_vec_env* env, int* width, int* height) {
+    if (!env) return nullptr;
+    if (width) *width = env->env->obs_width();
+    if (height) *height = env->env->obs_height();
+    return env->env->observations();
+}
+
+const uint8_t* sb_vec_env_ram_features(const sb_vec_env* env) {
+    return env ? env->env->ram_features() : nullptr;
+}
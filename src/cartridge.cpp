@@ -1,4 +1,5 @@
 #include "cartridge.h"
+#include "rom_image.h"
 #include <stdexcept>
 #include <string>
 
@@ -10,7 +11,10 @@
     ram_size = y; \
     break; \
 
-CartridgeHeader get_header_from_romdata(std::vector<uint8_t>& rom_data) {
+CartridgeHeader get_header_from_romdata(const uint8_t* rom_data, size_t size) {
+    if (size < 0x150)
+        throw std::invalid_argument("invalid argument. rom is too small to contain a cartridge header");
+
     std::string title(' ', 16);
     for (int i = 0; i <= 0xF; i++)
         if (rom_data[0x134 + i] != 0) title[i] = rom_data[0x134 + i];
@@ -69,16 +73,30 @@ CartridgeHeader get_header_from_romdata(std::vector<uint8_t>& rom_data) {
     return header;
 }
 
-Cartridge::Cartridge(std::vector<uint8_t> rom_data, std::vector<uint8_t> ram_data)
-    :m_rom(rom_data), m_ram(ram_data) {
-    m_rom.reserve(0x8000);
-    m_ram.reserve(0x2000);
+Cartridge::Cartridge(std::shared_ptr<const RomImage> rom, std::vector<uint8_t> ram_data)
+    :m_rom_image(std::move(rom)), m_ram(std::move(ram_data)) {
+    m_rom = m_rom_image->data();
+    m_rom_bank_mask = m_rom_image->bank_mask();
+    if (m_ram.size() < 0x2000) m_ram.resize(0x2000);
 }
 
 Cartridge::~Cartridge() {}
 
-CartridgeNoMBC::CartridgeNoMBC(std::vector<uint8_t> rom_data, std::vector<uint8_t> ram_data)
-    : Cartridge(rom_data, ram_data) {}
+void Cartridge::save_state(CartridgeState& state, std::vector<uint8_t>& ram) const {
+    state = CartridgeState {1, 0, false, false};
+    // assign() reuses the capacity of an existing snapshot, no allocation after the first one
+    ram.assign(m_ram.begin(), m_ram.end());
+}
+
+// No mapper registers here, the CartridgeState is for the subclasses that have them
+void Cartridge::load_state(const CartridgeState&, const std::vector<uint8_t>& ram) {
+    if (ram.size() != m_ram.size())
+        throw std::invalid_argument("invalid argument. cartridge ram size does not match the save state");
+    m_ram.assign(ram.begin(), ram.end());
+}
+
+CartridgeNoMBC::CartridgeNoMBC(std::shared_ptr<const RomImage> rom, std::vector<uint8_t> ram_data)
+    : Cartridge(std::move(rom), std::move(ram_data)) {}
 
 uint8_t CartridgeNoMBC::read(uint16_t address) {
     if (address >= 0 && address <= 0x7FFF)
@@ -102,10 +120,9 @@ void CartridgeNoMBC::write(uint16_t address, uint8_t value) {
     throw std::invalid_argument("invalid argument. out-of-bounds of cartridge's address map");
 }
 
-CartridgeMBC1::CartridgeMBC1(std::vector<uint8_t> rom_data, std::vector<uint8_t> ram_data)
-    : Cartridge(rom_data, ram_data) {
-    CartridgeHeader header = get_header_from_romdata(rom_data);
-    m_ram.reserve(0x8000);
+CartridgeMBC1::CartridgeMBC1(std::shared_ptr<const RomImage> rom, std::vector<uint8_t> ram_data)
+    : Cartridge(std::move(rom), std::move(ram_data)) {
+    if (m_ram.size() < 0x8000) m_ram.resize(0x8000);
 }
 
 uint8_t CartridgeMBC1::read(uint16_t address) {
@@ -113,7 +130,8 @@ uint8_t CartridgeMBC1::read(uint16_t address) {
         return m_rom[address];
 
     if (address >= 0x4000 && address <= 0x7FFF) {
-        return m_rom[0x4000 * m_current_rom_bank + (address - 0x4000)];
+        // Bank numbers past the end of the ROM wrap around, like the unconnected address lines
+        return m_rom[0x4000 * (m_current_rom_bank & m_rom_bank_mask) + (address - 0x4000)];
     }
 
     if (m_ram_enabled) {
@@ -126,6 +144,22 @@ uint8_t CartridgeMBC1::read(uint16_t address) {
     throw std::invalid_argument("invalid argument. out-of-bounds of cartridge's address map");
 }
 
+void CartridgeMBC1::save_state(CartridgeState& state, std::vector<uint8_t>& ram) const {
+    Cartridge::save_state(state, ram);
+    state.rom_bank = m_current_rom_bank;
+    state.ram_bank = m_current_ram_bank;
+    state.ram_enabled = m_ram_enabled;
+    state.ram_banking_mode = m_ram_banking_mode;
+}
+
+void CartridgeMBC1::load_state(const CartridgeState& state, const std::vector<uint8_t>& ram) {
+    Cartridge::load_state(state, ram);
+    m_current_rom_bank = state.rom_bank;
+    m_current_ram_bank = state.ram_bank;
+    m_ram_enabled = state.ram_enabled;
+    m_ram_banking_mode = state.ram_banking_mode;
+}
+
 void CartridgeMBC1::write(uint16_t address, uint8_t value) {
     if (address >= 0 && address <= 0x1FFF) {
         if ((value & 0xF) == 0xA)
@@ -136,13 +170,17 @@ void CartridgeMBC1::write(uint16_t address, uint8_t value) {
     }
 
     if (address >= 0x2000 && address <= 0x3FFF) {
+        const uint8_t old_rom_bank = m_current_rom_bank;
         m_current_rom_bank &= 0b11100000;
         m_current_rom_bank |= value & 0b11111;
         if (m_current_rom_bank == 0) m_current_rom_bank = 1;
+        if (m_perf && m_current_rom_bank != old_rom_bank) m_perf->bank_switches++;
         return;
     }
 
     if (address >= 0x4000 && address <= 0x5FFF) {
+        const uint8_t old_rom_bank = m_current_rom_bank;
+        const uint8_t old_ram_bank = m_current_ram_bank;
         if (m_ram_banking_mode) {
             m_current_ram_bank = value & 0b11;
         } else {
@@ -150,6 +188,7 @@ void CartridgeMBC1::write(uint16_t address, uint8_t value) {
             m_current_rom_bank |= value & 0b11100000;
             if (m_current_rom_bank == 0) m_current_rom_bank = 1;
         }
+        if (m_perf && (m_current_rom_bank != old_rom_bank || m_current_ram_bank != old_ram_bank)) m_perf->bank_switches++;
         return;
     }
 
@@ -1,9 +1,12 @@
 #ifndef CARTRIDGE_H
 #define CARTRIDGE_H
 
+#include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <vector>
 #include <string>
+#include "perf_counters.h"
 
 enum class CartridgeType {
     NoMBC,
@@ -44,32 +47,52 @@ struct CartridgeHeader {
     RAMSize ram_size;
 };
 
-CartridgeHeader get_header_from_romdata(std::vector<uint8_t>& rom_data);
+// Throws std::invalid_argument if `size` is too small to hold a header
+CartridgeHeader get_header_from_romdata(const uint8_t* rom_data, size_t size);
+
+class RomImage;
+
+// Mapper registers. External RAM is saved separately since its size depends on the cartridge.
+struct CartridgeState {
+    uint8_t rom_bank;
+    uint8_t ram_bank;
+    bool ram_enabled;
+    bool ram_banking_mode;
+};
 
 class Cartridge
 {
 public:
-    Cartridge(std::vector<uint8_t> rom_data, std::vector<uint8_t> ram_data = {});
+    Cartridge(std::shared_ptr<const RomImage> rom, std::vector<uint8_t> ram_data = {});
     virtual ~Cartridge();
     virtual uint8_t read(uint16_t address) = 0;
     virtual void write(uint16_t address, uint8_t value) = 0;
+    virtual void save_state(CartridgeState& state, std::vector<uint8_t>& ram) const;
+    virtual void load_state(const CartridgeState& state, const std::vector<uint8_t>& ram);
+    // Bank switches are counted into `perf`, nullptr stops counting
+    inline void set_perf_counters(PerfCounters* perf) { m_perf = perf; }
 protected:
-    std::vector<uint8_t> m_rom;
+    std::shared_ptr<const RomImage> m_rom_image;
+    const uint8_t* m_rom;   // m_rom_image->data(), kept for the hot read path
+    uint32_t m_rom_bank_mask;
     std::vector<uint8_t> m_ram;
+    PerfCounters* m_perf = nullptr;
 };
 
 class CartridgeNoMBC : public Cartridge {
 public:
-    CartridgeNoMBC(std::vector<uint8_t> rom_data, std::vector<uint8_t> ram_data = {});
+    CartridgeNoMBC(std::shared_ptr<const RomImage> rom, std::vector<uint8_t> ram_data = {});
     uint8_t read(uint16_t address) override;
     void write(uint16_t address, uint8_t value) override;
 };
 
 class CartridgeMBC1 : public Cartridge {
 public:
-    CartridgeMBC1(std::vector<uint8_t> rom_data, std::vector<uint8_t> ram_data = {});
+    CartridgeMBC1(std::shared_ptr<const RomImage> rom, std::vector<uint8_t> ram_data = {});
     uint8_t read(uint16_t address) override;
     void write(uint16_t address, uint8_t value) override;
+    void save_state(CartridgeState& state, std::vector<uint8_t>& ram) const override;
+    void load_state(const CartridgeState& state, const std::vector<uint8_t>& ram) override;
 private:
     uint8_t m_current_ram_bank = 0;
     uint8_t m_current_rom_bank = 1;
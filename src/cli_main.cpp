@@ -0,0 +1,198 @@
+// sleepy_boi_cli : runs one ROM headless and reports how fast it went
+//
+// usage: sleepy_boi_cli <rom> [--frames N] [--cycles N] [--until-serial TEXT]
+//                             [--state PATH] [--movie PATH] [--dump-frame PATH]
+//
+//   --frames        stop after N frames
+//   --cycles        stop after N CPU cycles (4194304 per emulated second)
+//   --until-serial  stop as soon as the serial output contains TEXT, exit code 2 if it never does
+//   --state         start from a save state
+//   --movie         start from the movie's initial state, feed its input and check its state hashes
+//   --dump-frame    write the last frame to PATH as a binary PPM, turns rendering on
+//
+// Without --frames or --cycles the run stops after 3600 frames, or at the end of the movie,
+// or after 36000 frames (ten emulated minutes) when waiting for serial output.
+// With SLEEPY_BOI_TRACE_FILE set, a build with -DSLEEPY_BOI_TRACE=ON writes a Chrome trace there.
+
+#include "gameboy.h"
+#include "movie.h"
+#include "savestate.h"
+#include "trace.h"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+struct Options {
+    std::string rom;
+    uint64_t frames = 0;
+    uint64_t cycles = 0;
+    std::string until_serial;
+    std::string state_path;
+    std::string movie_path;
+    std::string dump_frame_path;
+};
+
+static constexpr uint64_t DEFAULT_FRAMES = 3600;
+static constexpr uint64_t DEFAULT_SERIAL_FRAMES = 36000;
+static constexpr double CPU_FREQUENCY = 4194304.0;
+
+static void usage(const char* program) {
+    std::cerr << "usage: " << program << " <rom> [--frames N] [--cycles N] [--until-serial TEXT]"
+              << " [--state PATH] [--movie PATH] [--dump-frame PATH]" << std::endl;
+}
+
+static void write_ppm(const std::string& path, const Framebuffer& framebuffer) {
+    std::vector<uint8_t> rgb(Framebuffer::WIDTH * Framebuffer::HEIGHT * 3);
+    framebuffer.to_rgb(rgb.data());
+    std::ofstream file(path, std::ios::binary);
+    file << "P6\n" << Framebuffer::WIDTH << " " << Framebuffer::HEIGHT << "\n255\n";
+    file.write(reinterpret_cast<const char*>(rgb.data()), rgb.size());
+    if (!file)
+        throw std::runtime_error("could not write " + path);
+}
+
+static int run(const Options& options) {
+    Gameboy gb;
+    gb.LoadROM(options.rom);
+    gb.SetSerialCapture(true);
+    gb.SetRendering(!options.dump_frame_path.empty());
+
+    std::unique_ptr<Movie> movie;
+    if (!options.movie_path.empty()) {
+        movie = std::make_unique<Movie>(Movie::load(options.movie_path));
+        if (movie->rom_hash != gb.GetROMHash())
+            throw std::invalid_argument("invalid argument. movie was recorded with a different rom");
+    }
+
+    GameboyState state;
+    if (!options.state_path.empty()) {
+        std::vector<uint8_t> bytes = load_state_file_async(options.state_path).get();
+        deserialize_state(bytes.data(), bytes.size(), state);
+        gb.LoadState(state);
+    }
+    if (movie && !movie->initial_state.empty()) {
+        deserialize_state(movie->initial_state.data(), movie->initial_state.size(), state);
+        gb.LoadState(state);
+    }
+
+    uint64_t frame_limit = options.frames;
+    if (frame_limit == 0 && options.cycles == 0) {
+        if (movie) frame_limit = movie->frames();
+        else if (!options.until_serial.empty()) frame_limit = DEFAULT_SERIAL_FRAMES;
+        else frame_limit = DEFAULT_FRAMES;
+    }
+
+    gb.SetRunning(true);
+    const uint64_t start_cycle = gb.GetCycleCount();
+    uint64_t frames = 0;
+    std::string stop_reason = "frame limit";
+    bool serial_matched = false;
+    bool desynced = false;
+
+    auto start = std::chrono::steady_clock::now();
+    while (true) {
+        if (frame_limit != 0 && frames >= frame_limit) break;
+        const uint64_t cycles_run = gb.GetCycleCount() - start_cycle;
+        if (options.cycles != 0 && cycles_run >= options.cycles) {
+            stop_reason = "cycle limit";
+            break;
+        }
+
+        // Whole frames while they fit, single instructions for the rest of a cycle budget
+        const bool whole_frame = options.cycles == 0 || options.cycles - cycles_run >= static_cast<uint64_t>(Gameboy::CYCLES_PER_FRAME);
+        if (whole_frame) {
+            if (movie && frames < movie->frames())
+                movie->apply_frame(frames, gb);
+            gb.Update();
+            frames++;
+        } else {
+            gb.Step();
+        }
+
+        if (!options.until_serial.empty() && gb.GetSerialOutput().find(options.until_serial) != std::string::npos) {
+            stop_reason = "serial matched";
+            serial_matched = true;
+            break;
+        }
+        if (movie && whole_frame && frames % movie->hash_interval == 0 && frames <= movie->frames()) {
+            size_t index = frames / movie->hash_interval - 1;
+            if (index < movie->state_hashes.size() && movie->state_hashes[index] != hash_state(gb)) {
+                stop_reason = "movie desynced at frame " + std::to_string(frames - 1);
+                desynced = true;
+                break;
+            }
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    if (!options.dump_frame_path.empty())
+        write_ppm(options.dump_frame_path, gb.GetFrame().framebuffer);
+
+    if (!gb.GetSerialOutput().empty())
+        std::cout << "serial: " << gb.GetSerialOutput() << std::endl;
+
+    const uint64_t cycles = gb.GetCycleCount() - start_cycle;
+    const double seconds = elapsed.count() > 0 ? elapsed.count() : 1e-9;
+    const double mhz = cycles / seconds / 1e6;
+    std::cout << std::fixed << std::setprecision(2)
+              << frames << " frames, " << cycles << " cycles in " << elapsed.count() << " s (" << stop_reason << "): "
+              << mhz << " MHz, " << frames / seconds << " fps, " << mhz * 1e6 / CPU_FREQUENCY << "x real time" << std::endl;
+
+    if (desynced) return 1;
+    if (!options.until_serial.empty() && !serial_matched) return 2;
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const char* trace_path = std::getenv("SLEEPY_BOI_TRACE_FILE");
+    try {
+        Options options;
+        options.rom = argv[1];
+        for (int i = 2; i < argc; i++) {
+            const std::string arg = argv[i];
+            if (i + 1 >= argc) {
+                usage(argv[0]);
+                return 1;
+            }
+            const std::string value = argv[++i];
+            auto number = [&]() -> uint64_t {
+                try {
+                    return std::stoull(value);
+                } catch (const std::logic_error&) {
+                    throw std::invalid_argument("invalid argument. " + arg + " needs a number, got " + value);
+                }
+            };
+            if (arg == "--frames") options.frames = number();
+            else if (arg == "--cycles") options.cycles = number();
+            else if (arg == "--until-serial") options.until_serial = value;
+            else if (arg == "--state") options.state_path = value;
+            else if (arg == "--movie") options.movie_path = value;
+            else if (arg == "--dump-frame") options.dump_frame_path = value;
+            else {
+                std::cerr << "unknown option " << arg << std::endl;
+                usage(argv[0]);
+                return 1;
+            }
+        }
+
+        if (trace_path) Tracer::start();
+        TRACE_THREAD_NAME("main");
+        const int result = run(options);
+        if (trace_path) Tracer::write(trace_path);
+        return result;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
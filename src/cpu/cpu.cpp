@@ -1,4 +1,5 @@
 #include "cpu.h"
+#include "../trace.h"
 
 CPU::CPU(MMU& mmu)
     : m_mmu(mmu), m_af(m_a, m_f), m_bc(m_b, m_c), m_de(m_d, m_e),
@@ -270,6 +271,40 @@ int CPU::execute_next_opcode() {
     }
 }
 
+void CPU::save_state(State& state) const {
+    state.a = m_a;
+    state.f = m_f;
+    state.b = m_b;
+    state.c = m_c;
+    state.d = m_d;
+    state.e = m_e;
+    state.h = m_h;
+    state.l = m_l;
+    state.sp = m_sp;
+    state.pc = m_pc;
+    state.interrupt_enable = m_interrupt_enable;
+    state.interrupt_waiting = m_interrupt_waiting;
+    state.interrupt_enable_register = m_interrupt_controller.enable_register();
+    state.interrupt_request_register = m_interrupt_controller.request_register();
+}
+
+void CPU::load_state(const State& state) {
+    m_a = state.a;
+    m_f = state.f;
+    m_b = state.b;
+    m_c = state.c;
+    m_d = state.d;
+    m_e = state.e;
+    m_h = state.h;
+    m_l = state.l;
+    m_sp = state.sp;
+    m_pc = state.pc;
+    m_interrupt_enable = state.interrupt_enable;
+    m_interrupt_waiting = state.interrupt_waiting;
+    m_interrupt_controller[0xFFFF] = state.interrupt_enable_register;
+    m_interrupt_controller[0xFF0F] = state.interrupt_request_register;
+}
+
 InterruptController& CPU::interrupt_controller() {
     return m_interrupt_controller;
 }
@@ -283,6 +318,15 @@ void CPU::handle_interrupts() {
     }
 }
 
+bool CPU::interrupt_pending() {
+    if (!m_interrupt_enable) return false;
+    for (auto interrupt : {InterruptController::VBLANK, InterruptController::LCD, InterruptController::TIMER, InterruptController::JOYPAD}) {
+        if (m_interrupt_controller.check_requested(interrupt))
+            return true;
+    }
+    return false;
+}
+
 void CPU::service_interrupt(InterruptController::InterruptType type) {
     constexpr uint16_t VBLANK_INT_VECTOR = 0x0040;
     constexpr uint16_t LCD_INT_VECTOR = 0x0048;
@@ -291,6 +335,8 @@ void CPU::service_interrupt(InterruptController::InterruptType type) {
 
     m_interrupt_enable = false;
     m_interrupt_controller.finished_service(type);
+    if (m_perf) m_perf->interrupts[type]++;
+    TRACE_INSTANT("interrupt", type);
 
     uint16_t old_pc = m_pc;
     m_sp = m_sp - 1;
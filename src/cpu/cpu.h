@@ -5,6 +5,7 @@
 #include "register.h"
 #include "../mmu.h"
 #include "interrupt_controller.h"
+#include "../perf_counters.h"
 
 class MMU;
 class InterruptController;
@@ -12,6 +13,15 @@ class InterruptController;
 class CPU
 {
 public:
+    struct State {
+        uint8_t a, f, b, c, d, e, h, l;
+        uint16_t sp, pc;
+        bool interrupt_enable;
+        bool interrupt_waiting;
+        uint8_t interrupt_enable_register;
+        uint8_t interrupt_request_register;
+    };
+
     CPU(MMU& mmu);
     int execute_next_opcode();
     void handle_interrupts();
@@ -21,6 +31,16 @@ public:
         m_interrupt_controller.request_service(type);
     }
 
+    void save_state(State& state) const;
+    void load_state(const State& state);
+
+    inline bool is_halted() const { return m_interrupt_waiting; }
+    inline uint16_t pc() const { return m_pc; }
+    // True if handle_interrupts() would service an interrupt right now
+    bool interrupt_pending();
+    // Serviced interrupts are counted into `perf`, nullptr stops counting
+    inline void set_perf_counters(PerfCounters* perf) { m_perf = perf; }
+
 private:
     Register<uint8_t> m_a;
     FlagRegister m_f;
@@ -38,10 +58,12 @@ private:
     bool m_interrupt_enable = false;
     bool m_interrupt_waiting = false;
     InterruptController m_interrupt_controller;
+    PerfCounters* m_perf = nullptr;
 
     MMU& m_mmu;
 
     friend class Debugger;
+    friend class LockstepGroup;
 
     inline void reset() {
         m_a = 0;
@@ -77,7 +99,7 @@ private:
         BC, DE, HL, AF
     };
 
-    const int unprefixed_opcode_cycles_no_branch[256] = {
+    static constexpr uint8_t unprefixed_opcode_cycles_no_branch[256] = {
         4, 12,  8,  8,  4,  4,  8,  4, 20,  8,  8,  8,  4,  4,  8,  4,
         4, 12,  8,  8,  4,  4,  8,  4, 12,  8,  8,  8,  4,  4,  8,  4,
         8, 12,  8,  8,  4,  4,  8,  4,  8,  8,  8,  8,  4,  4,  8,  4,
@@ -96,7 +118,7 @@ private:
        12, 12,  8,  4,  0, 16,  8, 16, 12,  8, 16,  4,  0,  0,  8, 16
     };
 
-    const int unprefixed_opcode_cycles_branch[256] = {
+    static constexpr uint8_t unprefixed_opcode_cycles_branch[256] = {
         4, 12,  8,  8,  4,  4,  8,  4, 20,  8,  8,  8,  4,  4,  8,  4,
         4, 12,  8,  8,  4,  4,  8,  4, 12,  8,  8,  8,  4,  4,  8,  4,
        12, 12,  8,  8,  4,  4,  8,  4, 12,  8,  8,  8,  4,  4,  8,  4,
@@ -115,7 +137,7 @@ private:
        12, 12,  8,  4,  0, 16,  8, 16, 12,  8, 16,  4,  0,  0,  8, 16
     };
 
-    const int cbprefix_opcode_cycles[256] = {
+    static constexpr uint8_t cbprefix_opcode_cycles[256] = {
         8,  8,  8,  8,  8,  8, 16,  8,  8,  8,  8,  8,  8,  8, 16,  8,
         8,  8,  8,  8,  8,  8, 16,  8,  8,  8,  8,  8,  8,  8, 16,  8,
         8,  8,  8,  8,  8,  8, 16,  8,  8,  8,  8,  8,  8,  8, 16,  8,
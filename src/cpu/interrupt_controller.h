@@ -18,6 +18,8 @@ public:
     bool check_enabled(InterruptType type);
     bool check_requested(InterruptType type);
     void finished_service(InterruptType type);
+    inline uint8_t enable_register() const { return m_enable_register; }
+    inline uint8_t request_register() const { return m_request_register; }
 
 private:
     uint8_t m_enable_register = 0;
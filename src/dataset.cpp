@@ -0,0 +1,239 @@
+#include "dataset.h"
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+// .npy format 1.0: magic, version, header length, then a padded Python dict literal.
+// The header is always written at this size so it can be rewritten in place.
+static constexpr size_t NPY_HEADER_SIZE = 128;
+
+void DatasetWriter::NpyFile::open(const std::string& path, const std::vector<uint32_t>& row_shape) {
+    m_path = path;
+    m_row_shape = row_shape;
+    m_row_size = 1;
+    for (uint32_t dim : row_shape) m_row_size *= dim;
+    m_rows = 0;
+
+    m_file.open(path, std::ios::binary | std::ios::trunc);
+    if (!m_file)
+        throw std::runtime_error("could not open " + path + " for writing");
+    write_header();
+}
+
+void DatasetWriter::NpyFile::append(const uint8_t* data, size_t rows) {
+    m_file.write(reinterpret_cast<const char*>(data), rows * m_row_size);
+    if (!m_file)
+        throw std::runtime_error("could not write " + m_path);
+    m_rows += rows;
+}
+
+void DatasetWriter::NpyFile::close() {
+    m_file.seekp(0);
+    write_header();
+    m_file.close();
+    if (!m_file)
+        throw std::runtime_error("could not write " + m_path);
+}
+
+void DatasetWriter::NpyFile::write_header() {
+    std::ostringstream dict;
+    dict << "{'descr': '|u1', 'fortran_order': False, 'shape': (" << m_rows << ",";
+    for (size_t i = 0; i < m_row_shape.size(); i++)
+        dict << (i == 0 ? " " : ", ") << m_row_shape[i];
+    dict << "), }";
+
+    std::string header("\x93NUMPY\x01\x00", 8);
+    const uint16_t dict_size = NPY_HEADER_SIZE - 10;
+    header += static_cast<char>(dict_size & 0xFF);
+    header += static_cast<char>(dict_size >> 8);
+    header += dict.str();
+    header.resize(NPY_HEADER_SIZE - 1, ' ');
+    header += '\n';
+    m_file.write(header.data(), header.size());
+}
+
+DatasetWriter::DatasetWriter(const DatasetConfig& config)
+    : m_config(config) {
+    if (config.prefix.empty() || config.frames_per_shard == 0 || config.buffer_frames == 0)
+        throw std::invalid_argument("invalid argument. a dataset needs a prefix and non-zero shard and buffer sizes");
+
+    switch (config.pixels) {
+    case DatasetConfig::Pixels::NONE: m_pixel_size = 0; break;
+    case DatasetConfig::Pixels::SHADES: m_pixel_size = Framebuffer::WIDTH * Framebuffer::HEIGHT; break;
+    case DatasetConfig::Pixels::RGB: m_pixel_size = Framebuffer::WIDTH * Framebuffer::HEIGHT * 3; break;
+    }
+
+    m_ram_size = 0;
+    for (const DatasetConfig::RamRegion& region : config.ram) {
+        if (region.size == 0 || region.address + region.size > 0x10000)
+            throw std::invalid_argument("invalid argument. RAM region outside of the memory map");
+        m_ram_size += region.size;
+    }
+
+    for (Buffer& buffer : m_buffers) {
+        buffer.pixels.resize(config.buffer_frames * m_pixel_size);
+        buffer.joypad.resize(config.buffer_frames);
+        buffer.ram.resize(config.buffer_frames * m_ram_size);
+    }
+
+    m_thread = std::thread(&DatasetWriter::run, this);
+}
+
+DatasetWriter::~DatasetWriter() {
+    try {
+        close();
+    } catch (const std::exception&) {
+    }
+}
+
+void DatasetWriter::record(Gameboy& gb) {
+    Buffer& buffer = m_buffers[m_filling];
+    const uint32_t row = buffer.count;
+
+    if (m_config.pixels == DatasetConfig::Pixels::SHADES)
+        std::memcpy(&buffer.pixels[row * m_pixel_size], gb.GetFramebuffer(), m_pixel_size);
+    else if (m_config.pixels == DatasetConfig::Pixels::RGB)
+        gb.GetFrame().framebuffer.to_rgb(&buffer.pixels[row * m_pixel_size]);
+
+    buffer.joypad[row] = gb.GetButtons();
+
+    uint8_t* ram = buffer.ram.data() + row * m_ram_size;
+    for (const DatasetConfig::RamRegion& region : m_config.ram) {
+        for (uint32_t i = 0; i < region.size; i++)
+            *ram++ = gb.ReadMemory(region.address + i);
+    }
+
+    buffer.count++;
+    m_frames++;
+    m_frames_in_shard++;
+
+    if (m_frames_in_shard == m_config.frames_per_shard) {
+        buffer.ends_shard = true;
+        submit();
+        m_shard++;
+        m_frames_in_shard = 0;
+    } else if (buffer.count == m_config.buffer_frames) {
+        submit();
+    }
+}
+
+void DatasetWriter::submit() {
+    Buffer& buffer = m_buffers[m_filling];
+    buffer.shard = m_shard;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_pending) {
+            m_stalls++;
+            m_cv.wait(lock, [this] { return m_pending == nullptr; });
+        }
+        if (m_error)
+            std::rethrow_exception(m_error);
+        m_pending = &buffer;
+    }
+    m_cv.notify_all();
+
+    // The other buffer was written before m_pending could be cleared
+    m_filling ^= 1;
+    m_buffers[m_filling].count = 0;
+    m_buffers[m_filling].ends_shard = false;
+}
+
+void DatasetWriter::close() {
+    if (!m_thread.joinable()) return;
+
+    if (m_buffers[m_filling].count > 0) {
+        try {
+            submit();
+        } catch (const std::exception&) {
+            // rethrown below, after the I/O thread is gone
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+    throw_if_failed();
+}
+
+void DatasetWriter::throw_if_failed() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_error)
+        std::rethrow_exception(m_error);
+}
+
+void DatasetWriter::run() {
+    while (true) {
+        Buffer* buffer;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this] { return m_pending != nullptr || m_stop; });
+            buffer = m_pending;
+            if (!buffer) break;
+        }
+
+        // After an error buffers are still taken, so record() never waits forever
+        if (!m_error) {
+            try {
+                write(*buffer);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_error = std::current_exception();
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pending = nullptr;
+        }
+        m_cv.notify_all();
+    }
+
+    // The last shard ends wherever recording stopped
+    if (m_shard_open && !m_error) {
+        try {
+            close_shard();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_error = std::current_exception();
+        }
+    }
+}
+
+void DatasetWriter::write(const Buffer& buffer) {
+    if (!m_shard_open) {
+        std::ostringstream prefix;
+        prefix << m_config.prefix << "_" << std::setw(5) << std::setfill('0') << buffer.shard;
+
+        const uint32_t width = Framebuffer::WIDTH;
+        const uint32_t height = Framebuffer::HEIGHT;
+        if (m_config.pixels == DatasetConfig::Pixels::SHADES)
+            m_pixel_file.open(prefix.str() + ".frames.npy", {height, width});
+        else if (m_config.pixels == DatasetConfig::Pixels::RGB)
+            m_pixel_file.open(prefix.str() + ".frames.npy", {height, width, 3});
+        m_joypad_file.open(prefix.str() + ".joypad.npy", {});
+        if (m_ram_size > 0)
+            m_ram_file.open(prefix.str() + ".ram.npy", {static_cast<uint32_t>(m_ram_size)});
+        m_shard_open = true;
+    }
+
+    if (m_pixel_size > 0)
+        m_pixel_file.append(buffer.pixels.data(), buffer.count);
+    m_joypad_file.append(buffer.joypad.data(), buffer.count);
+    if (m_ram_size > 0)
+        m_ram_file.append(buffer.ram.data(), buffer.count);
+
+    if (buffer.ends_shard)
+        close_shard();
+}
+
+void DatasetWriter::close_shard() {
+    if (m_pixel_size > 0)
+        m_pixel_file.close();
+    m_joypad_file.close();
+    if (m_ram_size > 0)
+        m_ram_file.close();
+    m_shard_open = false;
+}
@@ -0,0 +1,119 @@
+#ifndef DATASET_H
+#define DATASET_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gameboy.h"
+
+// Output layout, one set of files per shard:
+//   <prefix>_<shard>.frames.npy    uint8 (N, 144, 160) shades, or (N, 144, 160, 3) RGB
+//   <prefix>_<shard>.joypad.npy    uint8 (N,) Joypad buttons the frame ran with
+//   <prefix>_<shard>.ram.npy       uint8 (N, R) the configured RAM regions, concatenated
+//
+// Plain .npy (format 1.0) so numpy.load / np.memmap read them without any extra code.
+// A shard's row count is patched into its headers when the shard is closed.
+struct DatasetConfig {
+    enum class Pixels { NONE, SHADES, RGB };
+
+    struct RamRegion {
+        uint16_t address;
+        uint16_t size;
+    };
+
+    std::string prefix;                 // path prefix, directories must exist
+    Pixels pixels = Pixels::SHADES;
+    std::vector<RamRegion> ram;
+    uint32_t frames_per_shard = 4096;
+    uint32_t buffer_frames = 256;       // frames per write, each of the two buffers holds this many
+};
+
+// Records frames on the emulation thread and writes them on a background I/O thread.
+// Two buffers take turns: the emulation side fills one while the I/O thread writes the
+// other, so disk latency only shows up if a whole buffer is written slower than it fills.
+class DatasetWriter
+{
+public:
+    // Throws std::invalid_argument on an unusable config
+    explicit DatasetWriter(const DatasetConfig& config);
+    // Flushes, errors are dropped, call close() to see them
+    ~DatasetWriter();
+    DatasetWriter(const DatasetWriter&) = delete;
+    DatasetWriter& operator=(const DatasetWriter&) = delete;
+
+    // Call after every Update, with rendering on if pixels are recorded. Rethrows
+    // (std::runtime_error) the first I/O error from the background thread.
+    void record(Gameboy& gb);
+    // Writes whatever is buffered, finishes the open shard and stops the I/O thread
+    void close();
+
+    inline uint64_t frames() const { return m_frames; }
+    inline uint32_t shards() const { return m_shard + (m_frames_in_shard > 0 ? 1 : 0); }
+    // How often record() had to wait for the I/O thread
+    inline uint64_t stalls() const { return m_stalls; }
+
+private:
+    struct Buffer {
+        std::vector<uint8_t> pixels;
+        std::vector<uint8_t> joypad;
+        std::vector<uint8_t> ram;
+        uint32_t count = 0;
+        uint32_t shard = 0;
+        bool ends_shard = false;
+    };
+
+    // One .npy file being appended to, its header is rewritten with the real row count on close
+    class NpyFile
+    {
+    public:
+        void open(const std::string& path, const std::vector<uint32_t>& row_shape);
+        void append(const uint8_t* data, size_t rows);
+        void close();
+
+    private:
+        void write_header();
+
+        std::ofstream m_file;
+        std::string m_path;
+        std::vector<uint32_t> m_row_shape;
+        size_t m_row_size = 0;
+        uint64_t m_rows = 0;
+    };
+
+    void submit();  // hands the filling buffer to the I/O thread
+    void run();
+    void write(const Buffer& buffer);
+    void close_shard();
+    void throw_if_failed();
+
+    DatasetConfig m_config;
+    size_t m_pixel_size;
+    size_t m_ram_size;
+
+    Buffer m_buffers[2];
+    int m_filling = 0;
+    uint64_t m_frames = 0;
+    uint32_t m_shard = 0;
+    uint32_t m_frames_in_shard = 0;
+    uint64_t m_stalls = 0;
+
+    // Shared with the I/O thread
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    Buffer* m_pending = nullptr;    // waiting to be written or being written
+    bool m_stop = false;
+    std::exception_ptr m_error;
+
+    // I/O thread only
+    NpyFile m_pixel_file, m_joypad_file, m_ram_file;
+    bool m_shard_open = false;
+
+    std::thread m_thread;
+};
+
+#endif // DATASET_H
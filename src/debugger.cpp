@@ -2,8 +2,36 @@
 #include "utility.h"
 #include <sstream>
 
+void Debugger::capture() {
+    Snapshot& snapshot = m_snapshots.back();
+    const CPU& cpu = m_gb.m_cpu;
+    snapshot.a = cpu.m_a;
+    snapshot.f = cpu.m_f;
+    snapshot.b = cpu.m_b;
+    snapshot.c = cpu.m_c;
+    snapshot.d = cpu.m_d;
+    snapshot.e = cpu.m_e;
+    snapshot.h = cpu.m_h;
+    snapshot.l = cpu.m_l;
+    snapshot.pc = cpu.m_pc;
+    snapshot.sp = cpu.m_sp;
+    snapshot.ime = cpu.m_interrupt_enable;
+    snapshot.iw = cpu.m_interrupt_waiting;
+    snapshot.running = m_gb.m_gb_running;
+    for (size_t i = 0; i < snapshot.memory.size(); i++)
+        snapshot.memory[i] = m_gb.m_mmu.read_byte(snapshot.pc + i);
+    m_snapshots.publish();
+}
+
+void Debugger::refresh() {
+    m_view = &m_snapshots.latest();
+}
+
 std::pair<std::string, int> Debugger::disassemble_instruction(uint16_t address) const {
-    auto next_byte = [&]() -> uint8_t { return m_gb.m_mmu.read_byte(address++); };
+    auto next_byte = [&]() -> uint8_t {
+        uint16_t offset = address++ - m_view->pc;
+        return offset < m_view->memory.size() ? m_view->memory[offset] : 0xFF;
+    };
     int opcode = next_byte();
 
     const std::string condition_flag[] = {"NZ", "Z", "NC", "C"};
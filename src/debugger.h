@@ -1,9 +1,11 @@
 #ifndef DEBUGGER_H
 #define DEBUGGER_H
 
+#include <array>
 #include <cstdint>
 #include <utility>
 #include "gameboy.h"
+#include "triple_buffer.h"
 
 class Gameboy;
 
@@ -13,29 +15,35 @@ public:
     Debugger(Gameboy& gb)
         : m_gb(gb) {}
 
-    inline bool gb_is_running() const { return m_gb.m_gb_running; }
-
-    inline uint8_t cpu_r8_a() const { return m_gb.m_cpu.m_a; }
-    inline uint8_t cpu_r8_f() const { return m_gb.m_cpu.m_f; }
-    inline uint8_t cpu_r8_b() const { return m_gb.m_cpu.m_b; }
-    inline uint8_t cpu_r8_c() const { return m_gb.m_cpu.m_c; }
-    inline uint8_t cpu_r8_d() const { return m_gb.m_cpu.m_d; }
-    inline uint8_t cpu_r8_e() const { return m_gb.m_cpu.m_e; }
-    inline uint8_t cpu_r8_h() const { return m_gb.m_cpu.m_h; }
-    inline uint8_t cpu_r8_l() const { return m_gb.m_cpu.m_l; }
-    inline uint16_t cpu_r16_af() const { return m_gb.m_cpu.m_af; }
-    inline uint16_t cpu_r16_bc() const { return m_gb.m_cpu.m_bc; }
-    inline uint16_t cpu_r16_de() const { return m_gb.m_cpu.m_de; }
-    inline uint16_t cpu_r16_hl() const { return m_gb.m_cpu.m_hl; }
-    inline uint16_t cpu_pc() const { return m_gb.m_cpu.m_pc; }
-    inline uint16_t cpu_sp() const { return m_gb.m_cpu.m_sp; }
-    inline bool cpu_flag_z() const { return m_gb.m_cpu.m_f.z(); }
-    inline bool cpu_flag_n() const { return m_gb.m_cpu.m_f.n(); }
-    inline bool cpu_flag_h() const { return m_gb.m_cpu.m_f.h(); }
-    inline bool cpu_flag_c() const { return m_gb.m_cpu.m_f.c(); }
-    inline bool cpu_flag_ime() const { return m_gb.m_cpu.m_interrupt_enable; }
-    inline bool cpu_flag_iw() const { return m_gb.m_cpu.m_interrupt_waiting; }
+    // Emulation thread: copies the state shown by the GUI and publishes it
+    void capture();
+    // GUI thread: switches the accessors below over to the latest published snapshot
+    void refresh();
 
+    inline bool gb_is_running() const { return m_view->running; }
+
+    inline uint8_t cpu_r8_a() const { return m_view->a; }
+    inline uint8_t cpu_r8_f() const { return m_view->f; }
+    inline uint8_t cpu_r8_b() const { return m_view->b; }
+    inline uint8_t cpu_r8_c() const { return m_view->c; }
+    inline uint8_t cpu_r8_d() const { return m_view->d; }
+    inline uint8_t cpu_r8_e() const { return m_view->e; }
+    inline uint8_t cpu_r8_h() const { return m_view->h; }
+    inline uint8_t cpu_r8_l() const { return m_view->l; }
+    inline uint16_t cpu_r16_af() const { return (m_view->a << 8) | m_view->f; }
+    inline uint16_t cpu_r16_bc() const { return (m_view->b << 8) | m_view->c; }
+    inline uint16_t cpu_r16_de() const { return (m_view->d << 8) | m_view->e; }
+    inline uint16_t cpu_r16_hl() const { return (m_view->h << 8) | m_view->l; }
+    inline uint16_t cpu_pc() const { return m_view->pc; }
+    inline uint16_t cpu_sp() const { return m_view->sp; }
+    inline bool cpu_flag_z() const { return (m_view->f & 0b10000000) != 0; }
+    inline bool cpu_flag_n() const { return (m_view->f & 0b01000000) != 0; }
+    inline bool cpu_flag_h() const { return (m_view->f & 0b00100000) != 0; }
+    inline bool cpu_flag_c() const { return (m_view->f & 0b00010000) != 0; }
+    inline bool cpu_flag_ime() const { return m_view->ime; }
+    inline bool cpu_flag_iw() const { return m_view->iw; }
+
+    // These mutate the gameboy, call them from the thread that runs it
     inline void step() {
         m_gb.SetRunning(false);
         m_gb.Step();
@@ -48,10 +56,22 @@ public:
         m_gb.m_mmu.m_bootrom_mapped = true;
     }
 
+    // Disassembles out of the snapshot's memory window (starts at PC)
     std::pair<std::string, int> disassemble_instruction(uint16_t address) const;
 
 private:
+    struct Snapshot {
+        uint8_t a = 0, f = 0, b = 0, c = 0, d = 0, e = 0, h = 0, l = 0;
+        uint16_t pc = 0, sp = 0;
+        bool ime = false;
+        bool iw = false;
+        bool running = false;
+        std::array<uint8_t, 64> memory = {}; // bytes at pc, pc+1, ...
+    };
+
     Gameboy& m_gb;
+    TripleBuffer<Snapshot> m_snapshots;
+    const Snapshot* m_view = &m_snapshots.latest();
 };
 
 #endif // DEBUGGER_H
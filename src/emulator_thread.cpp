@@ -0,0 +1,221 @@
+#include "emulator_thread.h"
+#include "savestate.h"
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+EmulatorThread::EmulatorThread(Gameboy& gb, Debugger& debugger)
+    : m_gb(gb), m_debugger(debugger) {}
+
+EmulatorThread::~EmulatorThread() {
+    stop();
+}
+
+void EmulatorThread::start() {
+    if (m_thread.joinable()) return;
+
+    if (!m_export_name.empty() && !m_exporter) {
+        try {
+            m_exporter = std::make_unique<FrameExporter>(m_gb, m_export_name, FrameExporter::DEFAULT_SLOTS, m_export_mode);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+        }
+    }
+
+    m_quit.store(false, std::memory_order_relaxed);
+    m_thread = std::thread(&EmulatorThread::run, this);
+}
+
+void EmulatorThread::stop() {
+    if (!m_thread.joinable()) return;
+
+    m_quit.store(true, std::memory_order_release);
+    m_thread.join();
+}
+
+bool EmulatorThread::send(Command command) {
+    return m_commands.push(command);
+}
+
+static uint64_t host_time_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool EmulatorThread::push_input(Joypad::Button button, bool pressed) {
+    return m_gb.PushInputEvent(Joypad::InputEvent {host_time_ns(), button, pressed});
+}
+
+void EmulatorThread::execute(Command command) {
+    switch (command) {
+    case Command::RUN:
+        m_gb.SetRunning(true);
+        break;
+    case Command::PAUSE:
+        m_gb.SetRunning(false);
+        break;
+    case Command::STEP:
+        // Stepping and resetting change the machine outside any recorded frame
+        if (m_recorder) {
+            std::cerr << "debugger: no stepping while a movie is being recorded" << std::endl;
+            break;
+        }
+        m_debugger.step();
+        break;
+    case Command::RESET:
+        if (m_recorder) {
+            std::cerr << "debugger: no reset while a movie is being recorded" << std::endl;
+            break;
+        }
+        m_debugger.reset();
+        break;
+    case Command::SAVE_STATE:
+        m_pending_save = m_gb.SaveStateToFile(m_state_path);
+        break;
+    case Command::LOAD_STATE:
+        // A movie can only continue from where its last frame left off
+        if (m_recorder) {
+            std::cerr << "save state: not loaded while a movie is being recorded" << std::endl;
+            break;
+        }
+        m_pending_load = load_state_file_async(m_state_path);
+        break;
+    case Command::START_RECORDING:
+        m_recorder = std::make_unique<MovieRecorder>(m_gb);
+        break;
+    case Command::STOP_RECORDING:
+        if (!m_recorder) break;
+        try {
+            m_recorder->movie().save(m_movie_path);
+        } catch (const std::exception& e) {
+            std::cerr << "movie: " << e.what() << std::endl;
+        }
+        m_recorder.reset();
+        break;
+    }
+}
+
+static bool is_ready(const std::future<void>& f) {
+    return f.valid() && f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+static bool is_ready(const std::future<std::vector<uint8_t>>& f) {
+    return f.valid() && f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+void EmulatorThread::poll_state_io() {
+    try {
+        if (is_ready(m_pending_save))
+            m_pending_save.get();
+        if (is_ready(m_pending_load)) {
+            std::vector<uint8_t> bytes = m_pending_load.get();
+            if (m_recorder) {
+                std::cerr << "save state: not loaded while a movie is being recorded" << std::endl;
+                return;
+            }
+            deserialize_state(bytes.data(), bytes.size(), m_loaded_state);
+            m_gb.LoadState(m_loaded_state);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "save state: " << e.what() << std::endl;
+    }
+}
+
+void EmulatorThread::rewind() {
+    // While recording, every movie frame has its start state as one of the newest rewind
+    // entries. Rewinding cuts the movie back by the frames popped, never past its start.
+    uint32_t steps = REWIND_STEP;
+    if (m_recorder) steps = std::min(steps, m_recorder->frames());
+    uint32_t restored = 0;
+    while (restored < steps && m_rewind.pop(m_gb))
+        restored++;
+    if (restored == 0) return;
+
+    // Replay the restored frame so it gets drawn. It is only pushed and recorded again
+    // while recording, which keeps the movie and the rewind buffer in step.
+    if (m_recorder) {
+        m_recorder->truncate(m_recorder->frames() - restored);
+        m_rewind.push(m_gb);
+    }
+    m_gb.Update();
+    if (m_recorder) m_recorder->record_frame(m_gb);
+}
+
+void EmulatorThread::run() {
+    TRACE_THREAD_NAME("emulator");
+    using clock = std::chrono::steady_clock;
+    constexpr auto FRAME_PERIOD = std::chrono::nanoseconds(static_cast<int64_t>(1000000000 / FRAMERATE));
+    constexpr auto SPEED_SAMPLE_PERIOD = std::chrono::milliseconds(250);
+    constexpr int MAX_FRAMES_BEHIND = 4;
+
+    m_debugger.capture();
+    auto next_frame = clock::now();
+    auto speed_sample_start = next_frame;
+    int frames_in_sample = 0;
+    uint64_t input_window_start = host_time_ns();
+    auto last_snapshot = next_frame;
+    while (!m_quit.load(std::memory_order_acquire)) {
+        Command command;
+        while (m_commands.pop(command))
+            execute(command);
+        poll_state_io();
+
+        const int speed = m_speed.load(std::memory_order_relaxed);
+        if (speed == 1)
+            m_gb.SetRendering(true);
+        else
+            m_gb.SetRendering(m_frame_wanted.exchange(false, std::memory_order_relaxed));
+
+        m_gb.SetRunAhead(m_run_ahead.load(std::memory_order_relaxed));
+
+        // Input that arrived while the previous frame was being paced goes into this one
+        const uint64_t input_window_end = host_time_ns();
+        m_gb.ScheduleInput(input_window_start, input_window_end);
+        input_window_start = input_window_end;
+
+        if (m_gb.IsRunning() && m_rewinding.load(std::memory_order_relaxed)) {
+            rewind();
+            frames_in_sample++;
+        } else if (m_gb.IsRunning()) {
+            TRACE_SCOPE("frame");
+            // Above 1x a snapshot per emulated frame costs more than the frame itself, take
+            // one per real frame period instead. A recording needs one per frame, rewinding
+            // cuts the movie back by the entries it pops.
+            const auto frame_start = clock::now();
+            if (speed == 1 || m_recorder || frame_start - last_snapshot >= FRAME_PERIOD) {
+                m_rewind.push(m_gb);
+                last_snapshot = frame_start;
+            }
+            m_gb.Update();
+            if (m_recorder) m_recorder->record_frame(m_gb);
+            if (m_exporter) m_exporter->publish();
+            frames_in_sample++;
+        }
+        m_debugger.capture();
+        m_perf.back().counters = m_gb.GetPerfCounters();
+        m_perf.back().history = m_gb.GetPerfHistory();
+        m_perf.publish();
+
+        auto now = clock::now();
+        if (now - speed_sample_start >= SPEED_SAMPLE_PERIOD) {
+            std::chrono::duration<float> elapsed = now - speed_sample_start;
+            m_achieved_speed.store(frames_in_sample / (elapsed.count() * FRAMERATE), std::memory_order_relaxed);
+            speed_sample_start = now;
+            frames_in_sample = 0;
+        }
+
+        if (speed == UNLIMITED && m_gb.IsRunning()) {
+            next_frame = now;
+            continue;
+        }
+
+        const auto period = speed == UNLIMITED ? FRAME_PERIOD : FRAME_PERIOD / speed;
+        next_frame += period;
+        if (now - next_frame > MAX_FRAMES_BEHIND * period) {
+            // Too far behind (debugger break, host hiccup), don't try to catch up in a burst
+            next_frame = now;
+        }
+        TRACE_SCOPE("pacing sleep");
+        std::this_thread::sleep_until(next_frame);
+    }
+}
@@ -0,0 +1,121 @@
+#ifndef EMULATOR_THREAD_H
+#define EMULATOR_THREAD_H
+
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gameboy.h"
+#include "debugger.h"
+#include "frame_export.h"
+#include "movie.h"
+#include "perf_counters.h"
+#include "rewind.h"
+#include "spsc_ring.h"
+#include "triple_buffer.h"
+
+// Runs a Gameboy on its own thread, paced by its own clock instead of the GUI's vsync.
+// The GUI thread talks to it only through a lock-free command queue, and reads back
+// frames (Gameboy::GetFrame) and debugger snapshots (Debugger::refresh).
+class EmulatorThread
+{
+public:
+    enum class Command : uint8_t {
+        RUN,
+        PAUSE,
+        STEP,
+        RESET,
+        SAVE_STATE,
+        LOAD_STATE,
+        START_RECORDING,
+        STOP_RECORDING
+    };
+
+    EmulatorThread(Gameboy& gb, Debugger& debugger);
+    ~EmulatorThread();
+
+    void start();
+    void stop();
+
+    // Quick save slot used by SAVE_STATE/LOAD_STATE, set it before start()
+    inline void set_state_path(const std::string& path) { m_state_path = path; }
+    // Where STOP_RECORDING writes the movie, set it before start()
+    inline void set_movie_path(const std::string& path) { m_movie_path = path; }
+    // Publish every frame to shared memory "/<name>" (see FrameExporter), set it before start()
+    inline void set_export_name(const std::string& name) { m_export_name = name; }
+    // Permissions of the exported object, see FrameExporter. Set it before start()
+    inline void set_export_mode(uint32_t mode) { m_export_mode = mode; }
+
+    // GUI thread only. Returns false if the queue is full and the command was dropped.
+    bool send(Command command);
+
+    // Emulation speed as a multiple of real time, UNLIMITED runs as fast as the host allows
+    static constexpr int UNLIMITED = 0;
+    inline void set_speed(int multiplier) { m_speed.store(multiplier, std::memory_order_relaxed); }
+    inline int speed() const { return m_speed.load(std::memory_order_relaxed); }
+    // Measured speed as a multiple of real time, updated a few times per second
+    inline float achieved_speed() const { return m_achieved_speed.load(std::memory_order_relaxed); }
+
+    struct PerfSnapshot {
+        PerfCounters counters;
+        PerfHistory history;
+    };
+    // GUI thread: the Gameboy's counters as of the last emulated frame (see Gameboy::GetPerfCounters)
+    inline const PerfSnapshot& perf() { return m_perf.latest(); }
+
+    // GUI thread: call once per display refresh after presenting. Above 1x only frames that
+    // will actually be shown get drawn, the rest are emulated with the PPU pixel work skipped.
+    inline void frame_presented() { m_frame_wanted.store(true, std::memory_order_relaxed); }
+
+    // GUI thread: stamps a key press/release with the host clock and queues it. It is
+    // applied at the matching cycle of the next emulated frame.
+    bool push_input(Joypad::Button button, bool pressed);
+    // See Gameboy::SetRunAhead
+    inline void set_run_ahead(int frames) { m_run_ahead.store(frames, std::memory_order_relaxed); }
+    // While set, emulation runs backwards through the rewind buffer instead of forwards.
+    // Above 1x it holds one snapshot per real frame period, not per emulated frame.
+    inline void set_rewinding(bool rewinding) { m_rewinding.store(rewinding, std::memory_order_relaxed); }
+
+private:
+    // 70224 cycles per frame at 4194304 Hz
+    static constexpr double FRAMERATE = 4194304.0 / 70224.0;
+    // Frames stepped back per rewound frame, rewinding plays at twice the emulation speed
+    static constexpr int REWIND_STEP = 2;
+
+    void run();
+    void execute(Command command);
+    void poll_state_io();
+    void rewind();
+
+    Gameboy& m_gb;
+    Debugger& m_debugger;
+
+    SPSCRing<Command, 64> m_commands;
+    std::atomic<bool> m_quit{false};
+    std::atomic<int> m_speed{1};
+    std::atomic<float> m_achieved_speed{0.0f};
+    std::atomic<bool> m_frame_wanted{true};
+    std::atomic<int> m_run_ahead{0};
+    std::atomic<bool> m_rewinding{false};
+    TripleBuffer<PerfSnapshot> m_perf;
+    std::thread m_thread;
+
+    std::string m_state_path = "quicksave.sst";
+    std::future<void> m_pending_save;
+    std::future<std::vector<uint8_t>> m_pending_load;
+    GameboyState m_loaded_state;
+
+    RewindBuffer m_rewind;
+
+    std::string m_movie_path = "recording.sbm";
+    std::unique_ptr<MovieRecorder> m_recorder;
+
+    std::string m_export_name;
+    uint32_t m_export_mode = FrameExporter::DEFAULT_MODE;
+    std::unique_ptr<FrameExporter> m_exporter;
+};
+
+#endif // EMULATOR_THREAD_H
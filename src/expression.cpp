@@ -0,0 +1,165 @@
+#include "expression.h"
+#include <cctype>
+#include <stdexcept>
+
+Expression::Expression() {
+    m_nodes.push_back(Node {Node::CONST, 0, -1, -1});
+    m_root = 0;
+}
+
+Expression::Expression(const std::string& text)
+    : m_text(text) {
+    m_root = parse_or();
+    skip_spaces();
+    if (m_pos != m_text.size())
+        fail("unexpected '" + m_text.substr(m_pos, 1) + "'");
+}
+
+int64_t Expression::eval(int index, const Gameboy& gb, uint64_t frame) const {
+    const Node& node = m_nodes[index];
+    switch (node.op) {
+    case Node::CONST: return node.value;
+    case Node::FRAME: return frame;
+    case Node::BYTE: return gb.ReadMemory(eval(node.lhs, gb, frame) & 0xFFFF);
+    case Node::WORD: {
+        const uint16_t address = eval(node.lhs, gb, frame) & 0xFFFF;
+        return gb.ReadMemory(address) | (gb.ReadMemory(address + 1) << 8);
+    }
+    case Node::NEG: return -eval(node.lhs, gb, frame);
+    case Node::NOT: return !eval(node.lhs, gb, frame);
+    case Node::AND: return eval(node.lhs, gb, frame) && eval(node.rhs, gb, frame);
+    case Node::OR: return eval(node.lhs, gb, frame) || eval(node.rhs, gb, frame);
+    default: break;
+    }
+
+    const int64_t a = eval(node.lhs, gb, frame);
+    const int64_t b = eval(node.rhs, gb, frame);
+    switch (node.op) {
+    case Node::ADD: return a + b;
+    case Node::SUB: return a - b;
+    case Node::MUL: return a * b;
+    case Node::BITAND: return a & b;
+    case Node::EQ: return a == b;
+    case Node::NE: return a != b;
+    case Node::LT: return a < b;
+    case Node::LE: return a <= b;
+    case Node::GT: return a > b;
+    case Node::GE: return a >= b;
+    default: return 0;
+    }
+}
+
+void Expression::fail(const std::string& what) const {
+    throw std::invalid_argument("invalid argument. " + what + " at column " + std::to_string(m_pos + 1) + " of '" + m_text + "'");
+}
+
+void Expression::skip_spaces() {
+    while (m_pos < m_text.size() && std::isspace((unsigned char)m_text[m_pos])) m_pos++;
+}
+
+bool Expression::accept(const char* token) {
+    skip_spaces();
+    const size_t length = std::char_traits<char>::length(token);
+    if (m_text.compare(m_pos, length, token) != 0) return false;
+    m_pos += length;
+    return true;
+}
+
+int Expression::add(Node::Op op, int lhs, int rhs, int64_t value) {
+    m_nodes.push_back(Node {op, value, lhs, rhs});
+    return m_nodes.size() - 1;
+}
+
+int Expression::parse_or() {
+    int lhs = parse_and();
+    while (accept("||")) lhs = add(Node::OR, lhs, parse_and());
+    return lhs;
+}
+
+int Expression::parse_and() {
+    int lhs = parse_compare();
+    while (accept("&&")) lhs = add(Node::AND, lhs, parse_compare());
+    return lhs;
+}
+
+int Expression::parse_compare() {
+    int lhs = parse_sum();
+    // Longer tokens first so "<=" is not read as "<"
+    if (accept("==")) return add(Node::EQ, lhs, parse_sum());
+    if (accept("!=")) return add(Node::NE, lhs, parse_sum());
+    if (accept("<=")) return add(Node::LE, lhs, parse_sum());
+    if (accept(">=")) return add(Node::GE, lhs, parse_sum());
+    if (accept("<")) return add(Node::LT, lhs, parse_sum());
+    if (accept(">")) return add(Node::GT, lhs, parse_sum());
+    return lhs;
+}
+
+int Expression::parse_sum() {
+    int lhs = parse_product();
+    while (true) {
+        if (accept("+")) lhs = add(Node::ADD, lhs, parse_product());
+        else if (accept("-")) lhs = add(Node::SUB, lhs, parse_product());
+        else return lhs;
+    }
+}
+
+int Expression::parse_product() {
+    int lhs = parse_unary();
+    while (true) {
+        skip_spaces();
+        if (accept("*")) {
+            lhs = add(Node::MUL, lhs, parse_unary());
+        } else if (m_text.compare(m_pos, 2, "&&") != 0 && accept("&")) {
+            lhs = add(Node::BITAND, lhs, parse_unary());
+        } else {
+            return lhs;
+        }
+    }
+}
+
+int Expression::parse_unary() {
+    skip_spaces();
+    if (accept("-")) return add(Node::NEG, parse_unary());
+    if (m_text.compare(m_pos, 2, "!=") != 0 && accept("!")) return add(Node::NOT, parse_unary());
+    return parse_primary();
+}
+
+int Expression::parse_primary() {
+    if (accept("(")) {
+        int inner = parse_or();
+        if (!accept(")")) fail("expected ')'");
+        return inner;
+    }
+    if (accept("w[")) return parse_address(Node::WORD);
+    if (accept("[")) return parse_address(Node::BYTE);
+    if (accept("frame")) return add(Node::FRAME, -1);
+
+    skip_spaces();
+    if (m_pos < m_text.size() && std::isdigit((unsigned char)m_text[m_pos])) {
+        size_t used = 0;
+        int64_t value = 0;
+        try {
+            value = std::stoll(m_text.substr(m_pos), &used, 0);
+        } catch (const std::out_of_range&) {
+            fail("number out of range");
+        }
+        m_pos += used;
+        return add(Node::CONST, -1, -1, value);
+    }
+    fail("expected a number, [address], w[address] or frame");
+}
+
+int Expression::parse_address(Node::Op op) {
+    // Addresses are always hex, with or without 0x
+    skip_spaces();
+    size_t used = 0;
+    int64_t value = 0;
+    try {
+        value = std::stoll(m_text.substr(m_pos), &used, 16);
+    } catch (const std::exception&) {
+        fail("expected a hex address");
+    }
+    m_pos += used;
+    if (!accept("]")) fail("expected ']'");
+    return add(op, add(Node::CONST, -1, -1, value));
+}
@@ -0,0 +1,51 @@
+#ifndef EXPRESSION_H
+#define EXPRESSION_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "gameboy.h"
+
+// Integer arithmetic over memory, the --maximize and --goal of sleepy_boi_search (the
+// syntax is in the usage at the top of search_main.cpp). Expressions compile to a flat
+// node list, children are indices into it.
+class Expression
+{
+public:
+    // Always 0
+    Expression();
+    // Throws std::invalid_argument on syntax errors
+    explicit Expression(const std::string& text);
+
+    inline int64_t eval(const Gameboy& gb, uint64_t frame) const { return eval(m_root, gb, frame); }
+
+private:
+    struct Node {
+        enum Op { CONST, FRAME, BYTE, WORD, NEG, NOT, ADD, SUB, MUL, BITAND, EQ, NE, LT, LE, GT, GE, AND, OR } op;
+        int64_t value;
+        int lhs, rhs;
+    };
+
+    int64_t eval(int index, const Gameboy& gb, uint64_t frame) const;
+
+    [[noreturn]] void fail(const std::string& what) const;
+    void skip_spaces();
+    bool accept(const char* token);
+    int add(Node::Op op, int lhs, int rhs = -1, int64_t value = 0);
+
+    int parse_or();
+    int parse_and();
+    int parse_compare();
+    int parse_sum();
+    int parse_product();
+    int parse_unary();
+    int parse_primary();
+    int parse_address(Node::Op op);
+
+    std::string m_text;
+    size_t m_pos = 0;
+    std::vector<Node> m_nodes;
+    int m_root;
+};
+
+#endif // EXPRESSION_H
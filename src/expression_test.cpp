@@ -0,0 +1,105 @@
+#include "expression.h"
+#include "gameboy.h"
+#include "rom_image.h"
+#include "test_util.h"
+#include <stdexcept>
+#include <string>
+#include <vector>
+// Search expressions: precedence, memory reads and syntax errors
+
+// Leaves 12 34 FF in C000 - C002 and spins
+static std::vector<uint8_t> memory_program() {
+    return {
+        0x3E, 0x12,         // 0150: ld a, 12
+        0xEA, 0x00, 0xC0,   //       ld (C000), a
+        0x3E, 0x34,         //       ld a, 34
+        0xEA, 0x01, 0xC0,   //       ld (C001), a
+        0x3E, 0xFF,         //       ld a, FF
+        0xEA, 0x02, 0xC0,   //       ld (C002), a
+        0x18, 0xFE,         // 015F: jr 015F
+    };
+}
+
+static int64_t eval(const Gameboy& gb, const std::string& text, uint64_t frame = 0) {
+    return Expression(text).eval(gb, frame);
+}
+
+// The message names the column the parser stopped at
+static std::string error(const std::string& text) {
+    try {
+        Expression expression(text);
+    } catch (const std::invalid_argument& e) {
+        return e.what();
+    }
+    return "";
+}
+
+static void test_arithmetic(const Gameboy& gb) {
+    CHECK(Expression().eval(gb, 5) == 0);
+    CHECK(eval(gb, "42") == 42);
+    CHECK(eval(gb, "0x2A") == 42);
+    CHECK(eval(gb, " 1 +2* 3 ") == 7);
+    CHECK(eval(gb, "(1 + 2) * 3") == 9);
+    CHECK(eval(gb, "10 - 4 - 3") == 3);
+    CHECK(eval(gb, "-3 * -2") == 6);
+    CHECK(eval(gb, "--5") == 5);
+    CHECK(eval(gb, "0xF0 & 0x3C") == 0x30);
+    CHECK(eval(gb, "1 + 6 & 3") == 3);
+    CHECK(eval(gb, "frame * 2", 21) == 42);
+}
+
+static void test_logic(const Gameboy& gb) {
+    CHECK(eval(gb, "1 < 2") == 1);
+    CHECK(eval(gb, "2 <= 2") == 1);
+    CHECK(eval(gb, "3 > 4") == 0);
+    CHECK(eval(gb, "4 >= 5") == 0);
+    CHECK(eval(gb, "1 + 1 == 2") == 1);
+    CHECK(eval(gb, "2 != 2") == 0);
+    CHECK(eval(gb, "!0") == 1);
+    CHECK(eval(gb, "!7") == 0);
+    CHECK(eval(gb, "!(1 == 1)") == 0);
+    // && binds tighter than ||, and neither is read as & or !
+    CHECK(eval(gb, "1 || 0 && 0") == 1);
+    CHECK(eval(gb, "(1 || 0) && 0") == 0);
+    CHECK(eval(gb, "2 && 1") == 1);
+    CHECK(eval(gb, "2 & 1") == 0);
+    CHECK(eval(gb, "3 != 4 && !0") == 1);
+}
+
+static void test_memory(const Gameboy& gb) {
+    CHECK(eval(gb, "[C000]") == 0x12);
+    CHECK(eval(gb, "[0xC001]") == 0x34);
+    CHECK(eval(gb, "[ c002 ]") == 0xFF);
+    CHECK(eval(gb, "w[C000]") == 0x3412);
+    CHECK(eval(gb, "w[C001]") == 0xFF34);
+    CHECK(eval(gb, "[C000] + w[C001] * 2") == 0x12 + 0xFF34 * 2);
+    CHECK(eval(gb, "[C002] == 255 && [C000] < [C001]") == 1);
+    // Addresses wrap to 16 bits
+    CHECK(eval(gb, "[1C000]") == 0x12);
+}
+
+static void test_errors() {
+    CHECK(error("") == "invalid argument. expected a number, [address], w[address] or frame at column 1 of ''");
+    CHECK(error("1 +") == "invalid argument. expected a number, [address], w[address] or frame at column 4 of '1 +'");
+    CHECK(error("(1 + 2") == "invalid argument. expected ')' at column 7 of '(1 + 2'");
+    CHECK(error("[C000") == "invalid argument. expected ']' at column 6 of '[C000'");
+    CHECK(error("[zz]") == "invalid argument. expected a hex address at column 2 of '[zz]'");
+    CHECK(error("1 2") == "invalid argument. unexpected '2' at column 3 of '1 2'");
+    CHECK(error("frames") == "invalid argument. unexpected 's' at column 6 of 'frames'");
+    CHECK(error("1 = 1") == "invalid argument. unexpected '=' at column 3 of '1 = 1'");
+    CHECK(error("99999999999999999999") == "invalid argument. number out of range at column 1 of '99999999999999999999'");
+    CHECK(error("[C000] | 1") == "invalid argument. unexpected '|' at column 8 of '[C000] | 1'");
+}
+
+int main() {
+    Gameboy gb;
+    gb.LoadROM(RomImage::from_bytes(make_test_rom(memory_program())));
+    gb.SetRunning(true);
+    for (int i = 0; i < BOOT_FRAMES + 2; i++) gb.Update();
+
+    test_arithmetic(gb);
+    test_logic(gb);
+    test_memory(gb);
+    test_errors();
+    return test_result("expression_test");
+}
@@ -0,0 +1,117 @@
+#include "frame_export.h"
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define FRAME_EXPORT_SHM
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+// Keep every slot on its own cache lines
+static constexpr size_t SHM_ALIGNMENT = 64;
+
+static size_t align_up(size_t size) {
+    return (size + SHM_ALIGNMENT - 1) & ~(SHM_ALIGNMENT - 1);
+}
+
+FrameExporter::FrameExporter(Gameboy& gb, const std::string& name, uint32_t slots, uint32_t mode)
+    : m_gb(gb), m_name("/" + name) {
+    if (name.empty() || name.find('/') != std::string::npos || slots == 0)
+        throw std::invalid_argument("invalid argument. shared memory needs a name without '/' and at least one slot");
+    if (mode > 0777)
+        throw std::invalid_argument("invalid argument. shared memory mode takes permission bits only (0 - 0777)");
+
+#ifdef FRAME_EXPORT_SHM
+    const size_t header_size = align_up(sizeof(sb_shm_header));
+    const size_t slot_size = align_up(sizeof(sb_shm_slot) + Framebuffer::WIDTH * Framebuffer::HEIGHT);
+    m_mapping_size = header_size + slots * slot_size;
+
+    // A leftover object from a crashed run would keep its old size and contents
+    shm_unlink(m_name.c_str());
+    int fd = shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, mode);
+    if (fd < 0)
+        throw std::runtime_error("could not create shared memory " + m_name);
+    // shm_open applies the umask, which would usually take the group/other write bits away
+    if (fchmod(fd, mode) != 0 || ftruncate(fd, m_mapping_size) != 0) {
+        close(fd);
+        shm_unlink(m_name.c_str());
+        throw std::runtime_error("could not set up shared memory " + m_name);
+    }
+    void* mapping = mmap(nullptr, m_mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        shm_unlink(m_name.c_str());
+        throw std::runtime_error("could not map shared memory " + m_name);
+    }
+    m_mapping = mapping;
+
+    // ftruncate zero-fills, so every slot starts out as "no frame"
+    m_header = static_cast<sb_shm_header*>(m_mapping);
+    m_header->version = SB_SHM_VERSION;
+    m_header->header_size = header_size;
+    m_header->slot_count = slots;
+    m_header->slot_size = slot_size;
+    m_header->width = Framebuffer::WIDTH;
+    m_header->height = Framebuffer::HEIGHT;
+    m_header->writer_alive = 1;
+    // Readers check the magic last, it goes in once everything else is set
+    __atomic_store_n(&m_header->magic, SB_SHM_MAGIC, __ATOMIC_RELEASE);
+    m_gb.SetFrameTap(&m_frames);
+#else
+    throw std::runtime_error("shared memory export needs a POSIX system");
+#endif
+}
+
+FrameExporter::~FrameExporter() {
+#ifdef FRAME_EXPORT_SHM
+    if (!m_mapping) return;
+    m_gb.SetFrameTap(nullptr);
+
+    __atomic_store_n(&m_header->writer_alive, 0, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&m_header->notify, 1, __ATOMIC_RELEASE);
+#if defined(__linux__)
+    syscall(SYS_futex, &m_header->notify, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+    munmap(m_mapping, m_mapping_size);
+    shm_unlink(m_name.c_str());
+#endif
+}
+
+void FrameExporter::publish() {
+    const Frame& frame = m_frames.latest();
+    if (!m_header || frame.sequence == m_last_frame) return;
+    m_last_frame = frame.sequence;
+
+    const uint64_t n = m_published + 1;
+    uint8_t* base = static_cast<uint8_t*>(m_mapping) + m_header->header_size;
+    sb_shm_slot* slot = reinterpret_cast<sb_shm_slot*>(base + ((n - 1) % m_header->slot_count) * m_header->slot_size);
+
+    // Odd while the slot is being rewritten, a reader in the middle of it sees the change
+    __atomic_store_n(&slot->seqlock, 2 * n - 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    slot->frame = frame.sequence;
+    slot->cycle = frame.cycle;
+    slot->pc = m_gb.GetPC();
+    slot->ly = m_gb.ReadMemory(0xFF44);
+    slot->buttons = m_gb.GetButtons();
+    std::memcpy(slot + 1, frame.framebuffer.get_buffer_ptr(), Framebuffer::WIDTH * Framebuffer::HEIGHT);
+
+    __atomic_store_n(&slot->seqlock, 2 * n, __ATOMIC_RELEASE);
+    __atomic_store_n(&m_header->write_sequence, n, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&m_header->notify, 1, __ATOMIC_SEQ_CST);
+#if defined(__linux__)
+    // Only wake when someone sleeps, most frames then cost no system call at all
+    if (__atomic_load_n(&m_header->waiters, __ATOMIC_SEQ_CST) != 0)
+        syscall(SYS_futex, &m_header->notify, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+    m_published = n;
+}
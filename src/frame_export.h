@@ -0,0 +1,53 @@
+#ifndef FRAME_EXPORT_H
+#define FRAME_EXPORT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "gameboy.h"
+#include "sleepyboi_shm.h"
+
+// Publishes every completed frame, plus a few words of CPU/PPU state, into a POSIX
+// shared-memory ring (layout in include/sleepyboi_shm.h). Encoders and dashboards map
+// it and read frames in place, without linking the emulator or slowing it down: the
+// writer never waits for readers, slow readers just miss frames. Readers that sleep in
+// sb_shm_wait write the header's waiter count, so they need write access to the object
+// (see `mode`); readers that poll can map it read-only.
+// Frames reach the exporter through a FrameExchange tap of its own, the Gameboy's
+// GetFrame() stays with whoever presents them.
+class FrameExporter
+{
+public:
+    static constexpr uint32_t DEFAULT_SLOTS = 8;
+    // Only the emulator's user can wait, everyone else can poll
+    static constexpr uint32_t DEFAULT_MODE = 0644;
+
+    // Creates (or replaces) the shared-memory object "/<name>" with permissions `mode`
+    // (not masked by the umask) and taps `gb`'s frames. 0666 lets readers running as
+    // other users wait too. Throws std::runtime_error if it can't, or on platforms
+    // without POSIX shared memory.
+    FrameExporter(Gameboy& gb, const std::string& name, uint32_t slots = DEFAULT_SLOTS, uint32_t mode = DEFAULT_MODE);
+    // Untaps the Gameboy, tells readers the writer is gone and unlinks the object,
+    // mappings stay valid. `gb` must not be running Update.
+    ~FrameExporter();
+    FrameExporter(const FrameExporter&) = delete;
+    FrameExporter& operator=(const FrameExporter&) = delete;
+
+    // Call after Update, on the thread that runs `gb`. Does nothing if no new frame was
+    // drawn (rendering off).
+    void publish();
+
+    inline uint64_t published() const { return m_published; }
+
+private:
+    Gameboy& m_gb;
+    FrameExchange m_frames;
+    std::string m_name;
+    void* m_mapping = nullptr;
+    size_t m_mapping_size = 0;
+    sb_shm_header* m_header = nullptr;
+    uint64_t m_published = 0;
+    uint64_t m_last_frame = 0;
+};
+
+#endif // FRAME_EXPORT_H
@@ -1,34 +1,136 @@
 #include "gameboy.h"
 #include "cartridge.h"
-#include <iterator>
+#include "savestate.h"
+#include "trace.h"
+#include "utility.h"
+#include <chrono>
+#include <stdexcept>
+#include <climits>
 #include <vector>
-#include <fstream>
 
 Gameboy::Gameboy()
-    : m_cpu(m_mmu), m_timer(m_mmu), m_video(m_mmu) {
+    : m_cpu(m_mmu), m_timer(m_mmu), m_video(m_mmu), m_joypad(m_mmu) {
     m_mmu.connect_cpu(&m_cpu);
     m_mmu.connect_timer(&m_timer);
     m_mmu.connect_video(&m_video);
+    m_mmu.connect_joypad(&m_joypad);
+    m_cpu.set_perf_counters(&m_perf);
+    m_mmu.set_perf_counters(&m_perf);
 }
 
-Gameboy::~Gameboy() {
-    delete m_cartridge;
-}
+Gameboy::~Gameboy() {}
 
 void Gameboy::Update() {
     if (!m_gb_running) return;
-    constexpr int CPU_CLOCK_FREQUENCY = 4194304; // 4ish MHz (from gameboy's specs)
-    constexpr int FRAMERATE = 60;
-    constexpr int CPU_CLOCK_CYCLES_PER_FRAME = CPU_CLOCK_FREQUENCY / FRAMERATE;
+    TRACE_SCOPE("Gameboy::Update");
+    const auto update_start = std::chrono::steady_clock::now();
+
+    m_joypad.begin_frame();
+    if (m_run_ahead_frames <= 0 || m_video.is_pipelined()) {
+        const PerfFrameSample sample = run_frame();
+        m_joypad.end_frame();
+        record_frame(sample, update_start);
+        return;
+    }
+
+    // The real frame is never shown, only the one `m_run_ahead_frames` into the future
+    const bool rendering = m_video.rendering();
+    m_video.set_rendering(false);
+    PerfFrameSample sample = run_frame();
+    m_joypad.end_frame();
+    SaveState(m_run_ahead_state);
+    // The counters describe the real frame, whatever the rolled back ones add is dropped
+    const PerfCounters perf = m_perf;
+
+    m_mmu.set_serial_muted(true);
+    for (int i = 0; i < m_run_ahead_frames; i++) {
+        if (i == m_run_ahead_frames - 1)
+            m_video.set_rendering(rendering);
+        run_frame();
+    }
+    m_mmu.set_serial_muted(false);
+
+    LoadState(m_run_ahead_state);
+    m_video.set_rendering(rendering);
+    m_perf = perf;
+    m_perf.frames_speculative += m_run_ahead_frames;
+    // The speculative frame is drawn in its place
+    sample.rendered = rendering;
+    record_frame(sample, update_start);
+}
 
+PerfFrameSample Gameboy::run_frame() {
+    TRACE_SCOPE("Gameboy::run_frame");
+    const bool sampled = m_perf.frames() % PERF_SAMPLE_FRAMES == 0;
+
+    // Stop at VBLANK, or after a frame's worth of cycles if the LCD is off
+    const uint64_t frame = m_video.frame_count();
     int cycles_so_far = 0;
-    while (cycles_so_far < CPU_CLOCK_CYCLES_PER_FRAME){
-        int cycles = m_cpu.execute_next_opcode();
+    uint32_t instructions = 0;
+    TRACE_SLICES(cpu_slices, "cpu slice", m_video[0xFF44]);
+    while (m_video.frame_count() == frame) {
+        if (cycles_so_far >= CYCLES_PER_FRAME && !m_video.is_lcd_enabled())
+            break;
+
+        if (cycles_so_far >= m_joypad.next_event_cycle())
+            m_joypad.apply_events(cycles_so_far);
+
+        int cycles;
+        if (sampled && instructions % PERF_SAMPLE_INSTRUCTIONS == 0) {
+            cycles = timed_step();
+        } else {
+            cycles = m_cpu.execute_next_opcode();
+            m_timer.tick(cycles);
+            m_video.update_graphics(cycles);
+        }
         cycles_so_far += cycles;
-        m_timer.tick(cycles);
-        m_video.update_graphics(cycles);
+        instructions++;
         m_cpu.handle_interrupts();
+        TRACE_SLICE_AT(cpu_slices, m_video[0xFF44]);
     }
+
+    // Anything scheduled past an early VBLANK still belongs to this frame
+    m_joypad.apply_events(INT_MAX);
+
+    if (sampled) m_perf.sampled_frames++;
+
+    PerfFrameSample sample;
+    sample.instructions = instructions;
+    sample.cycles = cycles_so_far;
+    sample.rendered = m_video.rendering();
+    return sample;
+}
+
+// Once per Update, however many frames it emulated
+void Gameboy::record_frame(PerfFrameSample sample, std::chrono::steady_clock::time_point start) {
+    m_perf.instructions += sample.instructions;
+    m_perf.cycles += sample.cycles;
+    if (sample.rendered) m_perf.frames_rendered++;
+    else m_perf.frames_skipped++;
+
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    sample.host_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    m_perf_history.record(sample);
+}
+
+// One instruction with the host time of each part measured, scaled up to stand in for
+// the PERF_SAMPLE_INSTRUCTIONS instructions around it
+int Gameboy::timed_step() {
+    using clock = std::chrono::steady_clock;
+    const auto start = clock::now();
+    m_mmu.set_mmio_timed(true);
+    int cycles = m_cpu.execute_next_opcode();
+    m_mmu.set_mmio_timed(false);
+    const auto cpu_end = clock::now();
+    m_timer.tick(cycles);
+    const auto timer_end = clock::now();
+    m_video.update_graphics(cycles);
+    const auto ppu_end = clock::now();
+
+    m_perf.cpu_ns += perf_sample_ns(start, cpu_end);
+    m_perf.timer_ns += perf_sample_ns(cpu_end, timer_end);
+    m_perf.ppu_ns += perf_sample_ns(timer_end, ppu_end);
+    return cycles;
 }
 
 void Gameboy::Step() {
@@ -36,36 +138,84 @@ void Gameboy::Step() {
     m_timer.tick(cycles);
     m_video.update_graphics(cycles);
     m_cpu.handle_interrupts();
+    m_perf.instructions++;
+    m_perf.cycles += cycles;
 }
 
-uint8_t* Gameboy::GetFramebuffer() {
+const uint8_t* Gameboy::GetFramebuffer() {
     return m_video.get_framebuffer();
 }
 
 void Gameboy::LoadROM(std::string path_to_rom) {
-    std::ifstream file(path_to_rom, std::ios::binary);
-    file.unsetf(std::ios::skipws);
-    std::streampos fileSize;
-    file.seekg(0, std::ios::end);
-    fileSize = file.tellg();
-    file.seekg(0, std::ios::beg);
-
-    std::vector<uint8_t> rom_data;
-    rom_data.reserve(fileSize);
-    rom_data.insert(rom_data.begin(),
-                    std::istream_iterator<uint8_t>(file),
-                    std::istream_iterator<uint8_t>());
-
-    CartridgeHeader header = get_header_from_romdata(rom_data);
-
-    switch (header.type) {
+    LoadROM(RomImage::from_file(path_to_rom));
+}
+
+void Gameboy::LoadROM(std::shared_ptr<const RomImage> rom) {
+    m_rom = std::move(rom);
+
+    m_cartridge = nullptr;
+    switch (m_rom->header().type) {
     case CartridgeType::NoMBC:
-        m_cartridge = new CartridgeNoMBC(rom_data);
+        m_cartridge = &m_cartridge_storage.emplace<CartridgeNoMBC>(m_rom);
         break;
     case CartridgeType::MBC1:
-        m_cartridge = new CartridgeMBC1(rom_data);
+        m_cartridge = &m_cartridge_storage.emplace<CartridgeMBC1>(m_rom);
         break;
+    default:
+        m_cartridge_storage.emplace<std::monostate>();
     }
 
+    if (m_cartridge) m_cartridge->set_perf_counters(&m_perf);
     m_mmu.connect_cartridge(m_cartridge);
 }
+
+std::unique_ptr<Gameboy> Gameboy::clone() const {
+    auto copy = std::make_unique<Gameboy>();
+    if (m_rom) copy->LoadROM(m_rom);
+
+    GameboyState state;
+    SaveState(state);
+    copy->LoadState(state);
+
+    copy->m_gb_running = m_gb_running;
+    copy->m_run_ahead_frames = m_run_ahead_frames;
+    copy->m_video.set_rendering(m_video.rendering());
+    copy->m_serial_output = m_serial_output;
+    copy->SetSerialCapture(m_mmu.is_serial_captured());
+    return copy;
+}
+
+uint64_t Gameboy::HashRAM() const {
+    uint64_t hash = fnv1a_hash(m_mmu.wram(), 0x2000);
+    return fnv1a_hash(m_mmu.hram(), 0x7F, hash);
+}
+
+void Gameboy::SaveState(GameboyState& state) const {
+    m_cpu.save_state(state.core.cpu);
+    m_mmu.save_state(state.core.mmu);
+    m_timer.save_state(state.core.timer);
+    m_video.save_state(state.core.video);
+    m_joypad.save_state(state.core.joypad);
+    if (m_cartridge) m_cartridge->save_state(state.core.cartridge, state.cartridge_ram);
+    state.rom_hash = GetROMHash();
+}
+
+void Gameboy::LoadState(const GameboyState& state) {
+    if (state.rom_hash != GetROMHash())
+        throw std::invalid_argument("invalid argument. save state belongs to a different rom");
+
+    m_cpu.load_state(state.core.cpu);
+    m_mmu.load_state(state.core.mmu);
+    m_timer.load_state(state.core.timer);
+    m_video.load_state(state.core.video);
+    m_joypad.load_state(state.core.joypad);
+    if (m_cartridge) m_cartridge->load_state(state.core.cartridge, state.cartridge_ram);
+}
+
+std::future<void> Gameboy::SaveStateToFile(const std::string& path) const {
+    std::vector<uint8_t> bytes;
+    GameboyState state;
+    SaveState(state);
+    serialize_state(state, bytes);
+    return save_state_file_async(path, std::move(bytes));
+}
@@ -4,32 +4,145 @@
 #include "cpu/cpu.h"
 #include "mmu.h"
 #include "timer.h"
+#include "joypad.h"
 #include "video/video.h"
 #include "cartridge.h"
+#include "perf_counters.h"
+#include "rom_image.h"
 #include <cstdint>
+#include <future>
+#include <memory>
 #include <string>
+#include <variant>
+#include <vector>
+
+// Everything needed to put a Gameboy back to an earlier point in time
+struct GameboyState {
+    // Fixed-size part, trivially copyable so it can be moved around with one memcpy.
+    // Ordered by alignment with the tail padding spelled out: there are no padding
+    // bytes, so save files and state hashes only ever contain emulator state.
+    struct Core {
+        Video::State video;
+        CPU::State cpu;
+        Timer::State timer;
+        CartridgeState cartridge;
+        Joypad::State joypad;
+        MMU::State mmu;
+        uint8_t reserved[6] = {};
+    } core;
+    std::vector<uint8_t> cartridge_ram;
+    uint64_t rom_hash = 0;
+};
 
 class Gameboy
 {
 public:
     Gameboy();
     ~Gameboy();
+    // Components hold pointers to each other, a plain copy would point back into the original
+    Gameboy(const Gameboy&) = delete;
+    Gameboy& operator=(const Gameboy&) = delete;
+
+    // Independent copy of this instance that shares the ROM image and copies everything
+    // else (a few tens of KB). Reads this instance only, so any thread may clone it as long
+    // as nothing is running it at the same time. The copy starts without a pipelined PPU
+    // and shows its first frame after its first Update.
+    std::unique_ptr<Gameboy> clone() const;
+    // Runs until the PPU enters the next VBLANK (one frame)
     void Update();
     void Step();
     inline void SetRunning(bool running) { m_gb_running = running; }
-    uint8_t* GetFramebuffer();
+    inline bool IsRunning() const { return m_gb_running; }
+    // Render pixels on a second thread (see PPUWorker)
+    inline void SetPipelinedPPU(bool enabled) { m_video.set_pipelined(enabled); }
+    // Skip pixel work for upcoming frames that nobody is going to look at
+    inline void SetRendering(bool enabled) { m_video.set_rendering(enabled); }
+    // Latest completed frame, 160x144 FB_COLOR shades (see Framebuffer::to_rgb). Call from one thread only.
+    const uint8_t* GetFramebuffer();
+    inline const Frame& GetFrame() { return m_video.latest_frame(); }
+    // A second frame reader (see FrameExchange::set_tap). Not while Update runs.
+    inline void SetFrameTap(FrameExchange* tap) { m_video.set_frame_tap(tap); }
     void LoadROM(std::string path_to_rom);
+    // Runs an already loaded image, shared with every other Gameboy that uses it
+    void LoadROM(std::shared_ptr<const RomImage> rom);
+    inline const std::shared_ptr<const RomImage>& GetROM() const { return m_rom; }
+
+    // Joypad buttons, one bit per Joypad::Button, set = pressed
+    inline void SetButtons(uint8_t pressed) { m_joypad.set_buttons(pressed); }
+    inline uint8_t GetButtons() const { return m_joypad.buttons(); }
+    // What the CPU would read at `address`, for tools that watch game variables
+    inline uint8_t ReadMemory(uint16_t address) const { return m_mmu.read_byte(address); }
+    inline uint16_t GetPC() const { return m_cpu.pc(); }
+    // Cycles emulated so far, part of the save state
+    inline uint64_t GetCycleCount() const { return m_video.cycle_count(); }
+    // Fingerprint of WRAM and HRAM only. Far cheaper than a full state hash, and two
+    // instances that agree on it are in the same game state for most purposes.
+    uint64_t HashRAM() const;
+    // Timestamped host input, safe to call from one other thread (see Joypad::InputEvent)
+    inline bool PushInputEvent(const Joypad::InputEvent& event) { return m_joypad.push_event(event); }
+    // Places the input that arrived between `from_ns` and `to_ns` into the next frame
+    inline void ScheduleInput(uint64_t from_ns, uint64_t to_ns) {
+        m_joypad.schedule_events(from_ns, to_ns, CYCLES_PER_FRAME);
+    }
+    // Places exactly these events into the next frame, for replaying recorded input
+    inline void ScheduleFrameInput(const Joypad::ScheduledEvent* events, int count) {
+        m_joypad.set_scheduled_events(events, count);
+    }
+    // Input of the frame the last Update emulated: the buttons held when it started and
+    // every scheduled event applied during it. Replaying both reproduces the frame exactly.
+    inline uint8_t GetFrameStartButtons() const { return m_joypad.frame_start_buttons(); }
+    inline int GetFrameEventCount() const { return m_joypad.frame_event_count(); }
+    inline const Joypad::ScheduledEvent& GetFrameEvent(int i) const { return m_joypad.frame_event(i); }
+
+    // Run-ahead: every Update emulates `frames` extra frames with the current input,
+    // shows the last one and rolls back. Hides the game's own input lag.
+    // Ignored while the PPU is pipelined.
+    inline void SetRunAhead(int frames) { m_run_ahead_frames = frames; }
+
+    void SaveState(GameboyState& state) const;
+    // Throws std::invalid_argument if the state was taken with a different ROM
+    void LoadState(const GameboyState& state);
+    // Snapshot now, write the file on a background thread
+    std::future<void> SaveStateToFile(const std::string& path) const;
+    inline uint64_t GetROMHash() const { return m_rom ? m_rom->hash() : 0; }
+
+    // Counters since this Gameboy was created and the most recent frames (see PerfCounters).
+    // Only consistent on the thread that runs the Gameboy, EmulatorThread republishes them.
+    inline const PerfCounters& GetPerfCounters() const { return m_perf; }
+    inline const PerfHistory& GetPerfHistory() const { return m_perf_history; }
+
+    // Keep serial output in memory instead of printing it, for headless runs
+    inline void SetSerialCapture(bool enabled) { m_mmu.set_serial_capture(enabled ? &m_serial_output : nullptr); }
+    inline const std::string& GetSerialOutput() const { return m_serial_output; }
+
+    static constexpr int CYCLES_PER_FRAME = 70224; // 154 scanlines * 456 cycles
 
 private:
     CPU m_cpu;
     MMU m_mmu;
     Timer m_timer;
     Video m_video;
-    Cartridge* m_cartridge;
+    Joypad m_joypad;
+    // The mapper lives inside the Gameboy, m_cartridge points at whichever one is active
+    std::variant<std::monostate, CartridgeNoMBC, CartridgeMBC1> m_cartridge_storage;
+    Cartridge* m_cartridge = nullptr;
+    std::shared_ptr<const RomImage> m_rom;
 
     bool m_gb_running = false;
+    std::string m_serial_output;
+
+    int m_run_ahead_frames = 0;
+    GameboyState m_run_ahead_state;
+
+    PerfCounters m_perf;
+    PerfHistory m_perf_history;
+
+    PerfFrameSample run_frame();
+    void record_frame(PerfFrameSample sample, std::chrono::steady_clock::time_point start);
+    int timed_step();
 
     friend class Debugger;
+    friend class LockstepGroup;
 };
 
 #endif // GAMEBOY_H
@@ -0,0 +1,112 @@
+#include "joypad.h"
+#include "cpu/interrupt_controller.h"
+#include <algorithm>
+
+Joypad::Joypad(MMU& mmu)
+    : m_mmu(mmu) {}
+
+uint8_t Joypad::input_lines() const {
+    uint8_t lines = 0x0F;
+    if ((m_select & 0b010000) == 0) // P14 : direction keys
+        lines &= ~(m_pressed & 0x0F);
+    if ((m_select & 0b100000) == 0) // P15 : button keys
+        lines &= ~(m_pressed >> 4);
+    return lines;
+}
+
+uint8_t Joypad::read() const {
+    return 0xC0 | m_select | input_lines();
+}
+
+void Joypad::write(uint8_t value) {
+    m_select = value & 0x30;
+}
+
+void Joypad::set_button(Button button, bool pressed) {
+    uint8_t buttons = m_pressed & ~(1 << button);
+    if (pressed) buttons |= (1 << button);
+    set_buttons(buttons);
+}
+
+void Joypad::set_buttons(uint8_t pressed) {
+    uint8_t old_lines = input_lines();
+    m_pressed = pressed;
+
+    // Interrupt fires when a selected input line goes from high to low
+    if ((old_lines & ~input_lines()) != 0)
+        m_mmu.request_interrupt(InterruptController::JOYPAD);
+}
+
+bool Joypad::push_event(const InputEvent& event) {
+    return m_events.push(event);
+}
+
+void Joypad::schedule_events(uint64_t from_ns, uint64_t to_ns, int cycles_per_frame) {
+    // Events no frame has run for yet (paused, single stepping) happened before this window,
+    // they go to the start of the frame instead of being dropped
+    int carried = 0;
+    for (int i = m_next_scheduled; i < m_scheduled_count; i++)
+        m_scheduled[carried++] = ScheduledEvent {0, m_scheduled[i].button, m_scheduled[i].pressed};
+    m_scheduled_count = carried;
+    m_next_scheduled = 0;
+    m_frame_event_count = 0;
+
+    const uint64_t window_ns = to_ns > from_ns ? to_ns - from_ns : 1;
+    while (m_scheduled_count < MAX_EVENTS_PER_FRAME) {
+        InputEvent event;
+        if (m_has_held_event) {
+            event = m_held_event;
+            m_has_held_event = false;
+        } else if (!m_events.pop(event)) {
+            break;
+        }
+
+        if (event.host_time_ns >= to_ns) {
+            // Happened after this frame's window, keep it for the next one
+            m_held_event = event;
+            m_has_held_event = true;
+            break;
+        }
+
+        int cycle = 0;
+        if (event.host_time_ns > from_ns)
+            cycle = static_cast<int>((event.host_time_ns - from_ns) * cycles_per_frame / window_ns);
+        m_scheduled[m_scheduled_count++] = ScheduledEvent {cycle, event.button, event.pressed};
+    }
+}
+
+void Joypad::apply_events(int cycle) {
+    while (m_next_scheduled < m_scheduled_count && m_scheduled[m_next_scheduled].cycle <= cycle) {
+        const ScheduledEvent& event = m_scheduled[m_next_scheduled++];
+        set_button(event.button, event.pressed);
+    }
+}
+
+void Joypad::set_scheduled_events(const ScheduledEvent* events, int count) {
+    m_scheduled_count = std::min(count, MAX_EVENTS_PER_FRAME);
+    m_next_scheduled = 0;
+    m_frame_event_count = 0;
+    std::copy(events, events + m_scheduled_count, m_scheduled.begin());
+}
+
+void Joypad::begin_frame() {
+    m_frame_start_pressed = m_pressed;
+    m_frame_event_count = 0;
+}
+
+void Joypad::end_frame() {
+    // Everything scheduled has been applied by now, it only stays around to be read back
+    m_frame_event_count = m_scheduled_count;
+    m_scheduled_count = 0;
+    m_next_scheduled = 0;
+}
+
+void Joypad::save_state(State& state) const {
+    state.select = m_select;
+    state.pressed = m_pressed;
+}
+
+void Joypad::load_state(const State& state) {
+    m_select = state.select;
+    m_pressed = state.pressed;
+}
@@ -0,0 +1,108 @@
+#ifndef JOYPAD_H
+#define JOYPAD_H
+
+#include <array>
+#include <climits>
+#include <cstdint>
+#include "mmu.h"
+#include "spsc_ring.h"
+
+class MMU;
+
+class Joypad
+{
+public:
+    enum Button {
+        RIGHT  = 0,
+        LEFT   = 1,
+        UP     = 2,
+        DOWN   = 3,
+        A      = 4,
+        B      = 5,
+        SELECT = 6,
+        START  = 7
+    };
+
+    struct State {
+        uint8_t select;     // P14/P15 select lines as last written to FF00
+        uint8_t pressed;    // one bit per Button, set = pressed
+    };
+
+    // A host key press/release, stamped with the host clock (nanoseconds) when it happened
+    struct InputEvent {
+        uint64_t host_time_ns;
+        Button button;
+        bool pressed;
+    };
+
+    // A press/release placed into a frame, `cycle` cycles after the frame started
+    struct ScheduledEvent {
+        int cycle;
+        Button button;
+        bool pressed;
+    };
+    static constexpr int MAX_EVENTS_PER_FRAME = 64;
+
+    Joypad(MMU& mmu);
+
+    // FF00 : P1/JOYP
+    uint8_t read() const;
+    void write(uint8_t value);
+
+    void set_button(Button button, bool pressed);
+    // Replaces the whole button state at once, one bit per Button
+    void set_buttons(uint8_t pressed);
+    inline uint8_t buttons() const { return m_pressed; }
+
+    // Host input thread only
+    bool push_event(const InputEvent& event);
+
+    // Emulation thread: takes the events that happened on the host between `from_ns` and
+    // `to_ns` and spreads them over the next frame at the same relative positions, so a
+    // press lands on the matching cycle instead of a whole frame late. Events still waiting
+    // from an earlier call that no frame ran for are kept, at the start of the frame.
+    void schedule_events(uint64_t from_ns, uint64_t to_ns, int cycles_per_frame);
+    // Cycle (relative to frame start) of the next scheduled event, INT_MAX if none
+    inline int next_event_cycle() const {
+        return m_next_scheduled < m_scheduled_count ? m_scheduled[m_next_scheduled].cycle : INT_MAX;
+    }
+    // Applies every scheduled event at or before `cycle`, raising JOYPAD as needed
+    void apply_events(int cycle);
+    // Replaces the schedule of the next frame with `count` events sorted by cycle (movie replay)
+    void set_scheduled_events(const ScheduledEvent* events, int count);
+
+    // Bracket the frame the schedule is for. end_frame() hands the schedule over to the
+    // frame_* accessors, which keep the frame's input until the next frame is scheduled.
+    void begin_frame();
+    void end_frame();
+    // Buttons held when the last frame started and the events applied during it
+    inline uint8_t frame_start_buttons() const { return m_frame_start_pressed; }
+    inline int frame_event_count() const { return m_frame_event_count; }
+    inline const ScheduledEvent& frame_event(int i) const { return m_scheduled[i]; }
+
+    void save_state(State& state) const;
+    void load_state(const State& state);
+
+private:
+    uint8_t m_select = 0x30;
+    uint8_t m_pressed = 0;
+
+    MMU& m_mmu;
+
+    SPSCRing<InputEvent, 256> m_events;
+    // An event popped from the ring that belongs to a later frame
+    InputEvent m_held_event;
+    bool m_has_held_event = false;
+
+    std::array<ScheduledEvent, MAX_EVENTS_PER_FRAME> m_scheduled;
+    int m_scheduled_count = 0;
+    int m_next_scheduled = 0;
+
+    uint8_t m_frame_start_pressed = 0;
+    int m_frame_event_count = 0;
+
+    // Low nibble of FF00 for the current select lines (active low)
+    uint8_t input_lines() const;
+};
+
+#endif // JOYPAD_H
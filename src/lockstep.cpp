@@ -0,0 +1,243 @@
+#include "lockstep.h"
+#include <climits>
+#include <stdexcept>
+
+// Flag bits of F
+static constexpr uint8_t FLAG_Z = 0x80;
+static constexpr uint8_t FLAG_N = 0x40;
+static constexpr uint8_t FLAG_H = 0x20;
+static constexpr uint8_t FLAG_C = 0x10;
+
+LockstepGroup::LockstepGroup(const Gameboy& start, int lanes)
+    : m_lanes(lanes) {
+    if (lanes <= 0 || lanes > MAX_LANES)
+        throw std::invalid_argument("invalid argument. a lockstep group has 1 to 16 lanes");
+
+    for (int i = 0; i < lanes; i++) {
+        m_gbs.push_back(start.clone());
+        m_gbs.back()->SetRunning(true);
+    }
+    m_regs = Registers {};
+}
+
+uint8_t* LockstepGroup::r8(int index) {
+    // Same order as the opcode encoding: B, C, D, E, H, L, (HL), A
+    switch (index) {
+    case 0: return m_regs.b.data();
+    case 1: return m_regs.c.data();
+    case 2: return m_regs.d.data();
+    case 3: return m_regs.e.data();
+    case 4: return m_regs.h.data();
+    case 5: return m_regs.l.data();
+    case 7: return m_regs.a.data();
+    }
+    return nullptr;
+}
+
+void LockstepGroup::load_lane(int lane) {
+    const CPU& cpu = m_gbs[lane]->m_cpu;
+    m_regs.a[lane] = cpu.m_a;
+    m_regs.f[lane] = cpu.m_f;
+    m_regs.b[lane] = cpu.m_b;
+    m_regs.c[lane] = cpu.m_c;
+    m_regs.d[lane] = cpu.m_d;
+    m_regs.e[lane] = cpu.m_e;
+    m_regs.h[lane] = cpu.m_h;
+    m_regs.l[lane] = cpu.m_l;
+    m_regs.sp[lane] = cpu.m_sp;
+    m_regs.pc[lane] = cpu.m_pc;
+}
+
+void LockstepGroup::store_lane(int lane) {
+    CPU& cpu = m_gbs[lane]->m_cpu;
+    cpu.m_a = m_regs.a[lane];
+    cpu.m_f = m_regs.f[lane];
+    cpu.m_b = m_regs.b[lane];
+    cpu.m_c = m_regs.c[lane];
+    cpu.m_d = m_regs.d[lane];
+    cpu.m_e = m_regs.e[lane];
+    cpu.m_h = m_regs.h[lane];
+    cpu.m_l = m_regs.l[lane];
+    cpu.m_sp = m_regs.sp[lane];
+    cpu.m_pc = m_regs.pc[lane];
+}
+
+int LockstepGroup::step_scalar(int lane) {
+    store_lane(lane);
+    int cycles = m_gbs[lane]->m_cpu.execute_next_opcode();
+    load_lane(lane);
+    m_stats.scalar_lane_steps++;
+    return cycles;
+}
+
+bool LockstepGroup::step_vector(uint8_t opcode, const Mask& mask, std::array<int, MAX_LANES>& cycles) {
+    auto& a = m_regs.a;
+    auto& f = m_regs.f;
+    auto& pc = m_regs.pc;
+    const int src_index = opcode & 0b111;
+    const int dst_index = (opcode >> 3) & 0b111;
+
+    if (opcode == 0x00) {
+        // nop
+        for (int i = 0; i < MAX_LANES; i++)
+            pc[i] += mask[i] & 1;
+    } else if ((opcode & 0b11000000) == 0x40 && opcode != 0x76 && src_index != 6 && dst_index != 6) {
+        // ld r8, r8
+        const uint8_t* src = r8(src_index);
+        uint8_t* dst = r8(dst_index);
+        for (int i = 0; i < MAX_LANES; i++) {
+            dst[i] = (src[i] & mask[i]) | (dst[i] & ~mask[i]);
+            pc[i] += mask[i] & 1;
+        }
+    } else if ((opcode & 0b11000111) == 0x06 && dst_index != 6) {
+        // ld r8, u8 : the immediate comes from each lane's own memory map
+        uint8_t* dst = r8(dst_index);
+        for (int i = 0; i < m_lanes; i++) {
+            if (!mask[i]) continue;
+            dst[i] = m_gbs[i]->m_mmu.read_byte(pc[i] + 1);
+            pc[i] += 2;
+        }
+    } else if ((opcode & 0b11000110) == 0x04 && dst_index != 6) {
+        // inc r8 / dec r8, carry is not affected
+        uint8_t* r = r8(dst_index);
+        const bool dec = (opcode & 1) != 0;
+        for (int i = 0; i < MAX_LANES; i++) {
+            const uint8_t x = r[i];
+            const uint8_t result = dec ? x - 1 : x + 1;
+            const bool half = dec ? (x & 0xF) == 0 : (x & 0xF) == 0xF;
+            const uint8_t flags = (result == 0 ? FLAG_Z : 0) | (dec ? FLAG_N : 0) | (half ? FLAG_H : 0) | (f[i] & FLAG_C);
+            r[i] = (result & mask[i]) | (x & ~mask[i]);
+            f[i] = (flags & mask[i]) | (f[i] & ~mask[i]);
+            pc[i] += mask[i] & 1;
+        }
+    } else if ((opcode & 0b11000000) == 0x80 && src_index != 6 && dst_index != 1 && dst_index != 3) {
+        // add/sub/and/xor/or/cp A, r8 (adc and sbc go through the reference CPU)
+        const uint8_t* src = r8(src_index);
+        for (int i = 0; i < MAX_LANES; i++) {
+            const int x = a[i];
+            const int y = src[i];
+            int result;
+            uint8_t flags;
+            switch (dst_index) {
+            case 0: // add
+                result = x + y;
+                flags = (((x & 0xF) + (y & 0xF)) > 0xF ? FLAG_H : 0) | (result > 0xFF ? FLAG_C : 0);
+                break;
+            case 4: // and
+                result = x & y;
+                flags = FLAG_H;
+                break;
+            case 5: // xor
+                result = x ^ y;
+                flags = 0;
+                break;
+            case 6: // or
+                result = x | y;
+                flags = 0;
+                break;
+            default: // sub, cp
+                result = x - y;
+                flags = FLAG_N | (((x & 0xF) - (y & 0xF)) < 0 ? FLAG_H : 0) | (result < 0 ? FLAG_C : 0);
+                break;
+            }
+            flags |= (result & 0xFF) == 0 ? FLAG_Z : 0;
+            const uint8_t new_a = dst_index == 7 ? x : static_cast<uint8_t>(result);
+            a[i] = (new_a & mask[i]) | (a[i] & ~mask[i]);
+            f[i] = (flags & mask[i]) | (f[i] & ~mask[i]);
+            pc[i] += mask[i] & 1;
+        }
+    } else if (opcode == 0x18 || (opcode & 0b11100111) == 0x20) {
+        // jr / jr cc, each lane may or may not take the branch
+        for (int i = 0; i < m_lanes; i++) {
+            if (!mask[i]) continue;
+            bool taken = true;
+            if (opcode != 0x18) {
+                switch ((opcode >> 3) & 0b11) {
+                case 0: taken = (f[i] & FLAG_Z) == 0; break;
+                case 1: taken = (f[i] & FLAG_Z) != 0; break;
+                case 2: taken = (f[i] & FLAG_C) == 0; break;
+                case 3: taken = (f[i] & FLAG_C) != 0; break;
+                }
+            }
+            const int8_t offset = static_cast<int8_t>(m_gbs[i]->m_mmu.read_byte(pc[i] + 1));
+            pc[i] += 2 + (taken ? offset : 0);
+            cycles[i] = taken ? CPU::unprefixed_opcode_cycles_branch[opcode] : CPU::unprefixed_opcode_cycles_no_branch[opcode];
+        }
+        return true;
+    } else {
+        return false;
+    }
+
+    for (int i = 0; i < m_lanes; i++)
+        cycles[i] = CPU::unprefixed_opcode_cycles_no_branch[opcode];
+    return true;
+}
+
+void LockstepGroup::run_frame() {
+    std::array<uint64_t, MAX_LANES> start_frame {};
+    std::array<int, MAX_LANES> cycles_so_far {};
+    std::array<int, MAX_LANES> cycles {};
+    Mask active {};
+    for (int i = 0; i < m_lanes; i++) {
+        load_lane(i);
+        start_frame[i] = m_gbs[i]->m_video.frame_count();
+        active[i] = 0xFF;
+    }
+
+    int running = m_lanes;
+    while (running > 0) {
+        // Leader: the first active lane that is not halted
+        int leader = -1;
+        for (int i = 0; i < m_lanes && leader < 0; i++) {
+            if (active[i] && !m_gbs[i]->m_cpu.is_halted()) leader = i;
+        }
+
+        Mask mask {};
+        bool vectorized = false;
+        if (leader >= 0) {
+            const uint16_t leader_pc = m_regs.pc[leader];
+            const uint8_t opcode = m_gbs[leader]->m_mmu.read_byte(leader_pc);
+            int lanes_in_mask = 0;
+            for (int i = 0; i < m_lanes; i++) {
+                if (active[i] && m_regs.pc[i] == leader_pc && !m_gbs[i]->m_cpu.is_halted()
+                        && m_gbs[i]->m_mmu.read_byte(leader_pc) == opcode) {
+                    mask[i] = 0xFF;
+                    lanes_in_mask++;
+                }
+            }
+            vectorized = lanes_in_mask > 1 && step_vector(opcode, mask, cycles);
+            if (vectorized) {
+                m_stats.vector_steps++;
+                m_stats.vector_lane_steps += lanes_in_mask;
+            }
+        }
+
+        for (int i = 0; i < m_lanes; i++) {
+            if (!active[i]) continue;
+            Gameboy& gb = *m_gbs[i];
+
+            if (!vectorized || !mask[i])
+                cycles[i] = step_scalar(i);
+
+            cycles_so_far[i] += cycles[i];
+            gb.m_timer.tick(cycles[i]);
+            gb.m_video.update_graphics(cycles[i]);
+            if (gb.m_cpu.interrupt_pending()) {
+                store_lane(i);
+                gb.m_cpu.handle_interrupts();
+                load_lane(i);
+            }
+
+            // Same stop condition as Gameboy::run_frame
+            const bool vblank = gb.m_video.frame_count() != start_frame[i];
+            const bool lcd_off_frame = cycles_so_far[i] >= Gameboy::CYCLES_PER_FRAME && !gb.m_video.is_lcd_enabled();
+            if (vblank || lcd_off_frame) {
+                active[i] = 0;
+                running--;
+            }
+        }
+    }
+
+    for (int i = 0; i < m_lanes; i++)
+        store_lane(i);
+}
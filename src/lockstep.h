@@ -0,0 +1,66 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "gameboy.h"
+
+// Experimental: runs up to MAX_LANES clones of one Gameboy in lockstep.
+//
+// While a frame runs, the CPU registers of every lane live here as structure-of-arrays.
+// Each step, the lanes that sit on the same PC with the same opcode form a mask. If that
+// opcode is one of the register-only instructions below, it is executed for the whole
+// mask at once by fixed-width loops the compiler turns into SIMD. Any other lane, or any
+// other opcode, goes through that lane's own CPU, which stays the reference for what an
+// instruction does. Lanes that diverge rejoin the mask as soon as their PCs meet again.
+//
+// Vectorized: nop, ld r,r, ld r,n, inc r, dec r, add/sub/and/xor/or/cp A,r, jr, jr cc
+// (no (HL) operands). Timer, PPU and interrupts still run per lane.
+class LockstepGroup
+{
+public:
+    static constexpr int MAX_LANES = 16;
+
+    LockstepGroup(const Gameboy& start, int lanes);
+
+    inline int lanes() const { return m_lanes; }
+    inline Gameboy& lane(int index) { return *m_gbs[index]; }
+    inline void set_buttons(int lane, uint8_t buttons) { m_gbs[lane]->SetButtons(buttons); }
+
+    // Runs every lane up to its next VBLANK, like Gameboy::Update. Joypad input has to be
+    // set with set_buttons, timestamped events are not applied.
+    void run_frame();
+
+    struct Stats {
+        uint64_t vector_steps = 0;      // steps executed for a whole mask at once
+        uint64_t vector_lane_steps = 0; // lane-instructions covered by those steps
+        uint64_t scalar_lane_steps = 0; // lane-instructions run through the reference CPU
+    };
+    inline const Stats& stats() const { return m_stats; }
+
+private:
+    using Mask = std::array<uint8_t, MAX_LANES>;    // 0xFF = lane takes part
+
+    // SoA register file, authoritative only inside run_frame
+    struct alignas(64) Registers {
+        std::array<uint8_t, MAX_LANES> a, f, b, c, d, e, h, l;
+        std::array<uint16_t, MAX_LANES> sp, pc;
+    };
+
+    void load_lane(int lane);   // CPU -> SoA
+    void store_lane(int lane);  // SoA -> CPU
+    // Runs one instruction of `lane` on its own CPU
+    int step_scalar(int lane);
+    // Returns false if `opcode` is not vectorized; fills `cycles` for the lanes in `mask`
+    bool step_vector(uint8_t opcode, const Mask& mask, std::array<int, MAX_LANES>& cycles);
+    uint8_t* r8(int index);
+
+    std::vector<std::unique_ptr<Gameboy>> m_gbs;
+    int m_lanes;
+    Registers m_regs;
+    Stats m_stats;
+};
+
+#endif // LOCKSTEP_H
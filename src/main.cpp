@@ -1,12 +1,17 @@
 #include "raylib.h"
 
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
 #include <iomanip>
 #include <string>
 #include <sstream>
+#include <vector>
 
 #include "gameboy.h"
 #include "debugger.h"
+#include "emulator_thread.h"
+#include "trace.h"
 #include "utility.h"
 
 #define RAYGUI_IMPLEMENTATION
@@ -18,7 +23,7 @@
 
 class GUI {
 public:
-    GUI(Gameboy& gb, Debugger& debugger) : m_gb(gb), m_debugger(debugger) {}
+    GUI(Gameboy& gb, Debugger& debugger, EmulatorThread& emulator) : m_gb(gb), m_debugger(debugger), m_emulator(emulator) {}
 
     void Paint() {
         // debugger side panel
@@ -31,6 +36,15 @@ public:
         // main gui
         GuiPanel(Rectangle {sidepanel_width, 0, main_gui_width, screen_height});
         GuiGrid(Rectangle {sidepanel_width, 0, main_gui_width, screen_height}, 10, 2);
+        speed_panel(sidepanel_width + main_gui_width/2 - 240, 720);
+
+        joypad_input();
+        hotkeys();
+    }
+
+    // Toggled with F3, drawn over the game screen at (x, y)
+    void PaintOverlay(float x, float y) {
+        if (m_show_perf) perf_overlay(x, y);
     }
 
 private:
@@ -40,13 +54,101 @@ private:
 
     void reset_step_button_group(float x, float y) {
         if (GuiButton(paddedRectangle(x + 0, y + 0, sidepanel_width/2 - 30, 60), "Reset")) {
-            m_debugger.reset();
+            m_emulator.send(EmulatorThread::Command::RESET);
         }
 
-        m_gb.SetRunning(GuiToggle(paddedRectangle(x + sidepanel_width/2 - 40, y + 0, 80, 60), m_debugger.gb_is_running() ? "#132#" : "#131#", m_debugger.gb_is_running()));
+        bool running = GuiToggle(paddedRectangle(x + sidepanel_width/2 - 40, y + 0, 80, 60), m_debugger.gb_is_running() ? "#132#" : "#131#", m_debugger.gb_is_running());
+        if (running != m_debugger.gb_is_running())
+            m_emulator.send(running ? EmulatorThread::Command::RUN : EmulatorThread::Command::PAUSE);
 
         if (GuiButton(paddedRectangle(x + sidepanel_width/2 + 30, y + 0, sidepanel_width/2 - 30, 60), "Step")) {
-            m_debugger.step();
+            m_emulator.send(EmulatorThread::Command::STEP);
+        }
+    }
+
+    void speed_panel(float x, float y) {
+        // Hold TAB to run unlimited regardless of the selected speed
+        constexpr int speeds[] = {1, 2, 4, 8, EmulatorThread::UNLIMITED};
+        m_speed_index = GuiToggleGroup(Rectangle {x, y, 480 / 5, 40}, "1x;2x;4x;8x;MAX", m_speed_index);
+        m_emulator.set_speed(IsKeyDown(KEY_TAB) ? EmulatorThread::UNLIMITED : speeds[m_speed_index]);
+
+        std::stringstream ss;
+        ss << "Speed : " << std::fixed << std::setprecision(2) << m_emulator.achieved_speed() << "x";
+        GuiLabel(Rectangle {x, y + 50, 480, 20}, ss.str().c_str());
+
+        GuiLabel(Rectangle {x, y + 90, 480, 20}, "Run-ahead frames");
+        m_run_ahead = GuiToggleGroup(Rectangle {x, y + 120, 480 / 4, 40}, "0;1;2;3", m_run_ahead);
+        m_emulator.set_run_ahead(m_run_ahead);
+    }
+
+    void hotkeys() {
+        if (IsKeyPressed(KEY_F5)) m_emulator.send(EmulatorThread::Command::SAVE_STATE);
+        if (IsKeyPressed(KEY_F9)) m_emulator.send(EmulatorThread::Command::LOAD_STATE);
+        if (IsKeyPressed(KEY_F6)) {
+            m_recording = !m_recording;
+            m_emulator.send(m_recording ? EmulatorThread::Command::START_RECORDING : EmulatorThread::Command::STOP_RECORDING);
+        }
+        m_emulator.set_rewinding(IsKeyDown(KEY_R));
+        if (IsKeyPressed(KEY_F3)) m_show_perf = !m_show_perf;
+    }
+
+    void perf_overlay(float x, float y) {
+        const EmulatorThread::PerfSnapshot& perf = m_emulator.perf();
+        const PerfCounters& counters = perf.counters;
+        const PerfHistory& history = perf.history;
+
+        uint64_t instructions = 0, cycles = 0;
+        for (size_t i = 0; i < history.size(); i++) {
+            instructions += history[i].instructions;
+            cycles += history[i].cycles;
+        }
+        const size_t frames = history.size() > 0 ? history.size() : 1;
+
+        std::stringstream lines[6];
+        lines[0] << std::fixed << std::setprecision(2) << "Frame  p50 " << history.host_ns_percentile(0.5) / 1e6
+                 << " ms  p99 " << history.host_ns_percentile(0.99) / 1e6 << " ms";
+        lines[1] << "Per frame  " << instructions / frames << " instr  " << cycles / frames << " cycles";
+        // Shares of the sampled host time, see PerfCounters
+        const double host_ns = std::max<uint64_t>(1, counters.cpu_ns + counters.ppu_ns + counters.timer_ns);
+        lines[2] << std::fixed << std::setprecision(0) << "Host time  CPU " << 100 * counters.cpu_ns / host_ns << "% (MMIO " << 100 * counters.mmio_ns / host_ns
+                 << "%)  PPU " << 100 * counters.ppu_ns / host_ns << "%  Timer " << 100 * counters.timer_ns / host_ns << "%";
+        lines[3] << "Frames  " << counters.frames_rendered << " rendered  " << counters.frames_skipped << " skipped  "
+                 << counters.frames_speculative << " run-ahead";
+        lines[4] << "IRQ  VBL " << counters.interrupts[InterruptController::VBLANK] << "  LCD " << counters.interrupts[InterruptController::LCD]
+                 << "  TIM " << counters.interrupts[InterruptController::TIMER] << "  JOY " << counters.interrupts[InterruptController::JOYPAD];
+        lines[5] << "DMA " << counters.dma_transfers << "  Bank switches " << counters.bank_switches;
+
+        constexpr int font_size = 18;
+        constexpr float line_height = 22;
+        constexpr float histogram_height = 80;
+        DrawRectangle(x, y, 160 * 3, 6 * line_height + histogram_height + 50, Fade(BLACK, 0.75f));
+        for (int i = 0; i < 6; i++)
+            DrawText(lines[i].str().c_str(), x + 10, y + 8 + i * line_height, font_size, RAYWHITE);
+
+        // Frame time histogram over the last PerfHistory::SIZE frames
+        const auto buckets = history.histogram();
+        uint32_t tallest = 1;
+        for (uint32_t count : buckets) tallest = std::max(tallest, count);
+        const char* labels[PerfHistory::BUCKETS] = {"<.125", "<.25", "<.5", "<1", "<2", "<4", "<16.7", "more"};
+        const float bar_width = 160 * 3 / PerfHistory::BUCKETS;
+        const float base_y = y + 8 + 6 * line_height + histogram_height;
+        for (size_t i = 0; i < PerfHistory::BUCKETS; i++) {
+            const float height = histogram_height * buckets[i] / tallest;
+            const float bar_x = x + i * bar_width;
+            // Frames slower than real time are the ones to worry about
+            DrawRectangle(bar_x + 4, base_y - height, bar_width - 8, height, i + 1 == PerfHistory::BUCKETS ? RED : SKYBLUE);
+            DrawText(labels[i], bar_x + 6, base_y + 4, 14, RAYWHITE);
+        }
+    }
+
+    void joypad_input() {
+        constexpr std::pair<int, Joypad::Button> keymap[] = {
+            {KEY_RIGHT, Joypad::RIGHT}, {KEY_LEFT, Joypad::LEFT}, {KEY_UP, Joypad::UP}, {KEY_DOWN, Joypad::DOWN},
+            {KEY_Z, Joypad::A}, {KEY_X, Joypad::B}, {KEY_BACKSPACE, Joypad::SELECT}, {KEY_ENTER, Joypad::START}
+        };
+        for (auto [key, button] : keymap) {
+            if (IsKeyPressed(key)) m_emulator.push_input(button, true);
+            if (IsKeyReleased(key)) m_emulator.push_input(button, false);
         }
     }
 
@@ -137,9 +239,10 @@ private:
 
     void gameboy_video_out(float x, float y) {
         //GuiPanel(Rectangle{x - 2, y - 2, 160 * 3 + 4, 144 * 3 + 4});
-        uint8_t* gb_fb_ptr =  m_gb.GetFramebuffer();
+        static uint8_t gb_fb_rgb[Framebuffer::WIDTH * Framebuffer::HEIGHT * 3];
+        m_gb.GetFrame().framebuffer.to_rgb(gb_fb_rgb);
         Image gb_fb_img = {
-            .data = gb_fb_ptr,
+            .data = (void*)gb_fb_rgb,
             .width = 160,
             .height = 144,
             .mipmaps = 1,
@@ -162,11 +265,20 @@ private:
 
     Gameboy& m_gb;
     Debugger& m_debugger;
+    EmulatorThread& m_emulator;
+    int m_speed_index = 0;
+    int m_run_ahead = 0;
+    bool m_recording = false;
+    bool m_show_perf = false;
 };
 
 #include "timer.h"
 
-int main() {
+int main(int argc, char** argv) {
+    // The save state and movie sit next to the ROM, e.g. cpu_instrs.sst and cpu_instrs.sbm
+    const std::string rom_path = argc > 1 ? argv[1] : "D:\\projects\\sleepy_boi\\res\\cpu_instrs.gb";
+    const std::string base_path = rom_path.substr(0, rom_path.find_last_of('.'));
+
     constexpr int screenWidth = 1300;
     constexpr int screenHeight = 1000;
     SetTraceLogLevel(LOG_NONE);
@@ -177,21 +289,48 @@ int main() {
     // ToggleFullscreen();
 
     Gameboy gb;
-    gb.LoadROM("D:\\projects\\sleepy_boi\\res\\cpu_instrs.gb");
+    gb.LoadROM(rom_path);
     Debugger debugger(gb);
-    GUI gui(gb, debugger);
+    EmulatorThread emulator(gb, debugger);
+    emulator.set_state_path(base_path + ".sst");
+    emulator.set_movie_path(base_path + ".sbm");
+    // Opt-in timeline for chrome://tracing, written on exit. Needs a -DSLEEPY_BOI_TRACE=ON build.
+    const char* trace_path = std::getenv("SLEEPY_BOI_TRACE_FILE");
+    if (trace_path) Tracer::start();
+    TRACE_THREAD_NAME("gui");
+    // Opt-in frame export for external tools, e.g. SLEEPY_BOI_SHM=sleepy_boi
+    if (const char* shm_name = std::getenv("SLEEPY_BOI_SHM"))
+        emulator.set_export_name(shm_name);
+    // Octal, e.g. SLEEPY_BOI_SHM_MODE=0666 so readers running as other users can wait for frames
+    if (const char* shm_mode = std::getenv("SLEEPY_BOI_SHM_MODE"))
+        emulator.set_export_mode(std::strtoul(shm_mode, nullptr, 8));
+    GUI gui(gb, debugger, emulator);
+
+    // The emulator publishes frames at its own pace, re-upload only when a new one shows up
+    const Frame* frame = &gb.GetFrame();
+    std::vector<uint8_t> gb_fb_rgb(Framebuffer::WIDTH * Framebuffer::HEIGHT * 3);
+    frame->framebuffer.to_rgb(gb_fb_rgb.data());
+    Image gb_fb_img = {
+        .data = (void*)gb_fb_rgb.data(),
+        .width = 160,
+        .height = 144,
+        .mipmaps = 1,
+        .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8
+    };
+    Texture2D gb_fb_tx = LoadTextureFromImage(gb_fb_img);
+    uint64_t presented_sequence = frame->sequence;
+
+    emulator.start();
 
     while(!WindowShouldClose()) {
-        gb.Update();
-        Image gb_fb_img = {
-            .data = gb.GetFramebuffer(),
-            .width = 160,
-            .height = 144,
-            .mipmaps = 1,
-            .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8
-        };
-        Texture2D gb_fb_tx = LoadTextureFromImage(gb_fb_img);
-
+        debugger.refresh();
+        frame = &gb.GetFrame();
+        if (frame->sequence != presented_sequence) {
+            TRACE_SCOPE("texture upload");
+            frame->framebuffer.to_rgb(gb_fb_rgb.data());
+            UpdateTexture(gb_fb_tx, gb_fb_rgb.data());
+            presented_sequence = frame->sequence;
+        }
 
         BeginDrawing();
 
@@ -199,19 +338,35 @@ int main() {
         GuiSetStyle(DEFAULT, TEXT_SIZE, 20);
 
         ClearBackground(GetColor(GuiGetStyle(DEFAULT, BACKGROUND_COLOR)));
-        gui.Paint();
+        {
+            TRACE_SCOPE("gui paint");
+            gui.Paint();
+        }
 
         DrawTextureQuad(gb_fb_tx, Vector2 {1.0f, 1.0f}, Vector2 {0.0f, 0.0f}, Rectangle {(float)(190 + GetScreenWidth() / 2 - 80 * 3), (float)(GetScreenHeight() / 2 - 80*3), 160 * 3, 144 * 3}, WHITE);
+        gui.PaintOverlay((float)(190 + GetScreenWidth() / 2 - 80 * 3), (float)(GetScreenHeight() / 2 - 80*3));
 
         // Dumb custom cursor
         float mouseX = GetMouseX(), mouseY = GetMouseY();
         DrawLineEx(Vector2 {mouseX, mouseY}, Vector2 {mouseX + 10, mouseY}, 2, BLACK);
         DrawLineEx(Vector2 {mouseX, mouseY}, Vector2 {mouseX, mouseY + 10}, 2, BLACK);
         DrawLineEx(Vector2 {mouseX, mouseY}, Vector2 {mouseX + 15, mouseY + 15}, 2, BLACK);
-        EndDrawing();
-
-        UnloadTexture(gb_fb_tx);
+        {
+            // Swaps buffers, so this is where the loop waits for vsync
+            TRACE_SCOPE("vsync wait");
+            EndDrawing();
+        }
+        emulator.frame_presented();
     }
 
+    emulator.stop();
+    if (trace_path) {
+        try {
+            Tracer::write(trace_path);
+        } catch (const std::exception& e) {
+            std::cerr << "trace: " << e.what() << std::endl;
+        }
+    }
+    UnloadTexture(gb_fb_tx);
     CloseWindow();
 }
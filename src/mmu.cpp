@@ -1,14 +1,22 @@
 #include "mmu.h"
+#include "joypad.h"
+#include <chrono>
 #include <stdexcept>
 #include <cassert>
 #include <iostream>
 
 MMU::MMU()
 {
-    m_memory.fill(0); // clear memory just in case
+    // clear memory just in case
+    m_vram.fill(0);
+    m_wram.fill(0);
+    m_oam.fill(0);
+    m_io.fill(0);
+    m_hram.fill(0);
 }
 
 void MMU::oam_dma_transfer(uint16_t start_addr) {
+    if (m_perf) m_perf->dma_transfers++;
     start_addr = start_addr << 8;
     for (int i = 0; i < 0xA0; i++)
         write_byte(0xFE00 + i, read_byte(start_addr + i));
@@ -26,7 +34,7 @@ uint8_t MMU::read_byte(const uint16_t address) const {
     } else if (address <= 0x9FFF) {
         // 8000 - 9FFF : 8 KiB of Video RAM
         // TODO: Replace this with video subsystem
-        return m_memory[address];
+        return m_vram[address - 0x8000];
     } else if (address <= 0xBFFF) {
         // A000 - BFFF : 8 KiB of External RAM (Cartridge RAM)
         // TODO: Replace this with cartridge subsystem
@@ -34,40 +42,28 @@ uint8_t MMU::read_byte(const uint16_t address) const {
         return 0x00;
     } else if (address <= 0xDFFF) {
         // C000 - DFFF : 8 KiB of Work RAM
-        return m_memory[address];
+        return m_wram[address - 0xC000];
     } else if (address <= 0xFDFF) {
         // E000 - FDFF : Echo RAM
-        return m_memory[address - 0x2000];
+        return m_wram[address - 0xE000];
     } else if (address <= 0xFE9F) {
         // FE00 - FE9F : OAM (Sprite attribute table)
         // TODO: Donno what to do with this? Probably with video subsystem. also DMA?
-        return m_memory[address];
+        return m_oam[address - 0xFE00];
     } else if (address <= 0xFEFF) {
         // FEA0 - FEFF : Not usable
         // TODO: Log an error/warning, not usable range
         return 0x00;
     } else if (address <= 0xFF7F) {
         // FF00 - FF7F : I/O registers
-        // TODO: Everything ! ! !
-
-        // Timer I/O Register Writes
-        if (address >= 0xFF04 && address <= 0xFF07)
-            return (*m_timer)[address];
-
-        // Interrupt request register
-        if (address == 0xFF0F)
-            return m_cpu->interrupt_controller()[address];
-
-        // Video subsystem
-        if (address >= 0xFF40 && address <= 0xFF4B) {
-            if (address == 0xFF46) return m_memory[address];
-            return (*m_video)[address];
-        }
-
-        return m_memory[address];
+        if (!m_mmio_timed) return read_io(address);
+        const auto start = std::chrono::steady_clock::now();
+        const uint8_t value = read_io(address);
+        m_perf->mmio_ns += perf_sample_ns(start, std::chrono::steady_clock::now());
+        return value;
     } else if (address <= 0xfffe) {
         // FF80 - FFFE : High RAM
-        return m_memory[address];
+        return m_hram[address - 0xFF80];
     } else {
         // FFFF : Interrupt Enable register
         return m_cpu->interrupt_controller()[address];
@@ -85,7 +81,8 @@ void MMU::write_byte(uint16_t address, uint8_t value) {
     } else if (address <= 0x9FFF) {
         // 8000 - 9FFF : 8 KiB of Video RAM
         // TODO: Replace this with video subsystem
-        m_memory[address] = value;
+        m_vram[address - 0x8000] = value;
+        m_video->log_write(address, value);
         return;
     } else if (address <= 0xBFFF) {
         // A000 - BFFF : 8 KiB of External RAM (Cartridge RAM)
@@ -94,15 +91,17 @@ void MMU::write_byte(uint16_t address, uint8_t value) {
         return;
     } else if (address <= 0xDFFF) {
         // C000 - DFFF : 8 KiB of Work RAM
-        m_memory[address] = value;
+        m_wram[address - 0xC000] = value;
         return;
     } else if (address <= 0xFDFF) {
         // E000 - FDFF : Echo RAM
-        m_memory[address - 0x2000] = value;
+        m_wram[address - 0xE000] = value;
         return;
     } else if (address <= 0xFE9F) {
         // FE00 - FE9F : OAM (Sprite attribute table)
         // TODO: Donno what to do with this? Probably with video subsystem. also DMA?
+        m_oam[address - 0xFE00] = value;
+        m_video->log_write(address, value);
         return;
     } else if (address <= 0xFEFF) {
         // FEA0 - FEFF : Not usable
@@ -110,65 +109,111 @@ void MMU::write_byte(uint16_t address, uint8_t value) {
         return;
     } else if (address <= 0xFF7F) {
         // FF00 - FF7F : I/O registers
-        // TODO: Everything ! ! !
-
-        // Serial out
-        if (address == 0xFF01) {
-            std::cout << value;
+        if (!m_mmio_timed) {
+            write_io(address, value);
             return;
         }
+        const auto start = std::chrono::steady_clock::now();
+        write_io(address, value);
+        m_perf->mmio_ns += perf_sample_ns(start, std::chrono::steady_clock::now());
+        return;
+    } else if (address <= 0xfffe) {
+        // FF80 - FFFE : High RAM
+        m_hram[address - 0xFF80] = value;
+        return;
+    } else {
+        // FFFF : Interrupt Enable register
+        m_cpu->interrupt_controller()[address] = value;
+        return;
+    }
+    assert(!"unreachable code : write_byte(uint16_t, uint8_t)");
+}
 
-        // Timer I/O Register Writes
-        if (address == 0xFF04) {
-            m_timer->reset_divider_register();
-            return;
-        }
+uint8_t MMU::read_io(uint16_t address) const {
+    // TODO: Everything ! ! !
 
-        if (address >= 0xFF05 && address <= 0xFF07) {
-            (*m_timer)[address] = value;
-            return;
-        }
+    // Joypad
+    if (address == 0xFF00)
+        return m_joypad ? m_joypad->read() : 0xFF;
 
-        // Interrupt request register
-        if (address == 0xFF0F) {
-            m_cpu->interrupt_controller()[address] = value;
-            return;
-        }
+    // Timer I/O Register Writes
+    if (address >= 0xFF04 && address <= 0xFF07)
+        return (*m_timer)[address];
 
-        // Video subsystem
-        if (address >= 0xFF40 && address <= 0xFF4B) {
-            if (address == 0xFF44) return;
+    // Interrupt request register
+    if (address == 0xFF0F)
+        return m_cpu->interrupt_controller()[address];
 
-            if (address == 0xFF46) {
-                oam_dma_transfer(value);
-                m_memory[address] = value;
-                return;
-            }
+    // Video subsystem
+    if (address >= 0xFF40 && address <= 0xFF4B) {
+        if (address == 0xFF46) return m_io[address - 0xFF00];
+        return (*m_video)[address];
+    }
 
-            (*m_video)[address] = value;
-            return;
-        }
+    return m_io[address - 0xFF00];
+}
 
-        // DMA Transfer register
-        if (address == 0xFF46)
-            oam_dma_transfer(value);
+void MMU::write_io(uint16_t address, uint8_t value) {
+    // TODO: Everything ! ! !
+
+    // Joypad
+    if (address == 0xFF00) {
+        if (m_joypad) m_joypad->write(value);
+        return;
+    }
 
-        // Bootrom mapping register
-        if (address == 0xFF50)
-            m_bootrom_mapped = (value == 0);
+    // Serial out
+    if (address == 0xFF01) {
+        if (m_serial_muted) return;
+        if (m_serial_sink)
+            m_serial_sink->push_back(static_cast<char>(value));
+        else
+            std::cout << value;
+        return;
+    }
 
-        m_memory[address] = value;
+    // Timer I/O Register Writes
+    if (address == 0xFF04) {
+        m_timer->reset_divider_register();
         return;
-    } else if (address <= 0xfffe) {
-        // FF80 - FFFE : High RAM
-        m_memory[address] = value;
+    }
+
+    if (address >= 0xFF05 && address <= 0xFF07) {
+        (*m_timer)[address] = value;
         return;
-    } else {
-        // FFFF : Interrupt Enable register
+    }
+
+    // Interrupt request register
+    if (address == 0xFF0F) {
         m_cpu->interrupt_controller()[address] = value;
         return;
     }
-    assert(!"unreachable code : write_byte(uint16_t, uint8_t)");
+
+    // Video subsystem
+    if (address >= 0xFF40 && address <= 0xFF4B) {
+        if (address == 0xFF44) return;
+
+        if (address == 0xFF46) {
+            oam_dma_transfer(value);
+            m_io[address - 0xFF00] = value;
+            return;
+        }
+
+        (*m_video)[address] = value;
+        m_video->log_write(address, value);
+        return;
+    }
+
+    // DMA Transfer register
+    if (address == 0xFF46)
+        oam_dma_transfer(value);
+
+    // Bootrom mapping register
+    if (address == 0xFF50)
+        m_bootrom_mapped = (value == 0);
+
+    m_io[address - 0xFF00] = value;
+    return;
 }
 
 void MMU::connect_cpu(CPU *cpu) {
@@ -190,3 +235,25 @@ void MMU::connect_video(Video* video) {
 void MMU::connect_cartridge(Cartridge* cartridge) {
     m_cartridge = cartridge;
 }
+
+void MMU::connect_joypad(Joypad* joypad) {
+    m_joypad = joypad;
+}
+
+void MMU::save_state(State& state) const {
+    state.vram = m_vram;
+    state.wram = m_wram;
+    state.oam = m_oam;
+    state.io = m_io;
+    state.hram = m_hram;
+    state.bootrom_mapped = m_bootrom_mapped;
+}
+
+void MMU::load_state(const State& state) {
+    m_vram = state.vram;
+    m_wram = state.wram;
+    m_oam = state.oam;
+    m_io = state.io;
+    m_hram = state.hram;
+    m_bootrom_mapped = state.bootrom_mapped;
+}
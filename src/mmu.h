@@ -4,20 +4,33 @@
 #include <array>
 #include <cstdint>
 #include <memory>
+#include <string>
 #include "cpu/cpu.h"
 #include "timer.h"
 #include "cpu/interrupt_controller.h"
 #include "video/video.h"
 #include "cartridge.h"
+#include "perf_counters.h"
 
 class CPU;
 class Timer;
 class InterruptController;
 class Video;
 
+class Joypad;
+
 class MMU
 {
 public:
+    struct State {
+        std::array<uint8_t, 0x2000> vram;
+        std::array<uint8_t, 0x2000> wram;
+        std::array<uint8_t, 0xA0> oam;
+        std::array<uint8_t, 0x80> io;
+        std::array<uint8_t, 0x7F> hram;
+        bool bootrom_mapped;
+    };
+
     MMU();
 
     uint8_t read_byte(const uint16_t address) const;
@@ -26,10 +39,37 @@ public:
     void connect_timer(Timer* timer);
     void connect_video(Video* video);
     void connect_cartridge(Cartridge* cartridge);
+    void connect_joypad(Joypad* joypad);
     void request_interrupt(InterruptController::InterruptType type);
 
+    // Raw views of VRAM (8000 - 9FFF) and OAM (FE00 - FE9F) for the pixel renderer
+    inline const uint8_t* vram() const { return m_vram.data(); }
+    inline const uint8_t* oam() const { return m_oam.data(); }
+    // Work RAM (C000 - DFFF) and high RAM (FF80 - FFFE), where games keep their variables
+    inline const uint8_t* wram() const { return m_wram.data(); }
+    inline const uint8_t* hram() const { return m_hram.data(); }
+
+    // Drop serial output, used while running frames that will be thrown away
+    inline void set_serial_muted(bool muted) { m_serial_muted = muted; }
+    // Append serial output to `sink` instead of printing it, nullptr goes back to stdout
+    inline void set_serial_capture(std::string* sink) { m_serial_sink = sink; }
+    inline bool is_serial_captured() const { return m_serial_sink != nullptr; }
+
+    // DMA transfers are counted into `perf`, nullptr stops counting
+    inline void set_perf_counters(PerfCounters* perf) { m_perf = perf; }
+    // While set, host time spent in I/O register accesses is added to perf->mmio_ns
+    inline void set_mmio_timed(bool timed) { m_mmio_timed = timed && m_perf; }
+
+    void save_state(State& state) const;
+    void load_state(const State& state);
+
 private:
-    std::array<uint8_t, 0x10000> m_memory;
+    // Only the regions that live inside the Gameboy, ROM and cartridge RAM belong to the cartridge
+    std::array<uint8_t, 0x2000> m_vram;     // 8000 - 9FFF
+    std::array<uint8_t, 0x2000> m_wram;     // C000 - DFFF (E000 - FDFF echoes it)
+    std::array<uint8_t, 0xA0> m_oam;        // FE00 - FE9F
+    std::array<uint8_t, 0x80> m_io;         // FF00 - FF7F, registers no other component owns
+    std::array<uint8_t, 0x7F> m_hram;       // FF80 - FFFE
 
     constexpr static uint8_t m_bootrom[0x100] = {
         0x31, 0xfe, 0xff, 0xaf, 0x21, 0xff, 0x9f, 0x32, 0xcb, 0x7c, 0x20, 0xfb, 0x21, 0x26, 0xff, 0x0e,
@@ -51,12 +91,20 @@ private:
     };
 
     bool m_bootrom_mapped = true;
+    bool m_serial_muted = false;
+    std::string* m_serial_sink = nullptr;
 
     CPU* m_cpu = nullptr;
     Timer* m_timer = nullptr;
     Video* m_video = nullptr;
     Cartridge* m_cartridge = nullptr;
+    Joypad* m_joypad = nullptr;
+
+    PerfCounters* m_perf = nullptr;
+    bool m_mmio_timed = false;
 
+    uint8_t read_io(uint16_t address) const;
+    void write_io(uint16_t address, uint8_t value);
     void oam_dma_transfer(uint16_t start_addr);
 
     friend class Debugger;
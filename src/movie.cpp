@@ -0,0 +1,173 @@
+#include "movie.h"
+#include "savestate.h"
+#include "utility.h"
+#include <array>
+#include <fstream>
+#include <stdexcept>
+
+void Movie::apply_frame(uint32_t frame, Gameboy& gb) const {
+    std::array<Joypad::ScheduledEvent, Joypad::MAX_EVENTS_PER_FRAME> scheduled;
+    int count = 0;
+    for (uint32_t i = event_offsets[frame]; i < event_offsets[frame + 1] && count < Joypad::MAX_EVENTS_PER_FRAME; i++) {
+        const MovieEvent& event = events[i];
+        scheduled[count++] = Joypad::ScheduledEvent {event.cycle, static_cast<Joypad::Button>(event.button), event.pressed != 0};
+    }
+    gb.SetButtons(inputs[frame]);
+    gb.ScheduleFrameInput(scheduled.data(), count);
+}
+
+void Movie::save(const std::string& path) const {
+    MovieHeader header {};
+    header.magic = MOVIE_MAGIC;
+    header.version = MOVIE_VERSION;
+    header.rom_hash = rom_hash;
+    header.frame_count = frames();
+    header.hash_interval = hash_interval;
+    header.initial_state_size = static_cast<uint32_t>(initial_state.size());
+    header.event_count = static_cast<uint32_t>(events.size());
+
+    std::vector<uint8_t> event_counts(frames());
+    for (uint32_t frame = 0; frame < frames(); frame++)
+        event_counts[frame] = static_cast<uint8_t>(event_offsets[frame + 1] - event_offsets[frame]);
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+        throw std::runtime_error("could not open " + path + " for writing");
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(initial_state.data()), initial_state.size());
+    file.write(reinterpret_cast<const char*>(inputs.data()), inputs.size());
+    file.write(reinterpret_cast<const char*>(event_counts.data()), event_counts.size());
+    file.write(reinterpret_cast<const char*>(events.data()), events.size() * sizeof(MovieEvent));
+    file.write(reinterpret_cast<const char*>(state_hashes.data()), state_hashes.size() * sizeof(uint64_t));
+    if (!file)
+        throw std::runtime_error("could not write " + path);
+}
+
+Movie Movie::load(const std::string& path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+        throw std::runtime_error("could not open " + path);
+    const uint64_t file_size = static_cast<uint64_t>(file.tellg());
+    file.seekg(0, std::ios::beg);
+
+    MovieHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != MOVIE_MAGIC)
+        throw std::runtime_error(path + " is not a movie");
+    if (header.version != MOVIE_VERSION)
+        throw std::runtime_error("unsupported movie version " + std::to_string(header.version));
+    if (header.hash_interval == 0)
+        throw std::runtime_error(path + " is corrupted");
+
+    // Check the sizes in the header against the file before allocating any of them
+    const uint64_t hash_count = header.frame_count / header.hash_interval;
+    const uint64_t expected_size = sizeof(header) + static_cast<uint64_t>(header.initial_state_size)
+        + 2 * static_cast<uint64_t>(header.frame_count)
+        + static_cast<uint64_t>(header.event_count) * sizeof(MovieEvent)
+        + hash_count * sizeof(uint64_t);
+    if (expected_size > file_size)
+        throw std::runtime_error(path + " is truncated");
+    if (expected_size < file_size)
+        throw std::runtime_error(path + " is corrupted");
+
+    Movie movie;
+    movie.rom_hash = header.rom_hash;
+    movie.hash_interval = header.hash_interval;
+    movie.initial_state.resize(header.initial_state_size);
+    movie.inputs.resize(header.frame_count);
+    std::vector<uint8_t> event_counts(header.frame_count);
+    movie.events.resize(header.event_count);
+    movie.state_hashes.resize(hash_count);
+    file.read(reinterpret_cast<char*>(movie.initial_state.data()), movie.initial_state.size());
+    file.read(reinterpret_cast<char*>(movie.inputs.data()), movie.inputs.size());
+    file.read(reinterpret_cast<char*>(event_counts.data()), event_counts.size());
+    file.read(reinterpret_cast<char*>(movie.events.data()), movie.events.size() * sizeof(MovieEvent));
+    file.read(reinterpret_cast<char*>(movie.state_hashes.data()), movie.state_hashes.size() * sizeof(uint64_t));
+    if (!file)
+        throw std::runtime_error(path + " is truncated");
+
+    movie.event_offsets.resize(header.frame_count + 1);
+    for (uint32_t frame = 0; frame < header.frame_count; frame++) {
+        if (event_counts[frame] > Joypad::MAX_EVENTS_PER_FRAME)
+            throw std::runtime_error(path + " is corrupted");
+        movie.event_offsets[frame + 1] = movie.event_offsets[frame] + event_counts[frame];
+    }
+    if (movie.event_offsets.back() != header.event_count)
+        throw std::runtime_error(path + " is corrupted");
+    for (const MovieEvent& event : movie.events) {
+        if (event.cycle < 0 || event.button > Joypad::START)
+            throw std::runtime_error(path + " is corrupted");
+    }
+    return movie;
+}
+
+uint64_t hash_state(const Gameboy& gb) {
+    GameboyState state;
+    std::vector<uint8_t> bytes;
+    gb.SaveState(state);
+    serialize_state(state, bytes);
+    return fnv1a_hash(bytes.data(), bytes.size());
+}
+
+MovieRecorder::MovieRecorder(const Gameboy& gb, bool from_power_on, uint32_t hash_interval) {
+    if (hash_interval == 0)
+        throw std::invalid_argument("invalid argument. hash interval must be at least one frame");
+
+    m_movie.rom_hash = gb.GetROMHash();
+    m_movie.hash_interval = hash_interval;
+    if (!from_power_on) {
+        GameboyState state;
+        gb.SaveState(state);
+        serialize_state(state, m_movie.initial_state);
+    }
+}
+
+void MovieRecorder::record_frame(const Gameboy& gb) {
+    m_movie.inputs.push_back(gb.GetFrameStartButtons());
+    for (int i = 0; i < gb.GetFrameEventCount(); i++) {
+        const Joypad::ScheduledEvent& event = gb.GetFrameEvent(i);
+        m_movie.events.push_back(MovieEvent {event.cycle, static_cast<uint8_t>(event.button), event.pressed, 0});
+    }
+    m_movie.event_offsets.push_back(static_cast<uint32_t>(m_movie.events.size()));
+    if (m_movie.inputs.size() % m_movie.hash_interval == 0)
+        m_movie.state_hashes.push_back(hash_state(gb));
+}
+
+void MovieRecorder::truncate(uint32_t frames) {
+    if (frames >= m_movie.frames()) return;
+    m_movie.inputs.resize(frames);
+    m_movie.events.resize(m_movie.event_offsets[frames]);
+    m_movie.event_offsets.resize(frames + 1);
+    m_movie.state_hashes.resize(frames / m_movie.hash_interval);
+}
+
+ReplayResult replay_movie(const Movie& movie, Gameboy& gb) {
+    if (movie.rom_hash != gb.GetROMHash())
+        throw std::invalid_argument("invalid argument. movie was recorded with a different rom");
+
+    if (!movie.initial_state.empty()) {
+        GameboyState state;
+        deserialize_state(movie.initial_state.data(), movie.initial_state.size(), state);
+        gb.LoadState(state);
+    }
+
+    gb.SetRendering(false);
+    gb.SetRunAhead(0);
+    gb.SetRunning(true);
+
+    ReplayResult result;
+    for (uint32_t frame = 0; frame < movie.frames(); frame++) {
+        movie.apply_frame(frame, gb);
+        gb.Update();
+        result.frames++;
+
+        if ((frame + 1) % movie.hash_interval == 0) {
+            size_t index = (frame + 1) / movie.hash_interval - 1;
+            if (index < movie.state_hashes.size() && movie.state_hashes[index] != hash_state(gb)) {
+                result.desynced = true;
+                result.desync_frame = frame;
+                break;
+            }
+        }
+    }
+    return result;
+}
@@ -0,0 +1,96 @@
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "gameboy.h"
+
+// Binary movie layout:
+//   MovieHeader
+//   initial state                  (header.initial_state_size bytes, see savestate.h; 0 = power-on)
+//   inputs                         (header.frame_count bytes, Joypad buttons held at the start of each frame)
+//   event counts                   (header.frame_count bytes, joypad events inside each frame)
+//   events                         (header.event_count MovieEvent, frame by frame)
+//   state hashes                   (header.frame_count / header.hash_interval uint64_t)
+//
+// A frame's input is the buttons it starts with plus every press/release during it at the
+// cycle it happened, so a tap shorter than a frame and the JOYPAD interrupt it raises are
+// replayed too. Replaying the same input from the same state is bit-exact. Every
+// `hash_interval` frames the hash of the whole emulator state is stored, which catches a
+// desync within a second instead of at the end.
+constexpr uint32_t MOVIE_MAGIC = 0x564D4253; // "SBMV"
+constexpr uint32_t MOVIE_VERSION = 2;
+
+struct MovieHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t rom_hash;
+    uint32_t frame_count;
+    uint32_t hash_interval;
+    uint32_t initial_state_size;
+    uint32_t event_count;
+};
+
+// A press/release `cycle` cycles into its frame (see Joypad::ScheduledEvent)
+struct MovieEvent {
+    int32_t cycle;
+    uint8_t button;     // Joypad::Button
+    uint8_t pressed;
+    uint16_t reserved;
+};
+
+struct Movie {
+    uint64_t rom_hash = 0;
+    uint32_t hash_interval = 60;
+    std::vector<uint8_t> initial_state;
+    std::vector<uint8_t> inputs;
+    // Events of frame i are events[event_offsets[i]] up to events[event_offsets[i + 1]]
+    std::vector<uint32_t> event_offsets = {0};
+    std::vector<MovieEvent> events;
+    std::vector<uint64_t> state_hashes;
+
+    inline uint32_t frames() const { return static_cast<uint32_t>(inputs.size()); }
+    // Hands frame `frame`'s input to `gb`, call right before the Update that emulates it
+    void apply_frame(uint32_t frame, Gameboy& gb) const;
+
+    // Throw std::runtime_error on I/O errors or if the file is not a movie
+    void save(const std::string& path) const;
+    static Movie load(const std::string& path);
+};
+
+// Fingerprint of everything in a save state
+uint64_t hash_state(const Gameboy& gb);
+
+class MovieRecorder
+{
+public:
+    // Starts a movie at the current state of `gb`. With `from_power_on` no initial state
+    // is stored and the movie has to be replayed on a freshly loaded Gameboy.
+    MovieRecorder(const Gameboy& gb, bool from_power_on = false, uint32_t hash_interval = 60);
+
+    // Call after every Update. Picks up input from SetButtons before the Update as well as
+    // events placed by Gameboy::ScheduleInput.
+    void record_frame(const Gameboy& gb);
+    // Cuts the movie back to its first `frames` frames, for when the Gameboy has been put
+    // back to the state at the start of that frame (rewind)
+    void truncate(uint32_t frames);
+
+    inline uint32_t frames() const { return m_movie.frames(); }
+    inline const Movie& movie() const { return m_movie; }
+
+private:
+    Movie m_movie;
+};
+
+struct ReplayResult {
+    uint32_t frames = 0;        // frames emulated
+    bool desynced = false;
+    uint32_t desync_frame = 0;  // first frame whose state hash did not match
+};
+
+// Plays `movie` on `gb` as fast as possible with rendering off, stopping at the first
+// desync. Throws std::invalid_argument if `gb` runs a different ROM.
+ReplayResult replay_movie(const Movie& movie, Gameboy& gb);
+
+#endif // MOVIE_H
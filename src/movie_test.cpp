@@ -0,0 +1,207 @@
+#include "gameboy.h"
+#include "movie.h"
+#include "rom_image.h"
+#include "test_util.h"
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <vector>
+// Movies: recording input, replaying it to the same state hashes, and the file format
+
+// Counts JOYPAD interrupts in FF80 and keeps copying P1 into C000
+static std::vector<uint8_t> joypad_program() {
+    return {
+        0x3E, 0x10,         // 0150: ld a, 10
+        0xE0, 0xFF,         //       ldh (IE), a     (JOYPAD only)
+        0xAF,               //       xor a
+        0xE0, 0x00,         //       ldh (P1), a     (select buttons and directions)
+        0xFB,               //       ei
+        0xF0, 0x00,         // 0158: ldh a, (P1)
+        0xEA, 0x00, 0xC0,   //       ld (C000), a
+        0x18, 0xF9,         //       jr 0158
+    };
+}
+
+static std::vector<uint8_t> joypad_handler() {
+    std::vector<uint8_t> handlers(0x68, 0x00);
+    const uint8_t handler[] = {
+        0xF5,               // 0060: push af
+        0xF0, 0x80,         //       ldh a, (80)
+        0x3C,               //       inc a
+        0xE0, 0x80,         //       ldh (80), a
+        0xF1,               //       pop af
+        0xD9,               //       reti
+    };
+    std::copy(handler, handler + sizeof(handler), handlers.begin() + 0x60);
+    return handlers;
+}
+
+static constexpr int RECORDED_FRAMES = 120;
+static constexpr int TRUNCATED_FRAMES = 60;
+
+struct Recording {
+    Movie movie;
+    uint64_t final_hash;
+    uint64_t truncated_hash;    // state after TRUNCATED_FRAMES frames
+    Movie truncated;
+};
+
+// Mixes SetButtons between frames with taps that start and end inside a single frame
+static Recording record(const std::shared_ptr<const RomImage>& rom) {
+    Gameboy gb;
+    gb.LoadROM(rom);
+    gb.SetRunning(true);
+    for (int i = 0; i < BOOT_FRAMES; i++) gb.Update();
+
+    Recording recording;
+    MovieRecorder recorder(gb, false, 5);
+    const uint64_t joypad_interrupts = gb.GetPerfCounters().interrupts[InterruptController::JOYPAD];
+    std::mt19937 rng(7);
+    uint64_t now_ns = 1000000;
+    constexpr uint64_t FRAME_NS = 16742706;
+    for (int frame = 0; frame < RECORDED_FRAMES; frame++) {
+        if (frame % 3 == 0) {
+            gb.SetButtons(static_cast<uint8_t>(rng() & 0xF0));
+        } else {
+            const Joypad::Button button = static_cast<Joypad::Button>(rng() % 8);
+            gb.PushInputEvent(Joypad::InputEvent {now_ns + FRAME_NS / 4, button, true});
+            gb.PushInputEvent(Joypad::InputEvent {now_ns + FRAME_NS / 2, button, false});
+        }
+        gb.ScheduleInput(now_ns, now_ns + FRAME_NS);
+        now_ns += FRAME_NS;
+
+        gb.Update();
+        recorder.record_frame(gb);
+        CHECK(gb.GetFrameEventCount() == (frame % 3 == 0 ? 0 : 2));
+        if (frame + 1 == TRUNCATED_FRAMES)
+            recording.truncated_hash = hash_state(gb);
+    }
+    // Taps that are over by the end of their frame still raised JOYPAD
+    CHECK(gb.GetPerfCounters().interrupts[InterruptController::JOYPAD] - joypad_interrupts > 20);
+    CHECK(recorder.movie().events.size() == 2 * (RECORDED_FRAMES - RECORDED_FRAMES / 3));
+
+    recording.movie = recorder.movie();
+    recording.final_hash = hash_state(gb);
+    recorder.truncate(TRUNCATED_FRAMES);
+    recording.truncated = recorder.movie();
+    return recording;
+}
+
+static void test_replay(const std::shared_ptr<const RomImage>& rom, const Recording& recording) {
+    const std::string path = "movie_test.sbm";
+    recording.movie.save(path);
+    const Movie loaded = Movie::load(path);
+    std::remove(path.c_str());
+    CHECK(loaded.frames() == RECORDED_FRAMES);
+    CHECK(loaded.events.size() == recording.movie.events.size());
+    CHECK(loaded.event_offsets == recording.movie.event_offsets);
+    CHECK(loaded.state_hashes == recording.movie.state_hashes);
+
+    Gameboy gb;
+    gb.LoadROM(rom);
+    const ReplayResult result = replay_movie(loaded, gb);
+    CHECK(!result.desynced);
+    CHECK(result.frames == RECORDED_FRAMES);
+    CHECK(hash_state(gb) == recording.final_hash);
+
+    Gameboy truncated;
+    truncated.LoadROM(rom);
+    CHECK(recording.truncated.frames() == TRUNCATED_FRAMES);
+    CHECK(recording.truncated.state_hashes.size() == TRUNCATED_FRAMES / 5);
+    const ReplayResult truncated_result = replay_movie(recording.truncated, truncated);
+    CHECK(!truncated_result.desynced);
+    CHECK(hash_state(truncated) == recording.truncated_hash);
+
+    // Dropping the events brings the recorded hashes out of step
+    Movie buttons_only = recording.movie;
+    buttons_only.events.clear();
+    buttons_only.event_offsets.assign(buttons_only.frames() + 1, 0);
+    Gameboy desynced;
+    desynced.LoadROM(rom);
+    CHECK(replay_movie(buttons_only, desynced).desynced);
+
+    Gameboy other;
+    other.LoadROM(RomImage::from_bytes(make_test_rom({0x18, 0xFE})));
+    CHECK_THROWS(replay_movie(loaded, other), std::invalid_argument);
+}
+
+// Press A while running, pause, release A, resume: the release still gets applied
+static void test_paused_input(const std::shared_ptr<const RomImage>& rom) {
+    Gameboy gb;
+    gb.LoadROM(rom);
+    gb.SetRunning(true);
+    constexpr uint64_t FRAME_NS = 16742706;
+    uint64_t now_ns = 1000000;
+    auto frame = [&] {
+        gb.ScheduleInput(now_ns, now_ns + FRAME_NS);
+        now_ns += FRAME_NS;
+        gb.Update();
+    };
+
+    gb.PushInputEvent(Joypad::InputEvent {now_ns + FRAME_NS / 2, Joypad::A, true});
+    frame();
+    CHECK(gb.GetButtons() == (1 << Joypad::A));
+
+    gb.SetRunning(false);
+    gb.PushInputEvent(Joypad::InputEvent {now_ns + FRAME_NS / 2, Joypad::A, false});
+    for (int i = 0; i < 3; i++) frame();
+    CHECK(gb.GetButtons() == (1 << Joypad::A));
+
+    gb.SetRunning(true);
+    frame();
+    CHECK(gb.GetButtons() == 0);
+    CHECK(gb.GetFrameEventCount() == 1);
+}
+
+static void write_file(const std::string& path, const std::vector<char>& bytes) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(bytes.data(), bytes.size());
+}
+
+static void test_load_errors(const Recording& recording) {
+    const std::string path = "movie_test_damaged.sbm";
+    recording.movie.save(path);
+    std::vector<char> bytes;
+    {
+        std::ifstream file(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    std::vector<char> damaged(bytes.begin(), bytes.end() - 1);
+    write_file(path, damaged);
+    CHECK_THROWS(Movie::load(path), std::runtime_error);
+
+    damaged = bytes;
+    damaged.push_back(0);
+    write_file(path, damaged);
+    CHECK_THROWS(Movie::load(path), std::runtime_error);
+
+    // A frame count far past the end of the file is refused before anything is allocated
+    damaged = bytes;
+    MovieHeader header;
+    std::copy(damaged.begin(), damaged.begin() + sizeof(header), reinterpret_cast<char*>(&header));
+    header.frame_count = 0xFFFFFFF0;
+    std::copy(reinterpret_cast<const char*>(&header), reinterpret_cast<const char*>(&header) + sizeof(header), damaged.begin());
+    write_file(path, damaged);
+    CHECK_THROWS(Movie::load(path), std::runtime_error);
+
+    // Event counts that don't add up to the header's
+    damaged = bytes;
+    std::copy(bytes.begin(), bytes.begin() + sizeof(header), reinterpret_cast<char*>(&header));
+    damaged[sizeof(header) + header.initial_state_size + header.frame_count] ^= 1;
+    write_file(path, damaged);
+    CHECK_THROWS(Movie::load(path), std::runtime_error);
+
+    std::remove(path.c_str());
+    CHECK_THROWS(Movie::load("movie_test_missing.sbm"), std::runtime_error);
+}
+
+int main() {
+    const auto rom = RomImage::from_bytes(make_test_rom(joypad_program(), joypad_handler()));
+    const Recording recording = record(rom);
+    test_replay(rom, recording);
+    test_load_errors(recording);
+    test_paused_input(rom);
+    return test_result("movie_test");
+}
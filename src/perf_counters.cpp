@@ -0,0 +1,50 @@
+#include "perf_counters.h"
+#include <algorithm>
+#include <cmath>
+
+// Median of a few hundred back-to-back clock reads, measured once
+static int64_t clock_overhead_ns() {
+    static const int64_t overhead = [] {
+        std::array<int64_t, 255> reads;
+        for (int64_t& read : reads) {
+            const auto a = std::chrono::steady_clock::now();
+            const auto b = std::chrono::steady_clock::now();
+            read = std::chrono::duration_cast<std::chrono::nanoseconds>(b - a).count();
+        }
+        std::nth_element(reads.begin(), reads.begin() + reads.size() / 2, reads.end());
+        return reads[reads.size() / 2];
+    }();
+    return overhead;
+}
+
+uint64_t perf_sample_ns(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+    const int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() - clock_overhead_ns();
+    return ns > 0 ? ns * PERF_SAMPLE_INSTRUCTIONS : 0;
+}
+
+void PerfHistory::record(const PerfFrameSample& sample) {
+    m_samples[m_next] = sample;
+    m_next = (m_next + 1) % SIZE;
+    if (m_count < SIZE) m_count++;
+}
+
+std::array<uint32_t, PerfHistory::BUCKETS> PerfHistory::histogram() const {
+    std::array<uint32_t, BUCKETS> buckets = {};
+    for (size_t i = 0; i < m_count; i++) {
+        const uint32_t us = (*this)[i].host_ns / 1000;
+        size_t bucket = 0;
+        while (us >= BUCKET_LIMITS_US[bucket] && bucket < BUCKETS - 1) bucket++;
+        buckets[bucket]++;
+    }
+    return buckets;
+}
+
+uint32_t PerfHistory::host_ns_percentile(double p) const {
+    if (m_count == 0) return 0;
+
+    std::array<uint32_t, SIZE> sorted;
+    for (size_t i = 0; i < m_count; i++) sorted[i] = (*this)[i].host_ns;
+    std::sort(sorted.begin(), sorted.begin() + m_count);
+    size_t rank = static_cast<size_t>(std::ceil(p * m_count));
+    return sorted[std::min(m_count - 1, rank > 0 ? rank - 1 : 0)];
+}
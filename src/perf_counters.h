@@ -0,0 +1,77 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Running totals since the Gameboy was created, written by the thread that runs it.
+// Always on: the event counts are single increments on paths that are rare anyway
+// (interrupts, DMA, bank switches) and the rest is summed once per frame.
+// Run-ahead frames are rolled back, so they only show up in frames_speculative.
+struct PerfCounters {
+    uint64_t instructions = 0;
+    uint64_t cycles = 0;
+    uint64_t frames_rendered = 0;
+    uint64_t frames_skipped = 0;                // emulated with the pixel work turned off
+    uint64_t frames_speculative = 0;            // run-ahead frames, emulated and rolled back
+    std::array<uint64_t, 5> interrupts = {};    // serviced, by InterruptController::InterruptType
+    uint64_t dma_transfers = 0;
+    uint64_t bank_switches = 0;                 // MBC writes that changed the mapped ROM/RAM bank
+
+    // Host time per subsystem. Timing every instruction would cost more than the work it
+    // measures, so only every PERF_SAMPLE_INSTRUCTIONS-th instruction of every
+    // PERF_SAMPLE_FRAMES-th frame is timed and scaled up. Divide by sampled_frames for
+    // a per-frame estimate. mmio_ns is the part of cpu_ns spent in I/O register accesses.
+    // Timing lone instructions disturbs them, so trust the ratios more than the totals.
+    uint64_t sampled_frames = 0;
+    uint64_t cpu_ns = 0;
+    uint64_t ppu_ns = 0;
+    uint64_t timer_ns = 0;
+    uint64_t mmio_ns = 0;
+
+    inline uint64_t frames() const { return frames_rendered + frames_skipped; }
+};
+
+constexpr uint32_t PERF_SAMPLE_FRAMES = 16;
+constexpr uint32_t PERF_SAMPLE_INSTRUCTIONS = 64;
+
+// Host ns from `start` to `end`, less what reading the clock costs, scaled up by
+// PERF_SAMPLE_INSTRUCTIONS. The spans are only tens of ns, the clock would otherwise
+// be most of what gets measured.
+uint64_t perf_sample_ns(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+struct PerfFrameSample {
+    uint32_t host_ns = 0;       // wall time of the frame, run-ahead included
+    uint32_t instructions = 0;
+    uint32_t cycles = 0;
+    bool rendered = false;
+};
+
+// The last SIZE frames, oldest first, and a frame time histogram over them
+class PerfHistory
+{
+public:
+    static constexpr size_t SIZE = 256;
+    // Upper bounds of the histogram buckets in microseconds, the last one takes the rest.
+    // 16742 us is one frame of real time.
+    static constexpr size_t BUCKETS = 8;
+    static constexpr std::array<uint32_t, BUCKETS> BUCKET_LIMITS_US = {125, 250, 500, 1000, 2000, 4000, 16742, UINT32_MAX};
+
+    void record(const PerfFrameSample& sample);
+
+    inline size_t size() const { return m_count; }
+    inline const PerfFrameSample& operator[](size_t i) const { return m_samples[(m_next + SIZE - m_count + i) % SIZE]; }
+
+    std::array<uint32_t, BUCKETS> histogram() const;
+    // Nearest-rank percentile of the frame times, 0 while empty
+    uint32_t host_ns_percentile(double p) const;
+
+private:
+    std::array<PerfFrameSample, SIZE> m_samples = {};
+    size_t m_next = 0;
+    size_t m_count = 0;
+};
+
+#endif // PERF_COUNTERS_H
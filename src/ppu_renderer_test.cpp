@@ -0,0 +1,170 @@
+#include "video/ppu_renderer.h"
+#include "test_util.h"
+#include <array>
+#include <cstdint>
+// Scanline rendering: sprite priority, size, flips and the background layer they sit on
+
+// Tiles, 16 bytes each at 8000 + 16 * index
+static constexpr uint8_t TILE_BG = 0;       // row 0: pixels 0-3 colour 1, 4-7 colour 0
+static constexpr uint8_t TILE_SOLID = 1;    // colour 3 everywhere
+static constexpr uint8_t TILE_CORNER = 2;   // only pixel (0, 0), colour 1
+static constexpr uint8_t TILE_UPPER = 4;    // colour 1 everywhere, the top of an 8x16 pair
+static constexpr uint8_t TILE_LOWER = 5;    // colour 2 everywhere, the bottom of an 8x16 pair
+
+struct Scene {
+    std::array<uint8_t, 0x2000> vram {};
+    std::array<uint8_t, 0xA0> oam {};
+    PPURegisters regs;
+    Framebuffer framebuffer;
+
+    Scene() {
+        set_row(TILE_BG, 0, 0xF0, 0x00);
+        for (int row = 0; row < 8; row++) {
+            set_row(TILE_SOLID, row, 0xFF, 0xFF);
+            set_row(TILE_UPPER, row, 0xFF, 0x00);
+            set_row(TILE_LOWER, row, 0x00, 0xFF);
+        }
+        set_row(TILE_CORNER, 0, 0x80, 0x00);
+        // The tile map at 9800 is all zeros, every background tile is TILE_BG
+        regs.lcd_control = PPURenderer::LCD_CTRL_ENABLE | PPURenderer::LCD_CTRL_BG_WIN_TILE_DATA_SELECT |
+                           PPURenderer::LCD_CTRL_OBJ_EN | PPURenderer::LCD_CTRL_BG_EN;
+        regs.bg_pallet = 0xE4;      // colour n is shade n
+        regs.obj_pallet0 = 0xE4;
+        regs.obj_pallet1 = 0x1B;    // reversed
+        // Stands in for the frame a recycled back buffer still holds
+        for (int y = 0; y < Framebuffer::HEIGHT; y++)
+            for (int x = 0; x < Framebuffer::WIDTH; x++)
+                framebuffer.set_pixel(x, y, FB_COLOR::FB_DARK_GRAY);
+    }
+
+    void set_row(uint8_t tile, int row, uint8_t low, uint8_t high) {
+        vram[tile * 16 + row * 2] = low;
+        vram[tile * 16 + row * 2 + 1] = high;
+    }
+
+    // OAM coordinates: screen position + (8, 16)
+    void sprite(int index, int x, int y, uint8_t tile, uint8_t attributes = 0) {
+        oam[index * 4] = y + 16;
+        oam[index * 4 + 1] = x + 8;
+        oam[index * 4 + 2] = tile;
+        oam[index * 4 + 3] = attributes;
+    }
+
+    FB_COLOR draw(int x, int ly) {
+        regs.ly = ly;
+        PPURenderer::draw_scanline(vram.data(), oam.data(), regs, framebuffer);
+        return pixel(x, ly);
+    }
+
+    FB_COLOR pixel(int x, int y) const {
+        return static_cast<FB_COLOR>(framebuffer.get_buffer_ptr()[x + y * Framebuffer::WIDTH]);
+    }
+};
+
+static constexpr uint8_t ATTR_BEHIND_BG = (1 << 7);
+static constexpr uint8_t ATTR_Y_FLIP = (1 << 6);
+static constexpr uint8_t ATTR_X_FLIP = (1 << 5);
+static constexpr uint8_t ATTR_PALLET1 = (1 << 4);
+
+// Every sprite starts off screen (y = 0 in OAM)
+static void test_background_off() {
+    Scene scene;
+    scene.regs.lcd_control &= ~PPURenderer::LCD_CTRL_BG_EN;
+    scene.sprite(0, 20, 0, TILE_SOLID);
+    scene.draw(0, 0);
+    for (int x = 0; x < Framebuffer::WIDTH; x++) {
+        if (x >= 20 && x < 28) CHECK(scene.pixel(x, 0) == FB_COLOR::FB_BLACK);
+        else CHECK(scene.pixel(x, 0) == FB_COLOR::FB_WHITE);
+    }
+    // Other lines are left alone
+    CHECK(scene.pixel(0, 1) == FB_COLOR::FB_DARK_GRAY);
+}
+
+static void test_flips() {
+    Scene scene;
+    scene.regs.lcd_control &= ~PPURenderer::LCD_CTRL_BG_EN;
+    scene.sprite(0, 0, 0, TILE_CORNER);
+    scene.sprite(1, 10, 0, TILE_CORNER, ATTR_X_FLIP);
+    scene.sprite(2, 20, 0, TILE_CORNER, ATTR_Y_FLIP);
+    scene.sprite(3, 30, 0, TILE_CORNER, ATTR_X_FLIP | ATTR_Y_FLIP);
+    scene.draw(0, 0);
+    scene.draw(0, 7);
+    CHECK(scene.pixel(0, 0) == FB_COLOR::FB_LIGHT_GRAY);
+    CHECK(scene.pixel(7, 0) == FB_COLOR::FB_WHITE);
+    CHECK(scene.pixel(17, 0) == FB_COLOR::FB_LIGHT_GRAY);
+    CHECK(scene.pixel(10, 0) == FB_COLOR::FB_WHITE);
+    CHECK(scene.pixel(20, 0) == FB_COLOR::FB_WHITE);
+    CHECK(scene.pixel(20, 7) == FB_COLOR::FB_LIGHT_GRAY);
+    CHECK(scene.pixel(37, 7) == FB_COLOR::FB_LIGHT_GRAY);
+    CHECK(scene.pixel(30, 7) == FB_COLOR::FB_WHITE);
+}
+
+static void test_tall_sprites() {
+    Scene scene;
+    scene.regs.lcd_control |= PPURenderer::LCD_CTRL_OBJ_SIZE;
+    // The low bit of the tile number is ignored, the pair is TILE_UPPER, TILE_LOWER
+    scene.sprite(0, 40, 10, TILE_LOWER);
+    scene.sprite(1, 60, 10, TILE_UPPER, ATTR_Y_FLIP | ATTR_PALLET1);
+    CHECK(scene.draw(40, 8) == FB_COLOR::FB_LIGHT_GRAY);  // background colour 1
+    CHECK(scene.draw(44, 10) == FB_COLOR::FB_LIGHT_GRAY);
+    CHECK(scene.draw(44, 17) == FB_COLOR::FB_LIGHT_GRAY);
+    CHECK(scene.draw(44, 18) == FB_COLOR::FB_DARK_GRAY);
+    CHECK(scene.draw(44, 25) == FB_COLOR::FB_DARK_GRAY);
+    CHECK(scene.draw(44, 26) == FB_COLOR::FB_WHITE);      // background colour 0
+    // Flipped as a whole, through the reversed pallet
+    CHECK(scene.draw(64, 10) == FB_COLOR::FB_LIGHT_GRAY);
+    CHECK(scene.draw(64, 25) == FB_COLOR::FB_DARK_GRAY);
+}
+
+static void test_priority() {
+    Scene scene;
+    scene.regs.lcd_control &= ~PPURenderer::LCD_CTRL_BG_EN;
+    // Lower x wins over lower OAM index
+    scene.sprite(0, 14, 0, TILE_UPPER);
+    scene.sprite(1, 10, 0, TILE_SOLID);
+    // Same x, lower OAM index wins
+    scene.sprite(2, 40, 0, TILE_LOWER);
+    scene.sprite(3, 40, 0, TILE_SOLID);
+    scene.draw(0, 0);
+    CHECK(scene.pixel(10, 0) == FB_COLOR::FB_BLACK);
+    CHECK(scene.pixel(17, 0) == FB_COLOR::FB_BLACK);
+    CHECK(scene.pixel(18, 0) == FB_COLOR::FB_LIGHT_GRAY);
+    CHECK(scene.pixel(40, 0) == FB_COLOR::FB_DARK_GRAY);
+
+    // Only the first 10 sprites in OAM order that cover the line are drawn
+    Scene crowded;
+    crowded.regs.lcd_control &= ~PPURenderer::LCD_CTRL_BG_EN;
+    for (int i = 0; i < 11; i++)
+        crowded.sprite(i, 150 - i * 10, 0, TILE_SOLID);
+    crowded.sprite(11, 0, 8, TILE_SOLID);
+    crowded.draw(0, 0);
+    CHECK(crowded.pixel(60, 0) == FB_COLOR::FB_BLACK);
+    CHECK(crowded.pixel(50, 0) == FB_COLOR::FB_WHITE);
+    CHECK(crowded.draw(0, 8) == FB_COLOR::FB_BLACK);
+}
+
+static void test_behind_background() {
+    Scene scene;
+    scene.sprite(0, 0, 0, TILE_SOLID, ATTR_BEHIND_BG);
+    scene.sprite(1, 8, 0, TILE_SOLID);
+    scene.draw(0, 0);
+    // Behind: only shows where the background has colour 0
+    CHECK(scene.pixel(3, 0) == FB_COLOR::FB_LIGHT_GRAY);
+    CHECK(scene.pixel(4, 0) == FB_COLOR::FB_BLACK);
+    CHECK(scene.pixel(8, 0) == FB_COLOR::FB_BLACK);
+    CHECK(scene.pixel(16, 0) == FB_COLOR::FB_LIGHT_GRAY);
+
+    // Sprites off, the background alone
+    scene.regs.lcd_control &= ~PPURenderer::LCD_CTRL_OBJ_EN;
+    CHECK(scene.draw(8, 0) == FB_COLOR::FB_LIGHT_GRAY);
+    CHECK(scene.pixel(12, 0) == FB_COLOR::FB_WHITE);
+}
+
+int main() {
+    test_background_off();
+    test_flips();
+    test_tall_sprites();
+    test_priority();
+    test_behind_background();
+    return test_result("ppu_renderer_test");
+}
@@ -0,0 +1,207 @@
+#include "rewind.h"
+#include "savestate.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+static uint8_t* put_varint(uint8_t* dst, size_t value) {
+    while (value >= 0x80) {
+        *dst++ = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    *dst++ = static_cast<uint8_t>(value);
+    return dst;
+}
+
+static const uint8_t* get_varint(const uint8_t* src, const uint8_t* end, size_t& value) {
+    value = 0;
+    int shift = 0;
+    while (src < end) {
+        uint8_t byte = *src++;
+        value |= static_cast<size_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) return src;
+        shift += 7;
+    }
+    throw std::runtime_error("rewind buffer is corrupted");
+}
+
+size_t rle_compress(const uint8_t* src, size_t size, uint8_t* dst) {
+    // Short zero gaps inside literals are cheaper to copy than to encode as a new token
+    constexpr size_t MIN_ZERO_RUN = 4;
+
+    uint8_t* out = dst;
+    size_t i = 0;
+    while (i < size) {
+        size_t zeros = 0;
+        while (i + zeros < size && src[i + zeros] == 0) zeros++;
+        i += zeros;
+
+        size_t literal_start = i;
+        size_t literal_end = i;
+        while (literal_end < size) {
+            if (src[literal_end] != 0) {
+                literal_end++;
+                continue;
+            }
+            size_t run = 0;
+            while (literal_end + run < size && src[literal_end + run] == 0 && run < MIN_ZERO_RUN) run++;
+            if (run >= MIN_ZERO_RUN || literal_end + run == size) break;
+            literal_end += run;
+        }
+
+        out = put_varint(out, zeros);
+        out = put_varint(out, literal_end - literal_start);
+        std::memcpy(out, src + literal_start, literal_end - literal_start);
+        out += literal_end - literal_start;
+        i = literal_end;
+    }
+    return out - dst;
+}
+
+void rle_decompress(const uint8_t* src, size_t size, uint8_t* dst, size_t dst_size) {
+    const uint8_t* end = src + size;
+    size_t pos = 0;
+    while (src < end) {
+        size_t zeros, literals;
+        src = get_varint(src, end, zeros);
+        src = get_varint(src, end, literals);
+        if (pos + zeros + literals > dst_size || literals > static_cast<size_t>(end - src))
+            throw std::runtime_error("rewind buffer is corrupted");
+        std::memset(dst + pos, 0, zeros);
+        pos += zeros;
+        std::memcpy(dst + pos, src, literals);
+        pos += literals;
+        src += literals;
+    }
+    std::memset(dst + pos, 0, dst_size - pos);
+}
+
+RewindBuffer::RewindBuffer(size_t capacity_bytes, int keyframe_interval)
+    : m_arena(capacity_bytes), m_keyframe_interval(std::max(keyframe_interval, 1)) {
+    // A delta is never smaller than a few bytes, this is plenty of entries for any capacity
+    m_entries.resize(capacity_bytes / 16 + 1);
+}
+
+void RewindBuffer::clear() {
+    m_first = 0;
+    m_count = 0;
+    m_bytes_used = 0;
+    m_frames_since_keyframe = 0;
+    m_keyframe_id = UINT64_MAX;
+}
+
+void RewindBuffer::drop_oldest_group() {
+    // A keyframe and all the deltas after it go together
+    do {
+        m_bytes_used -= entry(0).size;
+        m_first = (m_first + 1) % m_entries.size();
+        m_count--;
+    } while (m_count > 0 && !entry(0).keyframe);
+}
+
+size_t RewindBuffer::reserve(size_t size) {
+    if (size > m_arena.size())
+        throw std::length_error("rewind buffer is smaller than a single snapshot");
+
+    // Entries are laid out in push order; wrap to the start when the tail does not fit
+    size_t offset = 0;
+    if (m_count > 0) {
+        const Entry& newest = entry(m_count - 1);
+        offset = newest.offset + newest.size;
+        if (offset + size > m_arena.size()) {
+            // Everything past the newest entry is left over from the previous pass and older
+            // than what sits at the start, so it has to go before anything there can
+            const size_t newest_end = offset;
+            offset = 0;
+            while (m_count > 0 && entry(0).offset >= newest_end)
+                drop_oldest_group();
+        }
+    }
+
+    // Evict whatever still lives in [offset, offset + size), and make room in the entry ring
+    while (m_count > 0) {
+        const Entry& oldest = entry(0);
+        bool overlaps = oldest.offset < offset + size && offset < oldest.offset + oldest.size;
+        if (!overlaps && m_count < m_entries.size()) break;
+        drop_oldest_group();
+    }
+    return offset;
+}
+
+void RewindBuffer::push(const Gameboy& gb) {
+    gb.SaveState(m_state);
+    serialize_state(m_state, m_serialized);
+
+    const bool keyframe = m_keyframe_id == UINT64_MAX
+        || m_frames_since_keyframe >= m_keyframe_interval
+        || m_keyframe.size() != m_serialized.size();
+
+    if (keyframe) {
+        m_keyframe.assign(m_serialized.begin(), m_serialized.end());
+        m_keyframe_id = m_next_keyframe_id++;
+        m_frames_since_keyframe = 0;
+    } else {
+        for (size_t i = 0; i < m_serialized.size(); i++)
+            m_serialized[i] ^= m_keyframe[i];
+        m_frames_since_keyframe++;
+    }
+
+    m_compressed.resize(rle_bound(m_serialized.size()));
+    size_t size = rle_compress(m_serialized.data(), m_serialized.size(), m_compressed.data());
+
+    // Dropping the oldest group may take the current keyframe with it, start a new group then
+    size_t offset = reserve(size);
+    if (!keyframe && (m_count == 0 || entry(0).keyframe_id > m_keyframe_id)) {
+        m_keyframe_id = UINT64_MAX;
+        push(gb);
+        return;
+    }
+
+    std::memcpy(m_arena.data() + offset, m_compressed.data(), size);
+    m_entries[(m_first + m_count) % m_entries.size()] = Entry {offset, size, keyframe, m_keyframe_id};
+    m_count++;
+    m_bytes_used += size;
+}
+
+void RewindBuffer::load_keyframe(size_t index) {
+    const Entry& newest = entry(index);
+    if (m_keyframe_id == newest.keyframe_id) return;
+
+    size_t i = index;
+    while (!entry(i).keyframe) i--;
+    const Entry& key = entry(i);
+    rle_decompress(m_arena.data() + key.offset, key.size, m_keyframe.data(), m_keyframe.size());
+    m_keyframe_id = key.keyframe_id;
+}
+
+bool RewindBuffer::pop(Gameboy& gb) {
+    if (m_count == 0) return false;
+
+    const Entry newest = entry(m_count - 1);
+    m_serialized.resize(m_keyframe.size());
+    if (newest.keyframe) {
+        rle_decompress(m_arena.data() + newest.offset, newest.size, m_serialized.data(), m_serialized.size());
+    } else {
+        load_keyframe(m_count - 1);
+        rle_decompress(m_arena.data() + newest.offset, newest.size, m_serialized.data(), m_serialized.size());
+        for (size_t i = 0; i < m_serialized.size(); i++)
+            m_serialized[i] ^= m_keyframe[i];
+    }
+
+    m_count--;
+    m_bytes_used -= newest.size;
+
+    // New pushes continue from the restored frame
+    if (m_count == 0) {
+        m_keyframe_id = UINT64_MAX;
+    } else {
+        load_keyframe(m_count - 1);
+        m_frames_since_keyframe = 0;
+        for (size_t i = m_count; i-- > 0 && !entry(i).keyframe;)
+            m_frames_since_keyframe++;
+    }
+
+    deserialize_state(m_serialized.data(), m_serialized.size(), m_state);
+    gb.LoadState(m_state);
+    return true;
+}
@@ -0,0 +1,68 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "gameboy.h"
+
+// Keeps a snapshot of every frame in a fixed-size byte ring so gameplay can be run backwards.
+// Every `keyframe_interval` frames a full (run-length compressed) save state is stored; the
+// frames in between are XORed against their keyframe first, which leaves only a few hundred
+// non-zero bytes that compress down to almost nothing. When the ring is full, the oldest
+// keyframe is dropped together with every delta that depends on it.
+// All buffers are sized up front, push() and pop() never allocate.
+class RewindBuffer
+{
+public:
+    RewindBuffer(size_t capacity_bytes = 32 << 20, int keyframe_interval = 60);
+
+    // Records the current state of `gb` as the newest frame
+    void push(const Gameboy& gb);
+    // Restores the newest recorded frame into `gb` and forgets it. False if nothing is left.
+    bool pop(Gameboy& gb);
+    void clear();
+
+    inline size_t frames() const { return m_count; }
+    inline size_t bytes_used() const { return m_bytes_used; }
+
+private:
+    struct Entry {
+        size_t offset;
+        size_t size;
+        bool keyframe;
+        uint64_t keyframe_id; // id of the keyframe this entry is diffed against (its own id if keyframe)
+    };
+
+    std::vector<uint8_t> m_arena;
+    std::vector<Entry> m_entries;   // ring of entries, oldest at m_first
+    size_t m_first = 0;
+    size_t m_count = 0;
+    size_t m_bytes_used = 0;
+
+    int m_keyframe_interval;
+    int m_frames_since_keyframe = 0;
+    uint64_t m_next_keyframe_id = 0;
+
+    // Decoded bytes of the keyframe new deltas are diffed against / old deltas are patched onto
+    std::vector<uint8_t> m_keyframe;
+    uint64_t m_keyframe_id = UINT64_MAX;
+
+    // scratch
+    GameboyState m_state;
+    std::vector<uint8_t> m_serialized;
+    std::vector<uint8_t> m_compressed;
+
+    inline Entry& entry(size_t i) { return m_entries[(m_first + i) % m_entries.size()]; }
+    size_t reserve(size_t size);
+    void drop_oldest_group();
+    void load_keyframe(size_t index);
+};
+
+// Zero-run/literal run-length coding: a sequence of [varint zero run][varint literal count][literals]
+size_t rle_compress(const uint8_t* src, size_t size, uint8_t* dst);
+void rle_decompress(const uint8_t* src, size_t size, uint8_t* dst, size_t dst_size);
+// Upper bound for rle_compress output
+inline size_t rle_bound(size_t size) { return size + size / 64 + 32; }
+
+#endif // REWIND_H
@@ -0,0 +1,139 @@
+#include "gameboy.h"
+#include "rewind.h"
+#include "rom_image.h"
+#include "savestate.h"
+#include "test_util.h"
+#include <random>
+#include <stdexcept>
+#include <vector>
+// Rewind: the zero-run RLE codec and push/pop round trips through the snapshot ring
+
+static std::vector<uint8_t> snapshot(const Gameboy& gb) {
+    GameboyState state;
+    std::vector<uint8_t> bytes;
+    gb.SaveState(state);
+    serialize_state(state, bytes);
+    return bytes;
+}
+
+static void check_rle_round_trip(const std::vector<uint8_t>& data) {
+    std::vector<uint8_t> compressed(rle_bound(data.size()));
+    const size_t size = rle_compress(data.data(), data.size(), compressed.data());
+    CHECK(size <= compressed.size());
+
+    // Decoding fills the whole destination, whatever it held before
+    std::vector<uint8_t> decoded(data.size(), 0xAA);
+    rle_decompress(compressed.data(), size, decoded.data(), decoded.size());
+    CHECK(decoded == data);
+}
+
+static void test_rle() {
+    std::mt19937 rng(1234);
+    check_rle_round_trip({});
+    check_rle_round_trip({0});
+    check_rle_round_trip({7});
+    check_rle_round_trip(std::vector<uint8_t>(5000, 0));
+    check_rle_round_trip(std::vector<uint8_t>(5000, 0xFF));
+
+    // Mixed runs of zeros and literals of every length around the zero run threshold
+    for (int round = 0; round < 200; round++) {
+        std::vector<uint8_t> data;
+        const size_t size = rng() % 3000;
+        while (data.size() < size) {
+            const size_t run = rng() % 12;
+            const bool zeros = rng() % 2 == 0;
+            for (size_t i = 0; i < run && data.size() < size; i++)
+                data.push_back(zeros ? 0 : static_cast<uint8_t>(rng() % 255 + 1));
+        }
+        check_rle_round_trip(data);
+    }
+
+    // Sparse data, the way XORed deltas look, compresses to a fraction
+    std::vector<uint8_t> sparse(20000, 0);
+    for (int i = 0; i < 50; i++) sparse[rng() % sparse.size()] = static_cast<uint8_t>(rng() | 1);
+    std::vector<uint8_t> compressed(rle_bound(sparse.size()));
+    CHECK(rle_compress(sparse.data(), sparse.size(), compressed.data()) < 1000);
+
+    // Damaged input is reported, never written past the destination
+    const std::vector<uint8_t> data = {1, 2, 3, 0, 0, 0, 0, 0, 4};
+    const size_t size = rle_compress(data.data(), data.size(), compressed.data());
+    std::vector<uint8_t> small(data.size() - 1);
+    CHECK_THROWS(rle_decompress(compressed.data(), size, small.data(), small.size()), std::runtime_error);
+    CHECK_THROWS(rle_decompress(compressed.data(), size - 1, small.data(), data.size()), std::runtime_error);
+    const uint8_t unterminated[] = {0x80, 0x80};
+    CHECK_THROWS(rle_decompress(unterminated, sizeof(unterminated), small.data(), small.size()), std::runtime_error);
+}
+
+// Sweeps WRAM over and over, alternately with 00 and 5A. Compressed snapshots grow and
+// shrink by up to 8 KiB every few frames.
+static std::vector<uint8_t> fill_program() {
+    return {
+        0x0E, 0x00,         // 0150: ld c, 0
+        0x21, 0x00, 0xC0,   // 0152: ld hl, C000
+        0x79,               // 0155: ld a, c
+        0x22,               //       ld (hl+), a
+        0x7C,               //       ld a, h
+        0xFE, 0xE0,         //       cp E0
+        0x20, 0xF9,         //       jr nz, 0155
+        0x79,               //       ld a, c
+        0xEE, 0x5A,         //       xor 5A
+        0x4F,               //       ld c, a
+        0x18, 0xF0,         //       jr 0152
+    };
+}
+
+// Every pop has to bring back exactly the state pushed last, across arena wraps. The arena
+// holds a handful of keyframes whose sizes differ by several KiB, and pushes and pops are
+// interleaved, so the ring wraps many times with old entries left at its tail.
+static void test_push_pop(const std::shared_ptr<const RomImage>& rom) {
+    Gameboy gb;
+    gb.LoadROM(rom);
+    gb.SetRunning(true);
+    for (int i = 0; i < BOOT_FRAMES; i++) gb.Update();
+
+    const std::vector<uint8_t> state = snapshot(gb);
+    std::vector<uint8_t> compressed(rle_bound(state.size()));
+    const size_t keyframe_size = rle_compress(state.data(), state.size(), compressed.data()) + 0x2000;
+    RewindBuffer rewind(keyframe_size * 4, 3);
+
+    std::mt19937 rng(99);
+    std::vector<std::vector<uint8_t>> pushed;
+    for (int round = 0; round < 12; round++) {
+        for (int i = 0; i < 150; i++) {
+            if (rng() % 4 == 0) gb.SetButtons(static_cast<uint8_t>(rng()));
+            gb.Update();
+            rewind.push(gb);
+            pushed.push_back(snapshot(gb));
+            CHECK(rewind.frames() > 0);
+            CHECK(rewind.bytes_used() <= keyframe_size * 4);
+        }
+
+        const size_t pops = round % 3 == 2 ? SIZE_MAX : rng() % 60;
+        for (size_t i = 0; i < pops && rewind.frames() > 0; i++) {
+            const size_t frames = rewind.frames();
+            CHECK(rewind.pop(gb));
+            CHECK(rewind.frames() == frames - 1);
+            CHECK(snapshot(gb) == pushed.back());
+            pushed.pop_back();
+        }
+    }
+
+    while (rewind.frames() > 0) {
+        CHECK(rewind.pop(gb));
+        CHECK(snapshot(gb) == pushed.back());
+        pushed.pop_back();
+    }
+    CHECK(!rewind.pop(gb));
+    CHECK(rewind.bytes_used() == 0);
+
+    rewind.push(gb);
+    rewind.clear();
+    CHECK(rewind.frames() == 0);
+    CHECK(!rewind.pop(gb));
+}
+
+int main() {
+    test_rle();
+    test_push_pop(RomImage::from_bytes(make_test_rom(fill_program())));
+    return test_result("rewind_test");
+}
@@ -0,0 +1,130 @@
+#include "rom_image.h"
+#include "utility.h"
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define ROM_IMAGE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+RomImage::~RomImage() {
+    unmap();
+}
+
+void RomImage::unmap() {
+#ifdef ROM_IMAGE_MMAP
+    if (m_mapping) munmap(m_mapping, m_mapping_size);
+#endif
+    m_mapping = nullptr;
+    m_mapping_size = 0;
+}
+
+static size_t declared_rom_size(ROMSize size) {
+    switch (size) {
+    case ROMSize::K32:  return 0x8000;
+    case ROMSize::K64:  return 0x10000;
+    case ROMSize::K128: return 0x20000;
+    case ROMSize::K256: return 0x40000;
+    case ROMSize::K512: return 0x80000;
+    case ROMSize::M1:   return 0x100000;
+    case ROMSize::M2:   return 0x200000;
+    case ROMSize::M4:   return 0x400000;
+    case ROMSize::M8:   return 0x800000;
+    case ROMSize::M1_1: return 72 * RomImage::BANK_SIZE;
+    case ROMSize::M1_2: return 80 * RomImage::BANK_SIZE;
+    case ROMSize::M1_5: return 96 * RomImage::BANK_SIZE;
+    default:            return 0;
+    }
+}
+
+void RomImage::init(const std::string& name) {
+    m_header = get_header_from_romdata(m_data, m_file_size);
+
+    uint8_t checksum = 0;
+    for (int i = 0x134; i <= 0x14C; i++)
+        checksum = checksum - m_data[i] - 1;
+    if (checksum != m_data[0x14D])
+        throw std::invalid_argument("invalid argument. " + name + " has a bad header checksum");
+    if (m_header.type == CartridgeType::INVALID)
+        throw std::invalid_argument("invalid argument. " + name + " uses an unsupported cartridge type " + to_hex(m_data[0x147]));
+    if (m_header.rom_size == ROMSize::INVALID)
+        throw std::invalid_argument("invalid argument. " + name + " has an invalid rom size " + to_hex(m_data[0x148]));
+    if (m_file_size < declared_rom_size(m_header.rom_size))
+        throw std::invalid_argument("invalid argument. " + name + " is truncated");
+
+    // At least the two fixed banks; reads from unpopulated ROM return 0xFF
+    size_t banks = 2;
+    while (banks * BANK_SIZE < m_file_size) banks *= 2;
+    m_bank_mask = static_cast<uint32_t>(banks - 1);
+    m_size = banks * BANK_SIZE;
+
+    if (m_size != m_file_size) {
+        if (m_bytes.empty())
+            m_bytes.assign(m_data, m_data + m_file_size);
+        m_bytes.resize(m_size, 0xFF);
+        m_data = m_bytes.data();
+        unmap();
+    }
+}
+
+uint64_t RomImage::hash() const {
+    std::call_once(m_hash_once, [this] { m_hash = fnv1a_hash(m_data, m_file_size); });
+    return m_hash;
+}
+
+std::shared_ptr<const RomImage> RomImage::from_bytes(std::vector<uint8_t> bytes) {
+    std::shared_ptr<RomImage> image(new RomImage());
+    image->m_bytes = std::move(bytes);
+    image->m_data = image->m_bytes.data();
+    image->m_file_size = image->m_bytes.size();
+    image->init("rom");
+    return image;
+}
+
+std::shared_ptr<const RomImage> RomImage::from_file(const std::string& path) {
+    std::shared_ptr<RomImage> image(new RomImage());
+
+#ifdef ROM_IMAGE_MMAP
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("could not open " + path);
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapping != MAP_FAILED) {
+            image->m_mapping = mapping;
+            image->m_mapping_size = st.st_size;
+            image->m_data = static_cast<const uint8_t*>(mapping);
+            image->m_file_size = st.st_size;
+            // Banks get switched in any order; only the fixed bank is sure to be needed now
+            madvise(mapping, st.st_size, MADV_RANDOM);
+            madvise(mapping, std::min<size_t>(st.st_size, BANK_SIZE), MADV_WILLNEED);
+        }
+    }
+    close(fd);
+#endif
+
+    // No mmap on this platform (or the file couldn't be mapped), read it instead
+    if (!image->m_mapping) {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file)
+            throw std::runtime_error("could not open " + path);
+
+        image->m_bytes.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0, std::ios::beg);
+        file.read(reinterpret_cast<char*>(image->m_bytes.data()), image->m_bytes.size());
+        if (!file)
+            throw std::runtime_error("could not read " + path);
+        image->m_data = image->m_bytes.data();
+        image->m_file_size = image->m_bytes.size();
+    }
+
+    image->init(path);
+    return image;
+}
@@ -0,0 +1,64 @@
+#ifndef ROM_IMAGE_H
+#define ROM_IMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "cartridge.h"
+
+// ROM contents, loaded once and never written again. Cartridges keep a reference to the
+// image instead of a copy, so any number of Gameboy instances can run the same ROM while
+// only holding their own bank registers and RAM.
+//
+// Files are memory-mapped read-only where the platform allows it, so loading a ROM costs
+// a page fault per bank actually used instead of a read of the whole file. ROMs that are
+// not a power of two banks long are copied once to pad them.
+class RomImage
+{
+public:
+    ~RomImage();
+    RomImage(const RomImage&) = delete;
+    RomImage& operator=(const RomImage&) = delete;
+
+    // Throw std::runtime_error if the file can't be read, std::invalid_argument if it is
+    // not a ROM this emulator can run
+    static std::shared_ptr<const RomImage> from_file(const std::string& path);
+    static std::shared_ptr<const RomImage> from_bytes(std::vector<uint8_t> bytes);
+
+    inline const uint8_t* data() const { return m_data; }
+    inline size_t size() const { return m_size; }
+    inline const CartridgeHeader& header() const { return m_header; }
+    inline bool is_mapped() const { return m_mapping != nullptr; }
+    // FNV-1a of the file as loaded, identifies the ROM in save states and movies.
+    // Computed on first use, so a mapped ROM isn't read in full just to be opened.
+    uint64_t hash() const;
+    // Bank numbers are ANDed with this, the image is padded to a power of two banks
+    inline uint32_t bank_mask() const { return m_bank_mask; }
+
+    static constexpr size_t BANK_SIZE = 0x4000;
+
+private:
+    RomImage() = default;
+
+    // Validates the header of m_data/m_file_size, pads into m_bytes if needed
+    void init(const std::string& name);
+    void unmap();
+
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    size_t m_file_size = 0;     // size before padding, what the hash covers
+    std::vector<uint8_t> m_bytes;
+    void* m_mapping = nullptr;
+    size_t m_mapping_size = 0;
+
+    CartridgeHeader m_header;
+    uint32_t m_bank_mask = 1;
+
+    mutable std::once_flag m_hash_once;
+    mutable uint64_t m_hash = 0;
+};
+
+#endif // ROM_IMAGE_H
@@ -0,0 +1,72 @@
+#include "savestate.h"
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable<GameboyState::Core>::value, "GameboyState::Core is stored with memcpy");
+static_assert(std::has_unique_object_representations<GameboyState::Core>::value, "GameboyState::Core must not contain padding bytes");
+
+void serialize_state(const GameboyState& state, std::vector<uint8_t>& out) {
+    SaveStateHeader header = {
+        .magic = SAVESTATE_MAGIC,
+        .version = SAVESTATE_VERSION,
+        .core_size = sizeof(GameboyState::Core),
+        .cartridge_ram_size = static_cast<uint32_t>(state.cartridge_ram.size()),
+        .rom_hash = state.rom_hash
+    };
+
+    out.resize(sizeof(header) + header.core_size + header.cartridge_ram_size);
+    uint8_t* dst = out.data();
+    std::memcpy(dst, &header, sizeof(header));
+    dst += sizeof(header);
+    std::memcpy(dst, &state.core, sizeof(GameboyState::Core));
+    dst += sizeof(GameboyState::Core);
+    if (!state.cartridge_ram.empty())
+        std::memcpy(dst, state.cartridge_ram.data(), state.cartridge_ram.size());
+}
+
+void deserialize_state(const uint8_t* data, size_t size, GameboyState& state) {
+    SaveStateHeader header;
+    if (size < sizeof(header))
+        throw std::runtime_error("save state is truncated");
+    std::memcpy(&header, data, sizeof(header));
+
+    if (header.magic != SAVESTATE_MAGIC)
+        throw std::runtime_error("not a sleepy_boi save state");
+    if (header.version != SAVESTATE_VERSION || header.core_size != sizeof(GameboyState::Core))
+        throw std::runtime_error("save state was written by an incompatible version");
+    if (size != sizeof(header) + header.core_size + header.cartridge_ram_size)
+        throw std::runtime_error("save state is truncated");
+
+    const uint8_t* src = data + sizeof(header);
+    std::memcpy(&state.core, src, sizeof(GameboyState::Core));
+    src += sizeof(GameboyState::Core);
+    state.cartridge_ram.assign(src, src + header.cartridge_ram_size);
+    state.rom_hash = header.rom_hash;
+}
+
+std::future<void> save_state_file_async(const std::string& path, std::vector<uint8_t> bytes) {
+    return std::async(std::launch::async, [path, bytes = std::move(bytes)]() {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file)
+            throw std::runtime_error("could not open " + path + " for writing");
+        file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        if (!file)
+            throw std::runtime_error("could not write " + path);
+    });
+}
+
+std::future<std::vector<uint8_t>> load_state_file_async(const std::string& path) {
+    return std::async(std::launch::async, [path]() {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file)
+            throw std::runtime_error("could not open " + path);
+        std::vector<uint8_t> bytes(static_cast<size_t>(file.tellg()));
+        file.seekg(0, std::ios::beg);
+        file.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+        if (!file)
+            throw std::runtime_error("could not read " + path);
+        return bytes;
+    });
+}
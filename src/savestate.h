@@ -0,0 +1,37 @@
+#ifndef SAVESTATE_H
+#define SAVESTATE_H
+
+#include <cstdint>
+#include <future>
+#include <string>
+#include <vector>
+#include "gameboy.h"
+
+// Binary save state layout:
+//   SaveStateHeader
+//   GameboyState::Core             (header.core_size bytes, copied as-is)
+//   cartridge RAM                  (header.cartridge_ram_size bytes)
+//
+// Sections are raw struct images, so a state only loads into a build with the same
+// GameboyState::Core layout. Bump SAVESTATE_VERSION whenever a State struct changes.
+constexpr uint32_t SAVESTATE_MAGIC = 0x54534253; // "SBST"
+constexpr uint32_t SAVESTATE_VERSION = 3;
+
+struct SaveStateHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t core_size;
+    uint32_t cartridge_ram_size;
+    uint64_t rom_hash;
+};
+
+// Flattens `state` into `out`, reusing its capacity
+void serialize_state(const GameboyState& state, std::vector<uint8_t>& out);
+// Throws std::runtime_error if the data is not a save state this build understands
+void deserialize_state(const uint8_t* data, size_t size, GameboyState& state);
+
+// File I/O runs on a background thread, errors are rethrown from future::get()
+std::future<void> save_state_file_async(const std::string& path, std::vector<uint8_t> bytes);
+std::future<std::vector<uint8_t>> load_state_file_async(const std::string& path);
+
+#endif // SAVESTATE_H
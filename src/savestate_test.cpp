@@ -0,0 +1,159 @@
+#include "gameboy.h"
+#include "rom_image.h"
+#include "savestate.h"
+#include "test_util.h"
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+// Save state round trips: serialization, file I/O and restoring a running Gameboy
+
+static std::vector<uint8_t> snapshot(const Gameboy& gb) {
+    GameboyState state;
+    std::vector<uint8_t> bytes;
+    gb.SaveState(state);
+    serialize_state(state, bytes);
+    return bytes;
+}
+
+static void run_frames(Gameboy& gb, int frames) {
+    for (int i = 0; i < frames; i++) gb.Update();
+}
+
+static void test_serialize_round_trip(const std::shared_ptr<const RomImage>& rom) {
+    Gameboy gb;
+    gb.LoadROM(rom);
+    gb.SetRunning(true);
+    run_frames(gb, 10);
+
+    const std::vector<uint8_t> bytes = snapshot(gb);
+    GameboyState state;
+    deserialize_state(bytes.data(), bytes.size(), state);
+    std::vector<uint8_t> again;
+    serialize_state(state, again);
+    CHECK(again == bytes);
+    CHECK(state.rom_hash == rom->hash());
+
+    // Two snapshots of the same state are the same bytes, whatever the GameboyState held before
+    GameboyState reused;
+    deserialize_state(bytes.data(), bytes.size(), reused);
+    reused.core.cpu.pc ^= 0xFFFF;
+    gb.SaveState(reused);
+    serialize_state(reused, again);
+    CHECK(again == bytes);
+
+    std::vector<uint8_t> bad = bytes;
+    bad[0] ^= 0xFF;
+    CHECK_THROWS(deserialize_state(bad.data(), bad.size(), state), std::runtime_error);
+    CHECK_THROWS(deserialize_state(bytes.data(), bytes.size() - 1, state), std::runtime_error);
+    CHECK_THROWS(deserialize_state(bytes.data(), 4, state), std::runtime_error);
+}
+
+static void test_restore(const std::shared_ptr<const RomImage>& rom) {
+    Gameboy gb;
+    gb.LoadROM(rom);
+    gb.SetRunning(true);
+    run_frames(gb, BOOT_FRAMES + 30);
+
+    const std::vector<uint8_t> saved = snapshot(gb);
+    run_frames(gb, 20);
+    const std::vector<uint8_t> expected = snapshot(gb);
+    CHECK(expected != saved);
+
+    // Restored into a fresh instance, the next 20 frames end in the same state
+    GameboyState state;
+    deserialize_state(saved.data(), saved.size(), state);
+    Gameboy restored;
+    restored.LoadROM(rom);
+    restored.LoadState(state);
+    restored.SetRunning(true);
+    CHECK(snapshot(restored) == saved);
+    run_frames(restored, 20);
+    CHECK(snapshot(restored) == expected);
+
+    Gameboy other;
+    other.LoadROM(RomImage::from_bytes(make_test_rom({0x18, 0xFE})));
+    CHECK_THROWS(other.LoadState(state), std::invalid_argument);
+}
+
+static void test_file_round_trip(const std::shared_ptr<const RomImage>& rom) {
+    Gameboy gb;
+    gb.LoadROM(rom);
+    gb.SetRunning(true);
+    run_frames(gb, 5);
+
+    const std::string path = "savestate_test.sst";
+    gb.SaveStateToFile(path).get();
+    const std::vector<uint8_t> bytes = load_state_file_async(path).get();
+    CHECK(bytes == snapshot(gb));
+    std::remove(path.c_str());
+
+    CHECK_THROWS(load_state_file_async("savestate_test_missing.sst").get(), std::runtime_error);
+}
+
+// MBC1 registers and cartridge RAM are part of the state
+static void test_cartridge_state() {
+    const std::vector<uint8_t> program = {
+        0x3E, 0x0A,         // 0150: ld a, 0A
+        0xEA, 0x00, 0x00,   //       ld (0000), a    (RAM on)
+        0x3E, 0x03,         //       ld a, 3
+        0xEA, 0x00, 0x20,   //       ld (2000), a    (ROM bank 3)
+        0x21, 0x00, 0xA0,   //       ld hl, A000
+        0x34,               // 015D: inc (hl)
+        0x18, 0xFD,         //       jr 015D
+    };
+    std::vector<uint8_t> bytes = make_test_rom(program, {}, 0x03, 2, 2);
+    bytes[3 * RomImage::BANK_SIZE] = 0x33;
+    const auto rom = RomImage::from_bytes(bytes);
+
+    Gameboy gb;
+    gb.LoadROM(rom);
+    gb.SetRunning(true);
+    run_frames(gb, BOOT_FRAMES + 3);
+    CHECK(gb.ReadMemory(0x4000) == 0x33);
+    const std::vector<uint8_t> saved = snapshot(gb);
+    const uint8_t counter = gb.ReadMemory(0xA000);
+
+    GameboyState state;
+    deserialize_state(saved.data(), saved.size(), state);
+    CHECK(state.cartridge_ram.size() == 0x8000);
+    Gameboy restored;
+    restored.LoadROM(rom);
+    CHECK(restored.ReadMemory(0x4000) != 0x33);
+    restored.LoadState(state);
+    CHECK(restored.ReadMemory(0x4000) == 0x33);
+    CHECK(restored.ReadMemory(0xA000) == counter);
+}
+
+// Run-ahead rolls its extra frames back: same state and counters as a plain run, one
+// history entry per Update, the extra frames only counted as speculative
+static void test_run_ahead(std::shared_ptr<const RomImage> rom) {
+    Gameboy plain;
+    plain.LoadROM(rom);
+    plain.SetRunning(true);
+    auto ahead = plain.clone();
+    ahead->SetRunAhead(2);
+    run_frames(plain, 50);
+    run_frames(*ahead, 50);
+
+    CHECK(snapshot(plain) == snapshot(*ahead));
+    const PerfCounters& expected = plain.GetPerfCounters();
+    const PerfCounters& counters = ahead->GetPerfCounters();
+    CHECK(counters.frames_rendered == expected.frames_rendered);
+    CHECK(counters.frames_skipped == expected.frames_skipped);
+    CHECK(counters.instructions == expected.instructions);
+    CHECK(counters.cycles == expected.cycles);
+    CHECK(counters.sampled_frames == expected.sampled_frames);
+    CHECK(counters.frames_speculative == 100);
+    CHECK(expected.frames_speculative == 0);
+    CHECK(ahead->GetPerfHistory().size() == 50);
+}
+
+int main() {
+    const auto rom = RomImage::from_bytes(make_test_rom(busy_program()));
+    test_run_ahead(rom);
+    test_serialize_round_trip(rom);
+    test_restore(rom);
+    test_file_round_trip(rom);
+    test_cartridge_state();
+    return test_result("savestate_test");
+}
@@ -0,0 +1,347 @@
+// sleepy_boi_search : explores input sequences from a starting state, across all cores
+//
+// usage: sleepy_boi_search <rom> [options]
+//
+//   --state PATH        start from a save state instead of power-on
+//   --horizon N         frames to look ahead (default 600)
+//   --step N            frames each input is held for, one search level (default 8)
+//   --beam W            states kept per level (default 256)
+//   --bfs               keep states in the order they were found instead of by score
+//   --maximize EXPR     objective to climb, see below (default 0)
+//   --goal EXPR         stop at the first state where EXPR is not 0
+//   --softlock N        stop at the first state where input has changed nothing for N levels
+//   --actions LIST      comma separated inputs to try, buttons joined by '+'
+//                       (default none,right,left,up,down,a,b,start,a+right)
+//   --movie PATH        write the best input sequence as a movie
+//   --threads N         worker threads (default: all cores)
+//
+// Exits with 2 if a --goal was given and not reached within the horizon.
+//
+// Expressions are integer arithmetic over memory:
+//   [C0A0]  byte at C0A0 (hex)       w[C0A0]  little endian word at C0A0
+//   frame   frames since the start   42, 0x2A
+//   + - * & ( ) == != < <= > >= && || ! and unary -
+//
+// Every level, each state in the beam is cloned once per action and run for `step` frames
+// with that input held. Children whose WRAM+HRAM hash was seen before are dropped, so the
+// beam never spends work on states it already has. A state counts as input-dead when all
+// of its children end up with the same RAM, which is how --softlock finds places where the
+// game stops listening. Children that make the emulator throw are dropped from the beam
+// and reported with the input that got them there.
+
+#include "expression.h"
+#include "gameboy.h"
+#include "movie.h"
+#include "savestate.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+struct Options {
+    std::string rom;
+    std::string state_path;
+    std::string movie_path;
+    int horizon = 600;
+    int step = 8;
+    size_t beam = 256;
+    bool bfs = false;
+    Expression objective;
+    Expression goal;
+    bool has_goal = false;
+    int softlock_levels = 0;
+    std::vector<uint8_t> actions;
+    size_t threads = std::thread::hardware_concurrency();
+};
+
+struct Node {
+    std::unique_ptr<Gameboy> gb;
+    std::vector<uint8_t> path;  // one action per level
+    int64_t score = 0;
+    uint64_t ram_hash = 0;
+    int dead_levels = 0;        // consecutive levels at which no input made a difference
+    bool goal = false;
+    std::string error;          // what the emulator threw, the node has no gb then
+};
+
+static uint8_t parse_action(const std::string& text) {
+    static const char* names[] = {"right", "left", "up", "down", "a", "b", "select", "start"};
+    uint8_t buttons = 0;
+    size_t begin = 0;
+    while (begin <= text.size()) {
+        size_t end = text.find('+', begin);
+        if (end == std::string::npos) end = text.size();
+        std::string name = text.substr(begin, end - begin);
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+
+        bool found = name == "none";
+        for (int button = 0; button < 8 && !found; button++) {
+            if (name == names[button]) {
+                buttons |= 1 << button;
+                found = true;
+            }
+        }
+        if (!found)
+            throw std::invalid_argument("invalid argument. unknown button '" + name + "'");
+        begin = end + 1;
+    }
+    return buttons;
+}
+
+static std::string action_name(uint8_t buttons) {
+    static const char* names[] = {"right", "left", "up", "down", "a", "b", "select", "start"};
+    std::string name;
+    for (int button = 0; button < 8; button++) {
+        if ((buttons & (1 << button)) == 0) continue;
+        if (!name.empty()) name += "+";
+        name += names[button];
+    }
+    return name.empty() ? "none" : name;
+}
+
+// One line per input change
+static void print_path(const std::vector<uint8_t>& path, int step) {
+    for (size_t i = 0; i < path.size(); i++) {
+        if (i > 0 && path[i] == path[i - 1]) continue;
+        std::cout << "  frame " << i * step << ": " << action_name(path[i]) << std::endl;
+    }
+}
+
+static Options parse_options(int argc, char** argv) {
+    Options options;
+    options.rom = argv[1];
+    std::string actions = "none,right,left,up,down,a,b,start,a+right";
+
+    for (int i = 2; i < argc; i++) {
+        const std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc)
+                throw std::invalid_argument("invalid argument. " + arg + " needs a value");
+            return argv[++i];
+        };
+
+        if (arg == "--state") options.state_path = value();
+        else if (arg == "--horizon") options.horizon = std::stoi(value());
+        else if (arg == "--step") options.step = std::stoi(value());
+        else if (arg == "--beam") options.beam = std::stoul(value());
+        else if (arg == "--bfs") options.bfs = true;
+        else if (arg == "--maximize") options.objective = Expression(value());
+        else if (arg == "--goal") { options.goal = Expression(value()); options.has_goal = true; }
+        else if (arg == "--softlock") options.softlock_levels = std::stoi(value());
+        else if (arg == "--actions") actions = value();
+        else if (arg == "--movie") options.movie_path = value();
+        else if (arg == "--threads") options.threads = std::stoul(value());
+        else throw std::invalid_argument("invalid argument. unknown option " + arg);
+    }
+
+    if (options.step <= 0 || options.horizon < options.step || options.beam == 0)
+        throw std::invalid_argument("invalid argument. need 0 < step <= horizon and beam > 0");
+
+    size_t begin = 0;
+    while (begin <= actions.size()) {
+        size_t end = actions.find(',', begin);
+        if (end == std::string::npos) end = actions.size();
+        options.actions.push_back(parse_action(actions.substr(begin, end - begin)));
+        begin = end + 1;
+    }
+    return options;
+}
+
+static std::unique_ptr<Gameboy> load_start(const Options& options) {
+    auto gb = std::make_unique<Gameboy>();
+    gb->LoadROM(options.rom);
+    if (!options.state_path.empty()) {
+        std::vector<uint8_t> bytes = load_state_file_async(options.state_path).get();
+        GameboyState state;
+        deserialize_state(bytes.data(), bytes.size(), state);
+        gb->LoadState(state);
+    }
+    gb->SetRendering(false);
+    gb->SetSerialCapture(true);
+    gb->SetRunning(true);
+    return gb;
+}
+
+// Replays `path` from the start state and records it
+static void write_movie(const Options& options, const Gameboy& start, const std::vector<uint8_t>& path) {
+    std::unique_ptr<Gameboy> gb = start.clone();
+    MovieRecorder recorder(*gb);
+    for (uint8_t buttons : path) {
+        for (int frame = 0; frame < options.step; frame++) {
+            gb->SetButtons(buttons);
+            gb->Update();
+            recorder.record_frame(*gb);
+        }
+    }
+    recorder.movie().save(options.movie_path);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " <rom> [--state PATH] [--horizon N] [--step N] [--beam W] [--bfs]"
+                  << " [--maximize EXPR] [--goal EXPR] [--softlock N] [--actions LIST] [--movie PATH] [--threads N]" << std::endl;
+        return 1;
+    }
+
+    Options options;
+    std::unique_ptr<Gameboy> start;
+    try {
+        options = parse_options(argc, argv);
+        start = load_start(options);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    ThreadPool pool(options.threads);
+    std::unordered_set<uint64_t> seen;
+
+    std::vector<Node> beam(1);
+    beam[0].gb = start->clone();
+    beam[0].ram_hash = start->HashRAM();
+    beam[0].score = options.objective.eval(*start, 0);
+    seen.insert(beam[0].ram_hash);
+
+    Node best;
+    best.score = beam[0].score;
+    bool found = false;
+    std::vector<uint8_t> found_path;
+    std::string found_reason;
+    uint64_t duplicates = 0;
+    uint64_t crashes = 0;
+    Node first_crash;
+    std::atomic<uint64_t> frames_run {0};
+
+    const int levels = options.horizon / options.step;
+    const size_t fan_out = options.actions.size();
+    auto start_time = std::chrono::steady_clock::now();
+
+    int level = 0;
+    std::vector<Node> children;
+    for (; level < levels && !found && !beam.empty(); level++) {
+        const uint64_t frame = (uint64_t)(level + 1) * options.step;
+
+        // Expand every state in the beam with every action, one task per parent
+        children.clear();
+        children.resize(beam.size() * fan_out);
+        for (size_t p = 0; p < beam.size(); p++) {
+            pool.submit([&, p] {
+                Node& parent = beam[p];
+                for (size_t a = 0; a < fan_out; a++) {
+                    Node& child = children[p * fan_out + a];
+                    // Exceptions can't leave a pool thread, and one broken state is a
+                    // finding, not a reason to stop the search
+                    try {
+                        // The last child takes over the parent instead of cloning it
+                        child.gb = a + 1 < fan_out ? parent.gb->clone() : std::move(parent.gb);
+                        for (int f = 0; f < options.step; f++) {
+                            child.gb->SetButtons(options.actions[a]);
+                            child.gb->Update();
+                        }
+                        child.ram_hash = child.gb->HashRAM();
+                        child.score = options.objective.eval(*child.gb, frame);
+                        child.goal = options.has_goal && options.goal.eval(*child.gb, frame) != 0;
+                    } catch (const std::exception& e) {
+                        child.gb.reset();
+                        child.error = e.what();
+                    }
+                }
+                frames_run += fan_out * options.step;
+
+                bool input_dead = true;
+                for (size_t a = 1; a < fan_out; a++)
+                    input_dead = input_dead && children[p * fan_out + a].ram_hash == children[p * fan_out].ram_hash;
+                for (size_t a = 0; a < fan_out; a++) {
+                    Node& child = children[p * fan_out + a];
+                    child.path = parent.path;
+                    child.path.push_back(options.actions[a]);
+                    child.dead_levels = input_dead ? parent.dead_levels + 1 : 0;
+                }
+            });
+        }
+        pool.wait();
+
+        // Deduplicate in a fixed order so runs are reproducible whatever the thread count
+        std::vector<Node> next;
+        for (Node& child : children) {
+            if (!child.error.empty()) {
+                if (crashes++ == 0) {
+                    first_crash.error = child.error;
+                    first_crash.path = child.path;
+                }
+                continue;
+            }
+            if (child.goal) {
+                found_reason = "goal reached";
+            } else if (options.softlock_levels > 0 && child.dead_levels >= options.softlock_levels) {
+                found_reason = "input ignored for " + std::to_string(child.dead_levels * options.step) + " frames";
+            } else if (!seen.insert(child.ram_hash).second) {
+                duplicates++;
+                continue;
+            }
+            if (child.score > best.score || best.path.empty()) {
+                best.score = child.score;
+                best.path = child.path;
+            }
+            if (!found_reason.empty()) {
+                found = true;
+                found_path = child.path;
+                break;
+            }
+            next.push_back(std::move(child));
+        }
+
+        // Nothing new: the game is not looking at RAM-visible input yet (boot, fades,
+        // cutscenes). Keep one child so time moves on instead of ending the search.
+        if (!found && next.empty()) {
+            auto alive = std::find_if(children.begin(), children.end(), [](const Node& child) { return child.gb != nullptr; });
+            if (alive != children.end())
+                next.push_back(std::move(*alive));
+        }
+
+        if (!options.bfs) {
+            // Stable so equal scores keep discovery order
+            std::stable_sort(next.begin(), next.end(), [](const Node& a, const Node& b) { return a.score > b.score; });
+        }
+        if (next.size() > options.beam)
+            next.resize(options.beam);
+        beam = std::move(next);
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+    const std::vector<uint8_t>& path = found ? found_path : best.path;
+
+    std::cout << std::fixed << std::setprecision(1);
+    if (found)
+        std::cout << found_reason << " after " << level << " levels (" << path.size() * options.step << " frames)" << std::endl;
+    else
+        std::cout << "horizon reached, best score " << best.score << std::endl;
+
+    print_path(path, options.step);
+
+    if (crashes > 0) {
+        std::cout << crashes << " states made the emulator fail, the first after "
+                  << first_crash.path.size() * options.step << " frames: " << first_crash.error << std::endl;
+        print_path(first_crash.path, options.step);
+    }
+
+    std::cout << seen.size() << " unique states, " << duplicates << " duplicates, " << frames_run << " frames in "
+              << elapsed.count() << " s on " << pool.size() << " threads: " << frames_run / elapsed.count() << " fps" << std::endl;
+
+    if (!options.movie_path.empty() && !path.empty()) {
+        try {
+            write_movie(options, *start, path);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+    return found || !options.has_goal ? 0 : 2;
+}
@@ -0,0 +1,439 @@
+// sleepy_boi_server : drives emulator instances for other processes over a Unix socket
+//
+// usage: sleepy_boi_server <socket path> [threads]
+//
+// Protocol in include/sleepyboi_protocol.h. Instances and snapshots belong to the server,
+// not to a connection, so an orchestrator can reconnect or spread work over several
+// connections. Each wakeup reads what a client sent (up to one maximum-size batch ahead),
+// answers every complete batch and writes all responses back with as few syscalls as the
+// socket buffers allow.
+
+#include "gameboy.h"
+#include "savestate.h"
+#include "sleepyboi_protocol.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Stop reading from a client whose responses pile up faster than it reads them
+static constexpr size_t MAX_PENDING_OUTPUT = 64 << 20;
+// Unparsed input is capped at the largest valid batch: more than that is never needed to
+// make progress, and a client sending faster than batches run only fills the socket
+static constexpr size_t MAX_PENDING_INPUT = SB_PROTO_MAX_BATCH_SIZE + sizeof(sb_proto_batch_header);
+static constexpr size_t READ_CHUNK = 64 << 10;
+
+static volatile sig_atomic_t g_quit = 0;
+
+// Thrown by commands, carries the status for the result
+struct CommandError : std::runtime_error {
+    CommandError(sb_proto_status status, const std::string& what)
+        : std::runtime_error(what), status(status) {}
+    sb_proto_status status;
+};
+
+struct Command {
+    sb_proto_command header;
+    const uint8_t* payload;
+};
+
+struct Result {
+    int32_t status = SB_STATUS_OK;
+    std::vector<uint8_t> payload;
+};
+
+struct Connection {
+    explicit Connection(int fd)
+        : fd(fd) {}
+
+    int fd;
+    std::vector<uint8_t> in;
+    std::vector<uint8_t> out;
+    size_t out_sent = 0;
+};
+
+class Server
+{
+public:
+    explicit Server(size_t threads)
+        : m_pool(threads) {}
+
+    // Appends the response to `request` (a complete batch) to `out`
+    void handle_batch(const uint8_t* request, std::vector<uint8_t>& out);
+
+private:
+    static bool is_global(uint8_t op);
+    void execute(const Command& command, Result& result);
+    void execute_global(const Command& command, Result& result);
+    Gameboy& instance(uint32_t id);
+
+    template<typename T>
+    static void put(Result& result, const T& value) {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+        result.payload.insert(result.payload.end(), bytes, bytes + sizeof(T));
+    }
+
+    ThreadPool m_pool;
+    std::unordered_map<uint32_t, std::unique_ptr<Gameboy>> m_instances;
+    std::unordered_map<uint32_t, GameboyState> m_snapshots;
+    std::unordered_map<std::string, std::shared_ptr<const RomImage>> m_roms;
+    uint32_t m_next_instance = 1;
+    uint32_t m_next_snapshot = 1;
+};
+
+bool Server::is_global(uint8_t op) {
+    switch (op) {
+    case SB_OP_VERSION:
+    case SB_OP_CREATE:
+    case SB_OP_CLONE:
+    case SB_OP_DESTROY:
+    case SB_OP_SNAPSHOT:
+    case SB_OP_DROP_SNAPSHOT:
+        return true;
+    }
+    return false;
+}
+
+Gameboy& Server::instance(uint32_t id) {
+    auto it = m_instances.find(id);
+    if (it == m_instances.end())
+        throw CommandError(SB_STATUS_NO_INSTANCE, "no instance " + std::to_string(id));
+    return *it->second;
+}
+
+// Commands that change the instance or snapshot tables, run one at a time
+void Server::execute_global(const Command& command, Result& result) {
+    const sb_proto_command& c = command.header;
+    switch (c.op) {
+    case SB_OP_VERSION:
+        put<uint32_t>(result, SB_PROTO_VERSION);
+        break;
+    case SB_OP_CREATE: {
+        const std::string path(reinterpret_cast<const char*>(command.payload), c.payload_size);
+        std::shared_ptr<const RomImage>& rom = m_roms[path];
+        try {
+            if (!rom) rom = RomImage::from_file(path);
+        } catch (const std::exception& e) {
+            m_roms.erase(path);
+            throw CommandError(SB_STATUS_ROM, e.what());
+        }
+        auto gb = std::make_unique<Gameboy>();
+        gb->LoadROM(rom);
+        gb->SetSerialCapture(true);
+        gb->SetRendering(false);
+        gb->SetRunning(true);
+        m_instances[m_next_instance] = std::move(gb);
+        put<uint32_t>(result, m_next_instance++);
+        break;
+    }
+    case SB_OP_CLONE:
+        m_instances[m_next_instance] = instance(c.instance).clone();
+        put<uint32_t>(result, m_next_instance++);
+        break;
+    case SB_OP_DESTROY:
+        instance(c.instance);
+        m_instances.erase(c.instance);
+        break;
+    case SB_OP_SNAPSHOT:
+        instance(c.instance).SaveState(m_snapshots[m_next_snapshot]);
+        put<uint32_t>(result, m_next_snapshot++);
+        break;
+    case SB_OP_DROP_SNAPSHOT:
+        if (m_snapshots.erase(c.arg0) == 0)
+            throw CommandError(SB_STATUS_NO_INSTANCE, "no snapshot " + std::to_string(c.arg0));
+        break;
+    }
+}
+
+// Commands that only touch their own instance, safe to run next to each other
+void Server::execute(const Command& command, Result& result) {
+    const sb_proto_command& c = command.header;
+    Gameboy& gb = instance(c.instance);
+    switch (c.op) {
+    case SB_OP_RUN_FRAMES:
+        for (uint32_t i = 0; i < c.arg0; i++)
+            gb.Update();
+        break;
+    case SB_OP_SET_INPUT:
+        gb.SetButtons(c.arg0);
+        break;
+    case SB_OP_SET_RENDERING:
+        gb.SetRendering(c.arg0 != 0);
+        break;
+    case SB_OP_READ_MEMORY:
+        if (c.arg0 > 0xFFFF || c.arg1 > 0x10000 - c.arg0)
+            throw CommandError(SB_STATUS_INVALID_ARGUMENT, "memory range outside of the memory map");
+        result.payload.resize(c.arg1);
+        for (uint32_t i = 0; i < c.arg1; i++)
+            result.payload[i] = gb.ReadMemory(c.arg0 + i);
+        break;
+    case SB_OP_FRAMEBUFFER:
+        result.payload.assign(gb.GetFramebuffer(), gb.GetFramebuffer() + Framebuffer::WIDTH * Framebuffer::HEIGHT);
+        break;
+    case SB_OP_SAVE_STATE: {
+        GameboyState state;
+        gb.SaveState(state);
+        serialize_state(state, result.payload);
+        break;
+    }
+    case SB_OP_LOAD_STATE:
+        try {
+            GameboyState state;
+            deserialize_state(command.payload, c.payload_size, state);
+            gb.LoadState(state);
+        } catch (const std::exception& e) {
+            throw CommandError(SB_STATUS_STATE, e.what());
+        }
+        break;
+    case SB_OP_RESTORE: {
+        // The snapshot table only changes in global commands, reading it here is safe
+        auto it = m_snapshots.find(c.arg0);
+        if (it == m_snapshots.end())
+            throw CommandError(SB_STATUS_NO_INSTANCE, "no snapshot " + std::to_string(c.arg0));
+        try {
+            gb.LoadState(it->second);
+        } catch (const std::exception& e) {
+            throw CommandError(SB_STATUS_STATE, e.what());
+        }
+        break;
+    }
+    case SB_OP_SERIAL:
+        result.payload.assign(gb.GetSerialOutput().begin(), gb.GetSerialOutput().end());
+        break;
+    default:
+        throw CommandError(SB_STATUS_UNKNOWN_OP, "unknown op " + std::to_string(c.op));
+    }
+}
+
+static void run_command(const std::function<void()>& body, Result& result) {
+    try {
+        body();
+    } catch (const CommandError& e) {
+        result.status = e.status;
+        result.payload.assign(e.what(), e.what() + std::strlen(e.what()));
+    } catch (const std::invalid_argument& e) {
+        result.status = SB_STATUS_INVALID_ARGUMENT;
+        result.payload.assign(e.what(), e.what() + std::strlen(e.what()));
+    } catch (const std::exception& e) {
+        result.status = SB_STATUS_INTERNAL;
+        result.payload.assign(e.what(), e.what() + std::strlen(e.what()));
+    }
+}
+
+void Server::handle_batch(const uint8_t* request, std::vector<uint8_t>& out) {
+    sb_proto_batch_header header;
+    std::memcpy(&header, request, sizeof(header));
+
+    // Split the batch into commands, anything running past the end fails on its own
+    std::vector<Command> commands;
+    std::vector<Result> results(header.count);
+    const uint8_t* cursor = request + sizeof(header);
+    const uint8_t* end = cursor + header.size;
+    for (uint32_t i = 0; i < header.count; i++) {
+        Command command;
+        if (static_cast<size_t>(end - cursor) < sizeof(sb_proto_command)) break;
+        std::memcpy(&command.header, cursor, sizeof(sb_proto_command));
+        if (static_cast<size_t>(end - cursor) - sizeof(sb_proto_command) < command.header.payload_size) break;
+        command.payload = cursor + sizeof(sb_proto_command);
+        cursor += sizeof(sb_proto_command) + command.header.payload_size;
+        commands.push_back(command);
+    }
+    for (size_t i = commands.size(); i < results.size(); i++) {
+        run_command([] { throw CommandError(SB_STATUS_INVALID_ARGUMENT, "command runs past the end of its batch"); }, results[i]);
+    }
+
+    size_t i = 0;
+    while (i < commands.size()) {
+        if (is_global(commands[i].header.op)) {
+            run_command([&] { execute_global(commands[i], results[i]); }, results[i]);
+            i++;
+            continue;
+        }
+
+        // Everything up to the next global command, in order per instance
+        std::map<uint32_t, std::vector<size_t>> by_instance;
+        for (; i < commands.size() && !is_global(commands[i].header.op); i++)
+            by_instance[commands[i].header.instance].push_back(i);
+
+        auto run_instance = [this, &commands, &results](const std::vector<size_t>& indices) {
+            for (size_t index : indices)
+                run_command([&] { execute(commands[index], results[index]); }, results[index]);
+        };
+        if (by_instance.size() == 1) {
+            run_instance(by_instance.begin()->second);
+        } else {
+            for (auto& entry : by_instance) {
+                const std::vector<size_t>* indices = &entry.second;
+                m_pool.submit([run_instance, indices] { run_instance(*indices); });
+            }
+            m_pool.wait();
+        }
+    }
+
+    sb_proto_batch_header response = {SB_PROTO_RESPONSE_MAGIC, 0, header.batch_id, static_cast<uint32_t>(results.size())};
+    const size_t start = out.size();
+    out.resize(start + sizeof(response));
+    for (const Result& result : results) {
+        sb_proto_result result_header = {result.status, static_cast<uint32_t>(result.payload.size())};
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&result_header);
+        out.insert(out.end(), bytes, bytes + sizeof(result_header));
+        out.insert(out.end(), result.payload.begin(), result.payload.end());
+    }
+    response.size = out.size() - start - sizeof(response);
+    std::memcpy(&out[start], &response, sizeof(response));
+}
+
+// Returns false if the connection should be closed, after answering what it sent
+static bool read_client(Server& server, Connection& connection) {
+    bool open = true;
+    while (connection.in.size() < MAX_PENDING_INPUT) {
+        const size_t used = connection.in.size();
+        const size_t chunk = std::min(READ_CHUNK, MAX_PENDING_INPUT - used);
+        connection.in.resize(used + chunk);
+        ssize_t received = recv(connection.fd, connection.in.data() + used, chunk, 0);
+        connection.in.resize(used + (received > 0 ? received : 0));
+        if (received > 0) continue;
+        if (received < 0 && errno == EINTR) continue;
+        if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) open = false;
+        break;
+    }
+
+    size_t consumed = 0;
+    while (connection.in.size() - consumed >= sizeof(sb_proto_batch_header)) {
+        sb_proto_batch_header header;
+        std::memcpy(&header, &connection.in[consumed], sizeof(header));
+        if (header.magic != SB_PROTO_REQUEST_MAGIC || header.size > SB_PROTO_MAX_BATCH_SIZE
+                || header.count > header.size / sizeof(sb_proto_command))
+            return false;
+        if (connection.in.size() - consumed < sizeof(header) + header.size)
+            break;
+        server.handle_batch(&connection.in[consumed], connection.out);
+        consumed += sizeof(header) + header.size;
+    }
+    connection.in.erase(connection.in.begin(), connection.in.begin() + consumed);
+    return open;
+}
+
+static bool write_client(Connection& connection) {
+    while (connection.out_sent < connection.out.size()) {
+        ssize_t sent = send(connection.fd, connection.out.data() + connection.out_sent,
+                            connection.out.size() - connection.out_sent, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+            if (errno == EINTR) continue;
+            return false;
+        }
+        connection.out_sent += sent;
+    }
+    connection.out.clear();
+    connection.out_sent = 0;
+    return true;
+}
+
+static int listen_on(const std::string& path) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+        throw std::runtime_error("socket path too long: " + path);
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        throw std::runtime_error("could not create a socket");
+    unlink(path.c_str());
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(fd, 64) != 0) {
+        close(fd);
+        throw std::runtime_error("could not listen on " + path + ": " + std::strerror(errno));
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    return fd;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " <socket path> [threads]" << std::endl;
+        return 1;
+    }
+    const std::string path = argv[1];
+    size_t threads;
+    int listen_fd;
+    try {
+        threads = argc > 2 ? std::stoul(argv[2]) : std::thread::hardware_concurrency();
+        listen_fd = listen_on(path);
+    } catch (const std::logic_error&) {
+        std::cerr << "invalid argument. threads must be a number: " << argv[2] << std::endl;
+        return 1;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::signal(SIGINT, [](int) { g_quit = 1; });
+    std::signal(SIGTERM, [](int) { g_quit = 1; });
+
+    Server server(threads);
+    std::vector<Connection> connections;
+    std::vector<pollfd> fds;
+    std::cout << "listening on " << path << std::endl;
+
+    while (!g_quit) {
+        fds.assign(1, pollfd {listen_fd, POLLIN, 0});
+        for (const Connection& connection : connections) {
+            short events = 0;
+            // The rest of the input waits in the socket until what was read has been answered
+            if (connection.out.size() - connection.out_sent < MAX_PENDING_OUTPUT
+                    && connection.in.size() < MAX_PENDING_INPUT) events |= POLLIN;
+            if (connection.out_sent < connection.out.size()) events |= POLLOUT;
+            fds.push_back(pollfd {connection.fd, events, 0});
+        }
+
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        for (size_t i = connections.size(); i-- > 0;) {
+            Connection& connection = connections[i];
+            const short revents = fds[i + 1].revents;
+            bool keep = true;
+            if (revents & (POLLIN | POLLHUP | POLLERR))
+                keep = read_client(server, connection);
+            // Answer right away, most responses fit the socket buffer in one send
+            if (!write_client(connection))
+                keep = false;
+            if (!keep) {
+                close(connection.fd);
+                connections.erase(connections.begin() + i);
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int fd;
+            while ((fd = accept(listen_fd, nullptr, nullptr)) >= 0) {
+                fcntl(fd, F_SETFL, O_NONBLOCK);
+                connections.emplace_back(fd);
+            }
+        }
+    }
+
+    for (Connection& connection : connections)
+        close(connection.fd);
+    close(listen_fd);
+    unlink(path.c_str());
+    return 0;
+}
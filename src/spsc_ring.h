@@ -0,0 +1,56 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// Lock-free single-producer/single-consumer ring buffer.
+// Exactly one thread may call push() and exactly one (other) thread may call pop().
+template<typename T, size_t Capacity>
+class SPSCRing
+{
+    static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0, "SPSCRing capacity must be a power of two");
+
+public:
+    bool push(const T& item) {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_cached_tail == Capacity) {
+            m_cached_tail = m_tail.load(std::memory_order_acquire);
+            if (head - m_cached_tail == Capacity)
+                return false;
+        }
+        m_items[head & (Capacity - 1)] = item;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item) {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_cached_head) {
+            m_cached_head = m_head.load(std::memory_order_acquire);
+            if (tail == m_cached_head)
+                return false;
+        }
+        item = m_items[tail & (Capacity - 1)];
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+
+private:
+    // producer side
+    alignas(64) std::atomic<size_t> m_head{0};
+    size_t m_cached_tail = 0;
+
+    // consumer side
+    alignas(64) std::atomic<size_t> m_tail{0};
+    size_t m_cached_head = 0;
+
+    alignas(64) std::array<T, Capacity> m_items;
+};
+
+#endif // SPSC_RING_H
@@ -0,0 +1,96 @@
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// Shared by the src/*_test.cpp programs. Each one is a plain executable that prints the
+// checks that failed and returns non-zero if there were any (see the tests in CMakeLists.txt).
+// sleepy_boi_bench uses the ROM builders too.
+
+inline int g_test_failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition << std::endl; \
+            g_test_failures++; \
+        } \
+    } while (0)
+
+#define CHECK_THROWS(expression, exception) \
+    do { \
+        bool thrown = false; \
+        try { expression; } catch (const exception&) { thrown = true; } \
+        if (!thrown) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": expected " #exception " from " #expression << std::endl; \
+            g_test_failures++; \
+        } \
+    } while (0)
+
+inline int test_result(const char* name) {
+    if (g_test_failures != 0) {
+        std::cerr << name << ": " << g_test_failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << name << ": ok" << std::endl;
+    return 0;
+}
+
+// The boot ROM scrolls the logo for this long before the cartridge's code runs
+static constexpr int BOOT_FRAMES = 400;
+
+// A ROM the boot ROM accepts, running `program` from 0150. `handlers` are copied to the
+// start of the ROM, so interrupt vectors (0040 - 0060) can be filled in. With
+// `bank_numbers` every bank after the first starts with its own number, so bank
+// switches are visible in reads.
+inline std::vector<uint8_t> make_test_rom(const std::vector<uint8_t>& program, const std::vector<uint8_t>& handlers = {},
+                                          uint8_t type = 0x00, uint8_t rom_size = 0, uint8_t ram_size = 0,
+                                          bool bank_numbers = false) {
+    static const uint8_t logo[48] = {
+        0xCE, 0xED, 0x66, 0x66, 0xCC, 0x0D, 0x00, 0x0B, 0x03, 0x73, 0x00, 0x83, 0x00, 0x0C, 0x00, 0x0D,
+        0x00, 0x08, 0x11, 0x1F, 0x88, 0x89, 0x00, 0x0E, 0xDC, 0xCC, 0x6E, 0xE6, 0xDD, 0xDD, 0xD9, 0x99,
+        0xBB, 0xBB, 0x67, 0x63, 0x6E, 0x0E, 0xEC, 0xCC, 0xDD, 0xDC, 0x99, 0x9F, 0xBB, 0xB9, 0x33, 0x3E
+    };
+    std::vector<uint8_t> rom(0x8000 << rom_size, 0x00);
+    std::copy(handlers.begin(), handlers.end(), rom.begin());
+    for (size_t bank = 1; bank_numbers && bank < rom.size() / 0x4000; bank++)
+        rom[bank * 0x4000] = bank;
+    rom[0x100] = 0x00;  // nop; jp 0150
+    rom[0x101] = 0xC3;
+    rom[0x102] = 0x50;
+    rom[0x103] = 0x01;
+    std::copy(logo, logo + 48, rom.begin() + 0x104);
+    rom[0x147] = type;
+    rom[0x148] = rom_size;
+    rom[0x149] = ram_size;
+    uint8_t checksum = 0;
+    for (int i = 0x134; i <= 0x14C; i++) checksum = checksum - rom[i] - 1;
+    rom[0x14D] = checksum;
+    std::copy(program.begin(), program.end(), rom.begin() + 0x150);
+    return rom;
+}
+
+// Keeps VRAM, WRAM and the scroll registers changing every frame
+inline std::vector<uint8_t> busy_program() {
+    return {
+        0x21, 0x00, 0x80,   // 0150: ld hl, 8000
+        0x06, 0x00,         // 0153: ld b, 0
+        0x78,               // 0155: ld a, b
+        0x22,               //       ld (hl+), a
+        0x04,               //       inc b
+        0x7C,               //       ld a, h
+        0xFE, 0xD0,         //       cp D0          (runs on through WRAM up to CFFF)
+        0x20, 0xF8,         //       jr nz, 0155
+        0x21, 0x00, 0x80,   //       ld hl, 8000
+        0xF0, 0x43,         //       ldh a, (SCX)
+        0x3C,               //       inc a
+        0xE0, 0x43,         //       ldh (SCX), a
+        0x04,               //       inc b
+        0x18, 0xED,         //       jr 0155
+    };
+}
+
+#endif // TEST_UTIL_H
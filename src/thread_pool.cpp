@@ -0,0 +1,88 @@
+#include "thread_pool.h"
+
+// Index of the pool worker running on this thread, so nested submits stay local
+static thread_local const ThreadPool* t_pool = nullptr;
+static thread_local size_t t_worker_index = 0;
+
+ThreadPool::ThreadPool(size_t threads) {
+    if (threads == 0) threads = 1;
+    for (size_t i = 0; i < threads; i++)
+        m_workers.push_back(std::make_unique<Worker>());
+    for (size_t i = 0; i < threads; i++)
+        m_workers[i]->thread = std::thread(&ThreadPool::run, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_work_available.notify_all();
+    for (auto& worker : m_workers)
+        worker->thread.join();
+}
+
+void ThreadPool::submit(Task task) {
+    size_t index = t_pool == this ? t_worker_index : m_next_worker++ % m_workers.size();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queued++;
+        m_pending++;
+    }
+    {
+        Worker& worker = *m_workers[index];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.tasks.push_back(std::move(task));
+    }
+    m_work_available.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_all_done.wait(lock, [this] { return m_pending == 0; });
+}
+
+bool ThreadPool::pop_local(size_t index, Task& task) {
+    Worker& worker = *m_workers[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.tasks.empty()) return false;
+    task = std::move(worker.tasks.back());
+    worker.tasks.pop_back();
+    return true;
+}
+
+bool ThreadPool::steal(size_t thief, Task& task) {
+    for (size_t i = 1; i < m_workers.size(); i++) {
+        Worker& victim = *m_workers[(thief + i) % m_workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.tasks.empty()) continue;
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::run(size_t index) {
+    t_pool = this;
+    t_worker_index = index;
+
+    while (true) {
+        Task task;
+        if (pop_local(index, task) || steal(index, task)) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_queued--;
+            }
+            task();
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (--m_pending == 0)
+                m_all_done.notify_all();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_work_available.wait(lock, [this] { return m_quit || m_queued > 0; });
+        if (m_quit) return;
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool.
+// Every worker owns a deque: it pushes and pops its own tasks at the back (hot in cache),
+// and when it runs dry it steals from the front of another worker's deque. Tasks submitted
+// from inside a task go to the current worker, so a job that re-queues its next slice
+// tends to stay on one core until someone else is idle.
+class ThreadPool
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit ThreadPool(size_t threads = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(Task task);
+    // Blocks until every submitted task, including ones submitted by tasks, has run
+    void wait();
+
+    inline size_t size() const { return m_workers.size(); }
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+
+    void run(size_t index);
+    bool pop_local(size_t index, Task& task);
+    bool steal(size_t thief, Task& task);
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::atomic<size_t> m_next_worker{0};
+
+    // Idle workers sleep here instead of spinning on empty deques
+    std::mutex m_mutex;
+    std::condition_variable m_work_available;
+    std::condition_variable m_all_done;
+    size_t m_queued = 0;     // tasks sitting in any deque
+    size_t m_pending = 0;    // tasks submitted but not finished
+    bool m_quit = false;
+};
+
+#endif // THREAD_POOL_H
@@ -3,7 +3,7 @@
 #include <stdexcept>
 
 Timer::Timer(MMU& mmu)
-    : m_div(0), m_tima(0), m_tma(0), m_tac(0), m_mmu(mmu) {
+    : m_div(0), m_tima(0), m_tma(0), m_tac(0), m_divider_counter(0), m_mmu(mmu) {
     m_timer_counter = cycles_per_tick();
 }
 
@@ -45,3 +45,21 @@ void Timer::tick(int cycles) {
 void Timer::reset_divider_register() {
     m_div = 0;
 }
+
+void Timer::save_state(State& state) const {
+    state.div = m_div;
+    state.tima = m_tima;
+    state.tma = m_tma;
+    state.tac = m_tac;
+    state.timer_counter = m_timer_counter;
+    state.divider_counter = m_divider_counter;
+}
+
+void Timer::load_state(const State& state) {
+    m_div = state.div;
+    m_tima = state.tima;
+    m_tma = state.tma;
+    m_tac = state.tac;
+    m_timer_counter = state.timer_counter;
+    m_divider_counter = state.divider_counter;
+}
@@ -9,12 +9,21 @@ class MMU;
 class Timer
 {
 public:
+    struct State {
+        uint8_t div, tima, tma, tac;
+        int timer_counter;
+        int divider_counter;
+    };
+
     Timer(MMU& mmu);
     uint8_t& operator[](const uint16_t addr);
 
     void tick(int cycles);
     void reset_divider_register();
 
+    void save_state(State& state) const;
+    void load_state(const State& state);
+
 private:
     // Timer registers
     uint8_t m_div;		// Divider register
@@ -0,0 +1,158 @@
+#include "trace.h"
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+struct TraceEvent {
+    enum Type : uint8_t { SPAN, INSTANT, COUNTER };
+
+    const char* name;
+    uint64_t begin_ns;
+    int64_t value;      // end_ns for spans
+    Type type;
+};
+
+struct ThreadBuffer {
+    std::unique_ptr<TraceEvent[]> events;
+    size_t capacity = 0;
+    std::atomic<size_t> count{0};       // recorded so far, event i sits in slot i % capacity
+    const char* name = nullptr;         // guarded by s_mutex
+    uint32_t tid = 0;
+};
+
+static std::mutex s_mutex;
+static std::vector<std::unique_ptr<ThreadBuffer>> s_buffers;
+static std::atomic<size_t> s_events_per_thread{0};
+static std::atomic<uint64_t> s_start_ns{0};
+static thread_local ThreadBuffer* t_buffer = nullptr;
+static thread_local const char* t_name = nullptr;
+
+static ThreadBuffer* thread_buffer() {
+    if (t_buffer) return t_buffer;
+
+    auto buffer = std::make_unique<ThreadBuffer>();
+    buffer->capacity = s_events_per_thread.load(std::memory_order_relaxed);
+    // Left uninitialized, pages only get touched as events arrive
+    buffer->events.reset(new TraceEvent[buffer->capacity]);
+    std::lock_guard<std::mutex> lock(s_mutex);
+    buffer->tid = s_buffers.size() + 1;
+    buffer->name = t_name;
+    t_buffer = buffer.get();
+    s_buffers.push_back(std::move(buffer));
+    return t_buffer;
+}
+
+static void record(const TraceEvent& event) {
+    ThreadBuffer* buffer = thread_buffer();
+    const size_t count = buffer->count.load(std::memory_order_relaxed);
+    buffer->events[count % buffer->capacity] = event;
+    buffer->count.store(count + 1, std::memory_order_release);
+}
+
+static void write_escaped(std::ostream& out, const char* text) {
+    out << '"';
+    for (const char* c = text; *c; c++) {
+        if (*c == '"' || *c == '\\') out << '\\';
+        out << *c;
+    }
+    out << '"';
+}
+
+// Chrome trace timestamps are microseconds, fractions keep the nanoseconds
+static void write_us(std::ostream& out, uint64_t ns) {
+    out << ns / 1000 << '.' << static_cast<char>('0' + ns / 100 % 10) << static_cast<char>('0' + ns / 10 % 10)
+        << static_cast<char>('0' + ns % 10);
+}
+
+void Tracer::start(size_t events_per_thread) {
+    s_events_per_thread.store(std::max<size_t>(1, events_per_thread), std::memory_order_relaxed);
+    uint64_t unset = 0;
+    s_start_ns.compare_exchange_strong(unset, now_ns());
+    s_enabled.store(true, std::memory_order_release);
+}
+
+void Tracer::stop() {
+    s_enabled.store(false, std::memory_order_release);
+}
+
+void Tracer::set_thread_name(const char* name) {
+    t_name = name;
+    if (!t_buffer) return;
+    std::lock_guard<std::mutex> lock(s_mutex);
+    t_buffer->name = name;
+}
+
+void Tracer::span(const char* name, uint64_t begin_ns, uint64_t end_ns) {
+    record(TraceEvent {name, begin_ns, static_cast<int64_t>(end_ns), TraceEvent::SPAN});
+}
+
+void Tracer::instant(const char* name, int64_t value) {
+    record(TraceEvent {name, now_ns(), value, TraceEvent::INSTANT});
+}
+
+void Tracer::counter(const char* name, int64_t value) {
+    record(TraceEvent {name, now_ns(), value, TraceEvent::COUNTER});
+}
+
+void Tracer::write(const std::string& path) {
+    std::ofstream out(path);
+    if (!out)
+        throw std::runtime_error("could not open " + path);
+
+    const uint64_t start_ns = s_start_ns.load(std::memory_order_relaxed);
+    auto since_start = [start_ns](uint64_t ns) { return ns > start_ns ? ns - start_ns : 0; };
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    uint64_t overwritten = 0;
+    std::vector<TraceEvent> events;
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    out << "{\"ph\":\"M\",\"pid\":1,\"name\":\"process_name\",\"args\":{\"name\":\"sleepy_boi\"}}";
+    for (const auto& buffer : s_buffers) {
+        if (buffer->name) {
+            out << ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid << ",\"name\":\"thread_name\",\"args\":{\"name\":";
+            write_escaped(out, buffer->name);
+            out << "}}";
+        }
+
+        // Copy the ring oldest first, then drop whatever its thread wrote over meanwhile
+        // (the slot it may be writing right now included)
+        const size_t capacity = buffer->capacity;
+        const size_t count = buffer->count.load(std::memory_order_acquire);
+        const size_t first = count > capacity ? count - capacity : 0;
+        events.clear();
+        for (size_t i = first; i < count; i++)
+            events.push_back(buffer->events[i % capacity]);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const size_t count_after = buffer->count.load(std::memory_order_relaxed);
+        const size_t valid = count_after + 1 > capacity ? count_after + 1 - capacity : 0;
+        const size_t skip = std::min(events.size(), valid > first ? valid - first : 0);
+        overwritten += first + skip;
+
+        for (size_t i = skip; i < events.size(); i++) {
+            const TraceEvent& event = events[i];
+            out << ",\n{\"pid\":1,\"tid\":" << buffer->tid << ",\"name\":";
+            write_escaped(out, event.name);
+            out << ",\"ts\":";
+            write_us(out, since_start(event.begin_ns));
+            switch (event.type) {
+            case TraceEvent::SPAN:
+                out << ",\"ph\":\"X\",\"dur\":";
+                write_us(out, static_cast<uint64_t>(event.value) - event.begin_ns);
+                out << "}";
+                break;
+            case TraceEvent::INSTANT:
+                out << ",\"ph\":\"i\",\"s\":\"t\",\"args\":{\"value\":" << event.value << "}}";
+                break;
+            case TraceEvent::COUNTER:
+                out << ",\"ph\":\"C\",\"args\":{\"value\":" << event.value << "}}";
+                break;
+            }
+        }
+    }
+    out << "\n],\"otherData\":{\"overwritten_events\":" << overwritten << "}}\n";
+    if (!out)
+        throw std::runtime_error("could not write " + path);
+}
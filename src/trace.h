@@ -0,0 +1,114 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Timeline of what the emulator threads did, written as Chrome Trace Event JSON that
+// chrome://tracing and ui.perfetto.dev open directly.
+//
+// Every thread records into a ring buffer of its own: the thread is the only writer and
+// publishes each event with one release store, so recording never takes a lock.
+// Buffers are allocated on a thread's first event after start() and kept until the
+// process exits, so write() still sees threads that have finished. A full buffer
+// overwrites its oldest events, the file keeps the run up to the end (the stutter being
+// chased) and counts what was overwritten. At 1x the emulator thread records about 19k
+// events per second, mostly one CPU slice and one draw_scanline span per scanline, so
+// the default buffer holds the last minute or so.
+//
+// The TRACE_* macros below are the way to instrument code. They compile to nothing
+// unless the build defines SLEEPY_BOI_TRACE (CMake option of the same name), and cost one
+// relaxed load while compiled in but not started.
+class Tracer
+{
+public:
+    // Starts recording, `events_per_thread` * 32 bytes get allocated per recording thread
+    static void start(size_t events_per_thread = 1 << 20);
+    static void stop();
+    static inline bool enabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+    // Writes everything recorded so far. Events being recorded while it runs may or may
+    // not make it in. Throws std::runtime_error on I/O errors.
+    static void write(const std::string& path);
+
+    // `name` and event names have to outlive the tracer, string literals are what they're for
+    static void set_thread_name(const char* name);
+    static void span(const char* name, uint64_t begin_ns, uint64_t end_ns);
+    static void instant(const char* name, int64_t value);
+    static void counter(const char* name, int64_t value);
+
+    static inline uint64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+private:
+    static inline std::atomic<bool> s_enabled{false};
+};
+
+// Cuts the enclosing scope into back-to-back spans, a new one whenever the key passed to
+// slice_at() changes. Used for the CPU's run through a frame, one slice per scanline.
+class TraceSlices
+{
+public:
+    TraceSlices(const char* name, int64_t key)
+        : m_name(name), m_key(key), m_begin_ns(Tracer::enabled() ? Tracer::now_ns() : 0) {}
+    ~TraceSlices() {
+        if (m_begin_ns != 0) Tracer::span(m_name, m_begin_ns, Tracer::now_ns());
+    }
+    TraceSlices(const TraceSlices&) = delete;
+    TraceSlices& operator=(const TraceSlices&) = delete;
+
+    inline void slice_at(int64_t key) {
+        if (key == m_key) return;
+        m_key = key;
+        if (m_begin_ns == 0) return;
+        const uint64_t now = Tracer::now_ns();
+        Tracer::span(m_name, m_begin_ns, now);
+        m_begin_ns = now;
+    }
+
+private:
+    const char* m_name;
+    int64_t m_key;
+    uint64_t m_begin_ns;
+};
+
+// Records the enclosing scope as a span
+class TraceScope
+{
+public:
+    explicit TraceScope(const char* name)
+        : m_name(name), m_begin_ns(Tracer::enabled() ? Tracer::now_ns() : 0) {}
+    ~TraceScope() {
+        if (m_begin_ns != 0) Tracer::span(m_name, m_begin_ns, Tracer::now_ns());
+    }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* m_name;
+    uint64_t m_begin_ns;
+};
+
+#ifdef SLEEPY_BOI_TRACE
+    #define SB_TRACE_CONCAT_(a, b) a##b
+    #define SB_TRACE_CONCAT(a, b) SB_TRACE_CONCAT_(a, b)
+    #define TRACE_SCOPE(name) TraceScope SB_TRACE_CONCAT(trace_scope_, __LINE__)(name)
+    #define TRACE_SLICES(var, name, key) TraceSlices var(name, key)
+    #define TRACE_SLICE_AT(var, key) var.slice_at(key)
+    #define TRACE_INSTANT(name, value) do { if (Tracer::enabled()) Tracer::instant(name, value); } while (0)
+    #define TRACE_COUNTER(name, value) do { if (Tracer::enabled()) Tracer::counter(name, value); } while (0)
+    #define TRACE_THREAD_NAME(name) Tracer::set_thread_name(name)
+#else
+    #define TRACE_SCOPE(name) ((void)0)
+    #define TRACE_SLICES(var, name, key) ((void)0)
+    #define TRACE_SLICE_AT(var, key) ((void)0)
+    #define TRACE_INSTANT(name, value) ((void)0)
+    #define TRACE_COUNTER(name, value) ((void)0)
+    #define TRACE_THREAD_NAME(name) ((void)0)
+#endif
+
+#endif // TRACE_H
@@ -0,0 +1,43 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Lock-free triple buffer for one writer thread and one reader thread.
+// The writer fills back() and publishes it with a single atomic swap; the reader always
+// gets the most recently published slot, never one that is still being written.
+template<typename T>
+class TripleBuffer
+{
+public:
+    // writer side
+    inline T& back() { return m_slots[m_back]; }
+
+    void publish() {
+        m_back = m_middle.exchange(m_back | FRESH_BIT, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // reader side
+    const T& latest() {
+        if ((m_middle.load(std::memory_order_relaxed) & FRESH_BIT) != 0)
+            m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & INDEX_MASK;
+        return m_slots[m_front];
+    }
+
+    inline bool has_fresh() const {
+        return (m_middle.load(std::memory_order_relaxed) & FRESH_BIT) != 0;
+    }
+
+private:
+    static constexpr uint8_t INDEX_MASK = 0b11;
+    static constexpr uint8_t FRESH_BIT = 0b100;
+
+    std::array<T, 3> m_slots;
+    uint8_t m_back = 0;
+    alignas(64) std::atomic<uint8_t> m_middle{1};
+    alignas(64) uint8_t m_front = 2;
+};
+
+#endif // TRIPLE_BUFFER_H
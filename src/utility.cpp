@@ -6,6 +6,14 @@ std::string to_hex(int num, int d) {
     return ss.str();
 }
 
+uint64_t fnv1a_hash(const uint8_t* data, size_t size, uint64_t hash) {
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
 CartridgeType get_cartridge_type(std::vector<uint8_t> rom_data) {
     switch (rom_data[0x0147]) {
     case 0x00:
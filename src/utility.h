@@ -10,4 +10,7 @@
 
 std::string to_hex(int num, int d = 2);
 
+// 64-bit FNV-1a, used to identify ROMs and to fingerprint emulator state
+uint64_t fnv1a_hash(const uint8_t* data, size_t size, uint64_t hash = 14695981039346656037ull);
+
 #endif // UTILITY_H
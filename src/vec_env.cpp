@@ -0,0 +1,149 @@
+#include "vec_env.h"
+#include <algorithm>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+
+// FB_COLOR -> luminance. An LCD that is off shows as white.
+static constexpr uint8_t SHADE_TO_GRAY[5] = {255, 255, 170, 85, 0};
+static constexpr size_t FRAME_PIXELS = Framebuffer::WIDTH * Framebuffer::HEIGHT;
+// What a frame looks like when the LCD was off for it, every pixel FB_OFF
+static const uint8_t LCD_OFF_FRAME[FRAME_PIXELS] = {};
+
+VecEnv::VecEnv(const Gameboy& start, const VecEnvConfig& config)
+    : m_config(config), m_pool(std::max<size_t>(1, std::min<size_t>(config.threads, config.num_envs))) {
+    if (config.num_envs <= 0)
+        throw std::invalid_argument("invalid argument. a VecEnv needs at least one environment");
+    if (config.frame_skip <= 0)
+        throw std::invalid_argument("invalid argument. frame skip must be at least 1");
+    if (config.downsample != 1 && config.downsample != 2 && config.downsample != 4)
+        throw std::invalid_argument("invalid argument. downsample must be 1, 2 or 4");
+
+    m_obs_width = Framebuffer::WIDTH / config.downsample;
+    m_obs_height = Framebuffer::HEIGHT / config.downsample;
+    m_observations.resize(config.num_envs * obs_size());
+    if (config.max_pool && config.frame_skip > 1)
+        m_pooled.resize(config.num_envs * FRAME_PIXELS);
+    m_ram_features.resize(config.num_envs * config.ram_addresses.size());
+
+    start.SaveState(m_start_state);
+    for (int i = 0; i < config.num_envs; i++) {
+        m_envs.push_back(start.clone());
+        m_envs.back()->SetRunning(true);
+        m_envs.back()->SetRunAhead(0);
+        m_envs.back()->SetSerialCapture(true);
+    }
+    reset();
+}
+
+template<typename F>
+void VecEnv::parallel_for(F f) {
+    const int envs = m_config.num_envs;
+    const int chunks = static_cast<int>(m_pool.size());
+    // An exception can't leave a pool thread, the first one is rethrown here once every
+    // env has had its turn
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    for (int chunk = 0; chunk < chunks; chunk++) {
+        const int begin = envs * chunk / chunks;
+        const int end = envs * (chunk + 1) / chunks;
+        m_pool.submit([f, begin, end, &error, &error_mutex] {
+            for (int env = begin; env < end; env++) {
+                try {
+                    f(env);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    if (!error) error = std::current_exception();
+                }
+            }
+        });
+    }
+    m_pool.wait();
+    if (error) std::rethrow_exception(error);
+}
+
+void VecEnv::reset() {
+    parallel_for([this](int env) { reset(env); });
+}
+
+void VecEnv::reset(int env) {
+    Gameboy& gb = *m_envs[env];
+    gb.LoadState(m_start_state);
+    // The start state carries no pixels, draw one frame so there is something to observe
+    gb.SetRendering(true);
+    observe(env, draw_frame(gb));
+    read_ram(env);
+}
+
+void VecEnv::step(const uint8_t* actions) {
+    parallel_for([this, actions](int env) { step_env(env, actions[env]); });
+}
+
+void VecEnv::step_env(int env, uint8_t action) {
+    Gameboy& gb = *m_envs[env];
+    gb.SetButtons(action);
+
+    // Only the frames that end up in the observation get drawn
+    const int drawn = m_config.max_pool ? std::min(2, m_config.frame_skip) : 1;
+    for (int i = 0; i < m_config.frame_skip; i++) {
+        const int frames_left = m_config.frame_skip - i;
+        gb.SetRendering(frames_left <= drawn);
+        if (frames_left > drawn) {
+            gb.Update();
+            continue;
+        }
+        const uint8_t* shades = draw_frame(gb);
+        if (drawn == 1) {
+            observe(env, shades);
+        } else if (frames_left == 2) {
+            std::copy(shades, shades + FRAME_PIXELS, m_pooled.data() + env * FRAME_PIXELS);
+        } else {
+            max_pool(env, shades);
+            observe(env, m_pooled.data() + env * FRAME_PIXELS);
+        }
+    }
+    read_ram(env);
+}
+
+// Runs one frame. Nothing is published while the LCD is off, so a frame that didn't come
+// out of this Update is the LCD off frame rather than whatever was published last.
+const uint8_t* VecEnv::draw_frame(Gameboy& gb) {
+    const uint64_t sequence = gb.GetFrame().sequence;
+    gb.Update();
+    return gb.GetFrame().sequence != sequence ? gb.GetFramebuffer() : LCD_OFF_FRAME;
+}
+
+// Pools at full size before downsampling, keeping the darker shade of every pixel. DMG
+// sprites are dark on a light background, so one that flickers stays in the observation.
+void VecEnv::max_pool(int env, const uint8_t* shades) {
+    uint8_t* pooled = m_pooled.data() + env * FRAME_PIXELS;
+    for (size_t i = 0; i < FRAME_PIXELS; i++) {
+        if (SHADE_TO_GRAY[shades[i]] < SHADE_TO_GRAY[pooled[i]])
+            pooled[i] = shades[i];
+    }
+}
+
+void VecEnv::observe(int env, const uint8_t* shades) {
+    uint8_t* out = m_observations.data() + env * obs_size();
+    const int scale = m_config.downsample;
+    const bool gray = m_config.grayscale;
+
+    for (int y = 0; y < m_obs_height; y++) {
+        for (int x = 0; x < m_obs_width; x++) {
+            int sum = 0;
+            for (int dy = 0; dy < scale; dy++) {
+                const uint8_t* row = shades + (y * scale + dy) * Framebuffer::WIDTH + x * scale;
+                for (int dx = 0; dx < scale; dx++)
+                    sum += gray ? SHADE_TO_GRAY[row[dx]] : row[dx];
+            }
+            out[y * m_obs_width + x] = static_cast<uint8_t>(sum / (scale * scale));
+        }
+    }
+}
+
+void VecEnv::read_ram(int env) {
+    const std::vector<uint16_t>& addresses = m_config.ram_addresses;
+    uint8_t* out = m_ram_features.data() + env * addresses.size();
+    for (size_t i = 0; i < addresses.size(); i++)
+        out[i] = m_envs[env]->ReadMemory(addresses[i]);
+}
@@ -0,0 +1,80 @@
+#ifndef VEC_ENV_H
+#define VEC_ENV_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "gameboy.h"
+#include "thread_pool.h"
+
+struct VecEnvConfig {
+    int num_envs = 8;
+    // Emulated frames per step, the action is held for all of them
+    int frame_skip = 4;
+    // Observation keeps the darker of the last two frames of a step for every pixel (hides
+    // sprite flicker). Shades are compared by luminance, also when grayscale is false.
+    bool max_pool = true;
+    // Observation size is 160/downsample x 144/downsample, pixels are box-averaged. 1, 2 or 4.
+    int downsample = 1;
+    // true: 0 (black) - 255 (white) luminance, false: raw FB_COLOR shade indices.
+    // A frame the LCD was off for is all FB_OFF (white).
+    bool grayscale = true;
+    // Bytes read after every step, e.g. score or position variables
+    std::vector<uint16_t> ram_addresses;
+    size_t threads = std::thread::hardware_concurrency();
+};
+
+// Steps a batch of Gameboys with one call, for reinforcement learning.
+// All instances start as clones of one Gameboy and share its ROM. Observations and RAM
+// features are written into contiguous buffers owned by the VecEnv, laid out
+// [env][y][x] and [env][address] so they can be handed to a tensor library as they are.
+class VecEnv
+{
+public:
+    VecEnv(const Gameboy& start, const VecEnvConfig& config);
+
+    // Puts every instance (or one) back to the start state and refreshes its observation
+    void reset();
+    void reset(int env);
+
+    // `actions` holds num_envs() button masks (one bit per Joypad::Button).
+    // If an instance throws, the others still finish the step and the first exception is
+    // rethrown. The instances that threw are left mid-step, reset them before going on.
+    void step(const uint8_t* actions);
+
+    inline int num_envs() const { return m_config.num_envs; }
+    inline int obs_width() const { return m_obs_width; }
+    inline int obs_height() const { return m_obs_height; }
+    inline size_t obs_size() const { return static_cast<size_t>(m_obs_width) * m_obs_height; }
+    inline const uint8_t* observations() const { return m_observations.data(); }
+    inline const uint8_t* observation(int env) const { return m_observations.data() + env * obs_size(); }
+    inline const uint8_t* ram_features() const { return m_ram_features.data(); }
+
+    inline Gameboy& env(int index) { return *m_envs[index]; }
+
+private:
+    void step_env(int env, uint8_t action);
+    const uint8_t* draw_frame(Gameboy& gb);
+    void max_pool(int env, const uint8_t* shades);
+    void observe(int env, const uint8_t* shades);
+    void read_ram(int env);
+    // Runs `f(env)` for every env, split into one contiguous chunk per thread
+    template<typename F> void parallel_for(F f);
+
+    VecEnvConfig m_config;
+    int m_obs_width;
+    int m_obs_height;
+
+    GameboyState m_start_state;
+    std::vector<std::unique_ptr<Gameboy>> m_envs;
+    std::vector<uint8_t> m_observations;
+    // Full size frames, the first of the two frames being pooled for every env
+    std::vector<uint8_t> m_pooled;
+    std::vector<uint8_t> m_ram_features;
+
+    ThreadPool m_pool;
+};
+
+#endif // VEC_ENV_H
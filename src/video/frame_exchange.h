@@ -0,0 +1,47 @@
+#ifndef FRAME_EXCHANGE_H
+#define FRAME_EXCHANGE_H
+
+#include <cstdint>
+#include "../triple_buffer.h"
+#include "framebuffer.h"
+
+struct Frame
+{
+    Framebuffer framebuffer;
+    uint64_t sequence = 0;  // 1 for the first published frame, 0 if nothing was published yet
+    uint64_t cycle = 0;     // PPU cycle count when the frame was finished
+};
+
+// Hands completed frames from the PPU (writer) to the presentation side (reader)
+// without locks, copies or tearing. One writer thread and one reader thread at a time.
+class FrameExchange
+{
+public:
+    // writer side
+    inline Framebuffer& back() { return m_frames.back().framebuffer; }
+
+    void publish(uint64_t cycle) {
+        Frame& frame = m_frames.back();
+        frame.sequence = ++m_sequence;
+        frame.cycle = cycle;
+        if (m_tap) {
+            m_tap->m_frames.back() = frame;
+            m_tap->m_frames.publish();
+        }
+        m_frames.publish();
+    }
+
+    // Every published frame is also copied into `tap`, by the writer, so a second reader
+    // gets frames of its own. Only change it while nothing is publishing.
+    inline void set_tap(FrameExchange* tap) { m_tap = tap; }
+
+    // reader side
+    inline const Frame& latest() { return m_frames.latest(); }
+
+private:
+    TripleBuffer<Frame> m_frames;
+    uint64_t m_sequence = 0;
+    FrameExchange* m_tap = nullptr;
+};
+
+#endif // FRAME_EXCHANGE_H
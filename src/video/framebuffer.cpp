@@ -1,42 +1,36 @@
 #include "framebuffer.h"
+#include <cstring>
 
 Framebuffer::Framebuffer() {
     reset();
 }
 
 void Framebuffer::reset() {
-    for (int i = 0; i < 160; i++)
-        for (int j = 0; j < 144; j++)
-            set_pixel(i, j, FB_COLOR::FB_OFF);
+    std::memset(m_buffer, static_cast<uint8_t>(FB_COLOR::FB_OFF), sizeof(m_buffer));
 }
 
-void Framebuffer::set_pixel(int x, int y, FB_COLOR color) {
-    if (x < 0 || x >= 160 || y < 0 || y >= 144)
-        return;
+void Framebuffer::to_rgb(uint8_t* rgb) const {
+    // indexed by FB_COLOR
+    static constexpr uint8_t palette[5][3] = {
+        { 77,  77, 77},     // FB_OFF
+        {255, 187,  0},     // FB_WHITE
+        {168, 123,  0},     // FB_LIGHT_GRAY
+        {102,  75,  0},     // FB_DARK_GRAY
+        {  0,   0,  0}      // FB_BLACK
+    };
 
-    int r, g, b;
-    switch (color) {
-    case FB_COLOR::FB_BLACK:
-        r = 0, g = 0, b = 0;
-        break;
-    case FB_COLOR::FB_DARK_GRAY:
-        r = 102, g = 75, b = 0;
-        break;
-    case FB_COLOR::FB_LIGHT_GRAY:
-        r = 168, g = 123, b = 0;
-        break;
-    case FB_COLOR::FB_WHITE:
-        r = 255, g = 187, b = 0;
-        break;
-    case FB_COLOR::FB_OFF:
-        r = 77, g = 77, b = 77;
+    for (int i = 0; i < WIDTH*HEIGHT; i++) {
+        const uint8_t* color = palette[m_buffer[i]];
+        rgb[i*3 + 0] = color[0];
+        rgb[i*3 + 1] = color[1];
+        rgb[i*3 + 2] = color[2];
     }
-
-    m_buffer[(x + 160*y)*3 + 0] = r;
-    m_buffer[(x + 160*y)*3 + 1] = g;
-    m_buffer[(x + 160*y)*3 + 2] = b;
 }
 
 uint8_t* Framebuffer::get_buffer_ptr() {
     return m_buffer;
 }
+
+const uint8_t* Framebuffer::get_buffer_ptr() const {
+    return m_buffer;
+}
@@ -3,7 +3,7 @@
 
 #include <cstdint>
 
-enum class FB_COLOR {
+enum class FB_COLOR : uint8_t {
     FB_OFF,
     FB_WHITE,
     FB_LIGHT_GRAY,
@@ -11,15 +11,27 @@ enum class FB_COLOR {
     FB_BLACK
 };
 
+// One FB_COLOR per pixel. Turning shades into RGB is left to whoever displays the frame,
+// which keeps the framebuffer a third of the size and the PPU's stores to single bytes.
 class Framebuffer
 {
 public:
+    static constexpr int WIDTH = 160;
+    static constexpr int HEIGHT = 144;
+
     Framebuffer();
-    void set_pixel(int x, int y, FB_COLOR color);
+    inline void set_pixel(int x, int y, FB_COLOR color) {
+        if (x < 0 || x >= WIDTH || y < 0 || y >= HEIGHT)
+            return;
+        m_buffer[x + WIDTH*y] = static_cast<uint8_t>(color);
+    }
     uint8_t* get_buffer_ptr();
+    const uint8_t* get_buffer_ptr() const;
+    // Expands the frame into WIDTH*HEIGHT RGB888 pixels
+    void to_rgb(uint8_t* rgb) const;
     void reset();
 private:
-    uint8_t m_buffer[160*144*3];
+    uint8_t m_buffer[WIDTH*HEIGHT];
 };
 
 #endif // FRAMEBUFFER_H
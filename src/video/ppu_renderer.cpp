@@ -0,0 +1,161 @@
+#include "ppu_renderer.h"
+#include "../trace.h"
+#include <algorithm>
+#include <stdexcept>
+
+uint8_t& PPURegisters::operator[](const uint16_t addr) {
+    switch (addr) {
+    case 0xFF40: return lcd_control;
+    case 0xFF41: return lcd_status;
+    case 0xFF42: return scroll_y;
+    case 0xFF43: return scroll_x;
+    case 0xFF44: return ly;
+    case 0xFF45: return ly_compare;
+    case 0xFF47: return bg_pallet;
+    case 0xFF48: return obj_pallet0;
+    case 0xFF49: return obj_pallet1;
+    case 0xFF4A: return winy;
+    case 0xFF4B: return winx;
+    }
+
+    throw std::invalid_argument("invalid argument. out-of-bounds of memory map of video subsystem");
+}
+
+void PPURenderer::draw_scanline(const uint8_t* vram, const uint8_t* oam, const PPURegisters& regs, Framebuffer& framebuffer) {
+    TRACE_SCOPE("PPURenderer::draw_scanline");
+    uint8_t bg_colors[Framebuffer::WIDTH] = {};
+    if ((regs.lcd_control & LCD_CTRL_BG_EN) != 0) {
+        render_tiles(vram, regs, framebuffer, bg_colors);
+    } else {
+        // background (and window) off shows white, the back buffer still holds an old frame
+        for (int x = 0; x < Framebuffer::WIDTH; x++)
+            framebuffer.set_pixel(x, regs.ly, FB_COLOR::FB_WHITE);
+    }
+    if ((regs.lcd_control & LCD_CTRL_OBJ_EN) != 0)
+        render_sprites(vram, oam, regs, framebuffer, bg_colors);
+}
+
+void PPURenderer::render_tiles(const uint8_t* vram, const PPURegisters& regs, Framebuffer& framebuffer, uint8_t* bg_colors) {
+    uint16_t tiledata_address = 0;
+    uint16_t tilemap_address = 0;
+    uint8_t corrected_winx = regs.winx - 7;
+    bool unsigned_index = true;
+    bool drawing_window = false;
+
+    if ((regs.lcd_control & LCD_CTRL_WIN_EN) != 0 && regs.winy <= regs.ly)
+        drawing_window = true;
+
+    if ((regs.lcd_control & LCD_CTRL_BG_WIN_TILE_DATA_SELECT) != 0) {
+        unsigned_index = true;
+        tiledata_address = 0x8000;
+    } else {
+        unsigned_index = false;
+        tiledata_address = 0x8800;
+    }
+
+    uint16_t x_pos, y_pos; // where in the 256x256 space are we drawing?
+    uint16_t tile_row, tile_col; // which of the 32x32 tile are we drawing?
+    if (drawing_window) {
+        // drawing window
+        if ((regs.lcd_control & LCD_CTRL_WIN_TILEMAP_DISP_SELECT) != 0) {
+            tilemap_address = 0x9C00;
+        } else {
+            tilemap_address = 0x9800;
+        }
+        y_pos = regs.ly - regs.winy;
+    } else {
+        // drawing background
+        if ((regs.lcd_control & LCD_CTRL_BG_TILEMAP_DISP_SELECT) != 0) {
+            tilemap_address = 0x9C00;
+        } else {
+            tilemap_address = 0x9800;
+        }
+        y_pos = regs.ly + regs.scroll_y;
+    }
+    tile_row = (y_pos / 8) % 32;
+
+    // every address below is inside 8000 - 9FFF, so index the VRAM image directly
+    auto vram_at = [vram](uint16_t address) -> uint8_t { return vram[(address - 0x8000) & 0x1FFF]; };
+
+    for (int x = 0; x < 160; x++) {
+        x_pos = x + regs.scroll_x;
+        if (drawing_window && (x_pos >= corrected_winx))
+            x_pos = x - corrected_winx;
+        tile_col = (x_pos / 8) % 32;
+        int16_t tile_idx;
+        if (unsigned_index)
+            tile_idx = (uint8_t)vram_at(tilemap_address + tile_row * 32 + tile_col);
+        else
+            tile_idx = (int8_t)vram_at(tilemap_address + tile_row * 32 + tile_col);
+        uint16_t tile_address = tiledata_address + (unsigned_index? tile_idx * 16 : (tile_idx + 128)*16);
+        uint8_t tile_line = y_pos % 8;
+
+        uint8_t tile_data1 = vram_at(tile_address + 2*tile_line);
+        uint8_t tile_data2 = vram_at(tile_address + 2*tile_line + 1);
+
+        uint8_t color_bit = 7 - (x_pos % 8);
+        uint8_t color_number = ((tile_data2 >> (color_bit - 1)) & 0b10) | ((tile_data1 >> color_bit) & 0b1);
+        bg_colors[x] = color_number;
+        FB_COLOR color = get_color_from_pallet(color_number, regs.bg_pallet);
+        int y = regs.ly;
+        framebuffer.set_pixel(x, y, color);
+    }
+}
+
+void PPURenderer::render_sprites(const uint8_t* vram, const uint8_t* oam, const PPURegisters& regs, Framebuffer& framebuffer, const uint8_t* bg_colors) {
+    constexpr uint8_t ATTR_BEHIND_BG = (1 << 7);
+    constexpr uint8_t ATTR_Y_FLIP = (1 << 6);
+    constexpr uint8_t ATTR_X_FLIP = (1 << 5);
+    constexpr uint8_t ATTR_PALLET1 = (1 << 4);
+    constexpr int MAX_SPRITES_PER_LINE = 10;
+
+    const int height = (regs.lcd_control & LCD_CTRL_OBJ_SIZE) != 0 ? 16 : 8;
+    const int ly = regs.ly;
+
+    // the first 10 sprites in OAM order that cover this line
+    int visible[MAX_SPRITES_PER_LINE];
+    int visible_count = 0;
+    for (int i = 0; i < 40 && visible_count < MAX_SPRITES_PER_LINE; i++) {
+        const int y = oam[i * 4] - 16;
+        if (ly >= y && ly < y + height)
+            visible[visible_count++] = i;
+    }
+
+    // lower x wins, then lower OAM index. Drawing the losers first lets the winners overwrite them
+    std::stable_sort(visible, visible + visible_count, [oam](int a, int b) { return oam[a * 4 + 1] < oam[b * 4 + 1]; });
+    for (int n = visible_count - 1; n >= 0; n--) {
+        const uint8_t* sprite = oam + visible[n] * 4;
+        const int x = sprite[1] - 8;
+        const uint8_t attributes = sprite[3];
+        uint8_t tile = sprite[2];
+        if (height == 16)
+            tile &= 0xFE;
+
+        int line = ly - (sprite[0] - 16);
+        if ((attributes & ATTR_Y_FLIP) != 0)
+            line = height - 1 - line;
+        // sprite tiles always use unsigned indexing from 8000
+        const uint8_t tile_data1 = vram[tile * 16 + line * 2];
+        const uint8_t tile_data2 = vram[tile * 16 + line * 2 + 1];
+        const uint8_t pallet = (attributes & ATTR_PALLET1) != 0 ? regs.obj_pallet1 : regs.obj_pallet0;
+
+        for (int px = 0; px < 8; px++) {
+            const int screen_x = x + px;
+            if (screen_x < 0 || screen_x >= Framebuffer::WIDTH)
+                continue;
+            const uint8_t color_bit = (attributes & ATTR_X_FLIP) != 0 ? px : 7 - px;
+            const uint8_t color_number = (((tile_data2 >> color_bit) & 1) << 1) | ((tile_data1 >> color_bit) & 1);
+            // colour 0 is transparent
+            if (color_number == 0)
+                continue;
+            if ((attributes & ATTR_BEHIND_BG) != 0 && bg_colors[screen_x] != 0)
+                continue;
+            framebuffer.set_pixel(screen_x, ly, get_color_from_pallet(color_number, pallet));
+        }
+    }
+}
+
+FB_COLOR PPURenderer::get_color_from_pallet(uint8_t color, uint8_t pallet) {
+    FB_COLOR color_arr[] = {FB_COLOR::FB_WHITE, FB_COLOR::FB_LIGHT_GRAY, FB_COLOR::FB_DARK_GRAY, FB_COLOR::FB_BLACK};
+    return color_arr[(pallet >> (color * 2)) & 0b11];
+}
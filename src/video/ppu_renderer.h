@@ -0,0 +1,51 @@
+#ifndef PPU_RENDERER_H
+#define PPU_RENDERER_H
+
+#include <cstdint>
+#include "framebuffer.h"
+
+// LCD registers (FF40 - FF4B, except DMA at FF46)
+struct PPURegisters
+{
+    uint8_t lcd_control = 0x91;
+    uint8_t lcd_status = 0;
+    uint8_t scroll_y = 0;
+    uint8_t scroll_x = 0;
+    uint8_t ly = 0;
+    uint8_t ly_compare = 0;
+    uint8_t bg_pallet = 0xFC;
+    uint8_t obj_pallet0 = 0xFF;
+    uint8_t obj_pallet1 = 0xFF;
+    uint8_t winy = 0;
+    uint8_t winx = 0;
+
+    uint8_t& operator[](const uint16_t addr);
+};
+
+// Draws scanlines out of a VRAM/OAM image and a set of LCD registers. It holds no state
+// of its own, so it can render from the live MMU or from a replayed copy on another thread.
+class PPURenderer
+{
+public:
+    static constexpr uint8_t LCD_CTRL_ENABLE = (1 << 7);
+    static constexpr uint8_t LCD_CTRL_WIN_TILEMAP_DISP_SELECT = (1 << 6);
+    static constexpr uint8_t LCD_CTRL_WIN_EN = (1 << 5);
+    static constexpr uint8_t LCD_CTRL_BG_WIN_TILE_DATA_SELECT = (1 << 4);
+    static constexpr uint8_t LCD_CTRL_BG_TILEMAP_DISP_SELECT = (1 << 3);
+    static constexpr uint8_t LCD_CTRL_OBJ_SIZE = (1 << 2);
+    static constexpr uint8_t LCD_CTRL_OBJ_EN = (1 << 1);
+    static constexpr uint8_t LCD_CTRL_BG_EN = 1;
+
+    // vram : 8 KiB image of 8000 - 9FFF
+    // oam  : 160 byte image of FE00 - FE9F
+    static void draw_scanline(const uint8_t* vram, const uint8_t* oam, const PPURegisters& regs, Framebuffer& framebuffer);
+
+private:
+    // bg_colors gets the unpalleted colour number of every background pixel on the line,
+    // sprites with the behind-background flag only show through colour 0
+    static void render_tiles(const uint8_t* vram, const PPURegisters& regs, Framebuffer& framebuffer, uint8_t* bg_colors);
+    static void render_sprites(const uint8_t* vram, const uint8_t* oam, const PPURegisters& regs, Framebuffer& framebuffer, const uint8_t* bg_colors);
+    static FB_COLOR get_color_from_pallet(uint8_t color, uint8_t pallet);
+};
+
+#endif // PPU_RENDERER_H
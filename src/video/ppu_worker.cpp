@@ -0,0 +1,99 @@
+#include "ppu_worker.h"
+#include "../trace.h"
+#include <algorithm>
+#include <chrono>
+
+PPUWorker::PPUWorker() {
+    m_vram.fill(0);
+    m_oam.fill(0);
+}
+
+PPUWorker::~PPUWorker() {
+    stop();
+}
+
+void PPUWorker::start(const uint8_t* vram, const uint8_t* oam, const PPURegisters& regs, FrameExchange* frames) {
+    if (m_thread.joinable()) return;
+
+    std::copy(vram, vram + m_vram.size(), m_vram.begin());
+    std::copy(oam, oam + m_oam.size(), m_oam.begin());
+    m_regs = regs;
+    m_frames = frames;
+
+    m_thread = std::thread(&PPUWorker::run, this);
+}
+
+void PPUWorker::stop() {
+    if (!m_thread.joinable()) return;
+
+    push(Event {0, 0, 0, EventType::STOP});
+    m_thread.join();
+}
+
+void PPUWorker::push(const Event& event) {
+    // The log only fills up if the worker is more than a frame behind, let it catch up
+    while (!m_log.push(event))
+        std::this_thread::yield();
+}
+
+void PPUWorker::log_write(uint64_t cycle, uint16_t address, uint8_t value) {
+    push(Event {cycle, address, value, EventType::WRITE});
+}
+
+void PPUWorker::log_scanline(uint64_t cycle, uint8_t ly) {
+    push(Event {cycle, 0, ly, EventType::SCANLINE});
+}
+
+void PPUWorker::log_frame_end(uint64_t cycle) {
+    push(Event {cycle, 0, 0, EventType::FRAME_END});
+}
+
+void PPUWorker::log_reset(uint64_t cycle) {
+    push(Event {cycle, 0, 0, EventType::RESET});
+}
+
+void PPUWorker::apply_write(uint16_t address, uint8_t value) {
+    if (address >= 0x8000 && address <= 0x9FFF) {
+        m_vram[address - 0x8000] = value;
+    } else if (address >= 0xFE00 && address <= 0xFE9F) {
+        m_oam[address - 0xFE00] = value;
+    } else if (address >= 0xFF40 && address <= 0xFF4B && address != 0xFF46) {
+        m_regs[address] = value;
+    }
+}
+
+void PPUWorker::run() {
+    TRACE_THREAD_NAME("ppu worker");
+    Event event;
+    int idle_polls = 0;
+    while (true) {
+        if (!m_log.pop(event)) {
+            // Spin briefly while the CPU thread is mid-frame, back off once it goes quiet
+            if (++idle_polls < 64)
+                std::this_thread::yield();
+            else
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            continue;
+        }
+        idle_polls = 0;
+
+        switch (event.type) {
+        case EventType::WRITE:
+            apply_write(event.address, event.value);
+            break;
+        case EventType::SCANLINE:
+            m_regs.ly = event.value;
+            PPURenderer::draw_scanline(m_vram.data(), m_oam.data(), m_regs, m_frames->back());
+            break;
+        case EventType::FRAME_END:
+            m_frames->publish(event.cycle);
+            break;
+        case EventType::RESET:
+            m_frames->back().reset();
+            m_frames->publish(event.cycle);
+            break;
+        case EventType::STOP:
+            return;
+        }
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef PPU_WORKER_H
+#define PPU_WORKER_H
+
+#include <array>
+#include <cstdint>
+#include <thread>
+#include "../spsc_ring.h"
+#include "frame_exchange.h"
+#include "ppu_renderer.h"
+
+// Renders pixels on a second thread.
+// The CPU thread logs every VRAM/OAM/LCD register write with the cycle it happened at,
+// plus a marker whenever a scanline has to be drawn. The worker replays the log in order
+// against its own copy of VRAM/OAM/registers, so it draws frame N while the CPU thread is
+// already emulating frame N+1. Interrupt and STAT timing never leave the CPU thread.
+class PPUWorker
+{
+public:
+    PPUWorker();
+    ~PPUWorker();
+
+    // Seeds the worker with the current video state and spawns the thread.
+    // The worker becomes the writer of `frames` until stop() returns.
+    void start(const uint8_t* vram, const uint8_t* oam, const PPURegisters& regs, FrameExchange* frames);
+    void stop();
+
+    // CPU thread only
+    void log_write(uint64_t cycle, uint16_t address, uint8_t value);
+    void log_scanline(uint64_t cycle, uint8_t ly);
+    void log_frame_end(uint64_t cycle);
+    void log_reset(uint64_t cycle);
+
+private:
+    enum class EventType : uint8_t {
+        WRITE,
+        SCANLINE,
+        FRAME_END,
+        RESET,
+        STOP
+    };
+
+    struct Event {
+        uint64_t cycle;
+        uint16_t address;
+        uint8_t value;
+        EventType type;
+    };
+
+    // Enough room for a full frame of VRAM traffic before the CPU thread has to wait
+    static constexpr size_t LOG_CAPACITY = 1 << 16;
+
+    void push(const Event& event);
+    void apply_write(uint16_t address, uint8_t value);
+    void run();
+
+    SPSCRing<Event, LOG_CAPACITY> m_log;
+
+    // worker-owned copy of the video state
+    std::array<uint8_t, 0x2000> m_vram;
+    std::array<uint8_t, 0xA0> m_oam;
+    PPURegisters m_regs;
+    FrameExchange* m_frames = nullptr;
+
+    std::thread m_thread;
+};
+
+#endif // PPU_WORKER_H
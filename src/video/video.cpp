@@ -1,69 +1,58 @@
 #include "video.h"
 #include "../cpu/interrupt_controller.h"
+#include "../trace.h"
 #include <stdexcept>
 
 Video::Video(MMU& mmu)
     :m_scanline_counter(0), m_mmu(mmu) { }
 
 uint8_t& Video::operator[](const int addr) {
-    switch (addr) {
-    case 0xFF40: return m_lcd_control;
-    case 0xFF41: return m_lcd_status;
-    case 0xFF42: return m_scroll_y;
-    case 0xFF43: return m_scroll_x;
-    case 0xFF44: return m_ly;
-    case 0xFF45: return m_ly_compare;
-    case 0xFF47: return m_bg_pallet;
-    case 0xFF48: return m_obj_pallet0;
-    case 0xFF49: return m_obj_pallet1;
-    case 0xFF4A: return m_winy;
-    case 0xFF4B: return m_winx;
-    }
-
-    throw std::invalid_argument("invalid argument. out-of-bounds of memory map of video subsystem");
+    return m_regs[addr];
 }
 
 bool Video::is_lcd_enabled() {
-    return (m_lcd_control >> 7) == 1;
+    return (m_regs.lcd_control >> 7) == 1;
 }
 
 void Video::ppu_set_state(PPUState state) {
-    m_lcd_status &= 0b11111100;
-    m_lcd_status |= static_cast<uint8_t>(state);
+    m_regs.lcd_status &= 0b11111100;
+    m_regs.lcd_status |= static_cast<uint8_t>(state);
 }
 
 Video::PPUState Video::ppu_get_state() {
-    return static_cast<Video::PPUState>(m_lcd_status & 0b11);
+    return static_cast<Video::PPUState>(m_regs.lcd_status & 0b11);
 }
 
 bool Video::is_interrupt_enabled(PPUState state) {
     switch (state) {
-    case PPUState::HBLANK: return (m_lcd_status & 0b00001000) != 0;
-    case PPUState::VBLANK: return (m_lcd_status & 0b00010000) != 0;
-    case PPUState::SEARCH_SPRITE_ATTRB: return (m_lcd_status & 0b00100000) != 0;
+    case PPUState::HBLANK: return (m_regs.lcd_status & 0b00001000) != 0;
+    case PPUState::VBLANK: return (m_regs.lcd_status & 0b00010000) != 0;
+    case PPUState::SEARCH_SPRITE_ATTRB: return (m_regs.lcd_status & 0b00100000) != 0;
     case PPUState::TRANSFER_TO_LCD_DRIVER: return false;
     }
     throw std::invalid_argument("invalid argument. there is no interrupt enabled status for that state.");
 }
 
 void Video::set_coincidence_bit(bool coincidence) {
-    m_lcd_status &= 0b11111011;
-    if (coincidence) m_lcd_status |= 0b100;
+    m_regs.lcd_status &= 0b11111011;
+    if (coincidence) m_regs.lcd_status |= 0b100;
 }
 
 void Video::update_graphics(int cycles) {
+    m_cycle_count += cycles;
+
     if (is_lcd_enabled()) {
         m_scanline_counter += cycles;
     } else {
         m_scanline_counter = 0;
-        m_ly = 0;
+        m_regs.ly = 0;
         ppu_set_state(PPUState::VBLANK);
         return;
     }
 
     PPUState old_state = ppu_get_state();
 
-    if (m_ly >= 144) {
+    if (m_regs.ly >= 144) {
         // Status: VBLANK
         ppu_set_state(PPUState::VBLANK);
     } else if (m_scanline_counter < CYCLES_FOR_OBJ_ATTRB_SEARCH) {
@@ -77,111 +66,112 @@ void Video::update_graphics(int cycles) {
         ppu_set_state(PPUState::HBLANK);
     }
 
-    if (old_state != ppu_get_state() && is_interrupt_enabled(ppu_get_state()))
-        m_mmu.request_interrupt(InterruptController::LCD);
+    if (old_state != ppu_get_state()) {
+        // Only in and out of VBLANK: within a line the modes follow fixed cycle counts, and
+        // all four per line would be ~37k events per second
+        if (old_state == PPUState::VBLANK || ppu_get_state() == PPUState::VBLANK)
+            TRACE_COUNTER("lcd mode", static_cast<int>(ppu_get_state()));
+        if (is_interrupt_enabled(ppu_get_state()))
+            m_mmu.request_interrupt(InterruptController::LCD);
+    }
 
-    if (m_ly == m_ly_compare) {
+    if (m_regs.ly == m_regs.ly_compare) {
         set_coincidence_bit(true);
-        if ((m_lcd_status & 0b01000000) != 0)
+        if ((m_regs.lcd_status & 0b01000000) != 0)
             m_mmu.request_interrupt(InterruptController::LCD);
     } else {
         set_coincidence_bit(false);
     }
 
     if (m_scanline_counter >= CYCLES_PER_SCANLINE) {
-        m_ly++;
+        m_regs.ly++;
         m_scanline_counter = 0;
-        if (m_ly == 144)
+        if (m_regs.ly == 144) {
             m_mmu.request_interrupt(InterruptController::VBLANK);
-        if (m_ly > 153)
-            m_ly = 0;
+            end_frame();
+        }
+        if (m_regs.ly > 153) {
+            m_regs.ly = 0;
+            // Only switch between drawing and skipping on frame boundaries, never mid-frame
+            m_rendering_frame = m_rendering_requested;
+        }
         draw_scanline();
     }
 }
 
 void Video::draw_scanline() {
-    if ((m_lcd_control & LCD_CTRL_BG_EN) != 0)
-        render_tiles();
-    if ((m_lcd_control & LCD_CTRL_OBJ_EN) != 0)
-        render_sprites();
-}
+    // Nothing to draw during VBLANK or in frames that are being skipped
+    if (!m_rendering_frame || m_regs.ly >= 144) return;
 
-void Video::render_tiles() {
-    uint16_t tiledata_address = 0;
-    uint16_t tilemap_address = 0;
-    uint8_t corrected_winx = m_winx - 7;
-    bool unsigned_index = true;
-    bool drawing_window = false;
-
-    if ((m_lcd_control & LCD_CTRL_WIN_EN) != 0 && m_winy <= m_ly)
-        drawing_window = true;
-
-    if ((m_lcd_control & LCD_CTRL_BG_WIN_TILE_DATA_SELECT) != 0) {
-        unsigned_index = true;
-        tiledata_address = 0x8000;
-    } else {
-        unsigned_index = false;
-        tiledata_address = 0x8800;
+    if (m_ppu_worker) {
+        m_ppu_worker->log_scanline(m_cycle_count, m_regs.ly);
+        return;
     }
+    PPURenderer::draw_scanline(m_mmu.vram(), m_mmu.oam(), m_regs, m_frames.back());
+}
 
-    uint16_t x_pos, y_pos; // where in the 256x256 space are we drawing?
-    uint16_t tile_row, tile_col; // which of the 32x32 tile are we drawing?
-    if (drawing_window) {
-        // drawing window
-        if ((m_lcd_control & LCD_CTRL_WIN_TILEMAP_DISP_SELECT) != 0) {
-            tilemap_address = 0x9C00;
-        } else {
-            tilemap_address = 0x9800;
-        }
-        y_pos = m_ly - m_winy;
-    } else {
-        // drawing background
-        if ((m_lcd_control & LCD_CTRL_BG_TILEMAP_DISP_SELECT) != 0) {
-            tilemap_address = 0x9C00;
-        } else {
-            tilemap_address = 0x9800;
-        }
-        y_pos = m_ly + m_scroll_y;
+void Video::end_frame() {
+    m_frame_count++;
+    if (!m_rendering_frame) {
+        m_frames_skipped++;
+        return;
     }
-    tile_row = y_pos / 8;
-
-    for (int x = 0; x < 160; x++) {
-        x_pos = x + m_scroll_x;
-        if (drawing_window && (x_pos >= corrected_winx))
-            x_pos = x - corrected_winx;
-        tile_col = x_pos / 8;
-        int16_t tile_idx;
-        if (unsigned_index)
-            tile_idx = (uint8_t)m_mmu.read_byte(tilemap_address + tile_row * 32 + tile_col);
-        else
-            tile_idx = (int8_t)m_mmu.read_byte(tilemap_address + tile_row * 32 + tile_col);
-        uint16_t tile_address = tiledata_address + (unsigned_index? tile_idx * 16 : (tile_idx + 128)*16);
-        uint8_t tile_line = y_pos % 8;
-
-        uint8_t tile_data1 = m_mmu.read_byte(tile_address + 2*tile_line);
-        uint8_t tile_data2 = m_mmu.read_byte(tile_address + 2*tile_line + 1);
-
-        uint8_t color_bit = 7 - (x_pos % 8);
-        uint8_t color_number = ((tile_data2 >> (color_bit - 1)) & 0b10) | ((tile_data1 >> color_bit) & 0b1);
-        FB_COLOR color = get_color_from_pallet(color_number, m_bg_pallet);
-        int y = m_ly;
-        m_framebuffer.set_pixel(x, y, color);
+
+    if (m_ppu_worker) {
+        m_ppu_worker->log_frame_end(m_cycle_count);
+        return;
     }
+    m_frames.publish(m_cycle_count);
 }
 
-void Video::render_sprites() {
+const uint8_t* Video::get_framebuffer() {
+    return latest_frame().framebuffer.get_buffer_ptr();
+}
 
+void Video::reset() {
+    if (m_ppu_worker) {
+        m_ppu_worker->log_reset(m_cycle_count);
+        return;
+    }
+    m_frames.back().reset();
+    m_frames.publish(m_cycle_count);
 }
 
-FB_COLOR Video::get_color_from_pallet(uint8_t color, uint8_t pallet) {
-    FB_COLOR color_arr[] = {FB_COLOR::FB_WHITE, FB_COLOR::FB_LIGHT_GRAY, FB_COLOR::FB_DARK_GRAY, FB_COLOR::FB_BLACK};
-    return color_arr[(pallet >> (color * 2)) & 0b11];
+void Video::save_state(State& state) const {
+    state.regs = m_regs;
+    state.scanline_counter = m_scanline_counter;
+    state.cycle_count = m_cycle_count;
+    state.frame_count = m_frame_count;
 }
 
-uint8_t* Video::get_framebuffer() {
-    return m_framebuffer.get_buffer_ptr();
+void Video::load_state(const State& state) {
+    m_regs = state.regs;
+    m_scanline_counter = state.scanline_counter;
+    m_cycle_count = state.cycle_count;
+    m_frame_count = state.frame_count;
+
+    if (m_ppu_worker) {
+        // The worker's copy of VRAM no longer matches, reseed it
+        m_ppu_worker->stop();
+        m_ppu_worker->start(m_mmu.vram(), m_mmu.oam(), m_regs, &m_frames);
+    }
 }
 
-void Video::reset() {
-    m_framebuffer.reset();
+void Video::set_frame_tap(FrameExchange* tap) {
+    // The worker publishes frames on its own thread, it can't be mid-frame while the tap changes
+    if (m_ppu_worker) m_ppu_worker->stop();
+    m_frames.set_tap(tap);
+    if (m_ppu_worker) m_ppu_worker->start(m_mmu.vram(), m_mmu.oam(), m_regs, &m_frames);
+}
+
+void Video::set_pipelined(bool pipelined) {
+    if (pipelined == is_pipelined()) return;
+
+    if (pipelined) {
+        m_ppu_worker = std::make_unique<PPUWorker>();
+        m_ppu_worker->start(m_mmu.vram(), m_mmu.oam(), m_regs, &m_frames);
+    } else {
+        m_ppu_worker->stop();
+        m_ppu_worker.reset();
+    }
 }
@@ -2,34 +2,68 @@
 #define VIDEO_H
 
 #include <cstdint>
+#include <memory>
 #include "../mmu.h"
-#include "framebuffer.h"
+#include "frame_exchange.h"
+#include "ppu_renderer.h"
+#include "ppu_worker.h"
 
 class MMU;
 
 class Video
 {
 public:
+    struct State {
+        PPURegisters regs;
+        uint8_t reserved = 0;   // spells out the padding after the 11 register bytes
+        int scanline_counter;
+        uint64_t cycle_count;
+        uint64_t frame_count;
+    };
+
     Video(MMU& mmu);
     uint8_t& operator[](const int addr);
     void update_graphics(int cycles);
-    uint8_t* get_framebuffer();
+    // Latest completed frame. Only one thread may read frames at a time.
+    inline const Frame& latest_frame() { return m_frames.latest(); }
+    const uint8_t* get_framebuffer();
     void reset();
+    bool is_lcd_enabled();
+
+    // Pipelined mode: pixels are drawn by a PPUWorker thread from a log of video writes
+    void set_pipelined(bool pipelined);
+    inline bool is_pipelined() const { return m_ppu_worker != nullptr; }
+
+    // Called by the MMU for every CPU write to VRAM, OAM or the LCD registers
+    inline void log_write(uint16_t address, uint8_t value) {
+        if (m_ppu_worker) m_ppu_worker->log_write(m_cycle_count, address, value);
+    }
+
+    // Frame skipping: when disabled, the following frames are emulated but not drawn or published
+    inline void set_rendering(bool enabled) { m_rendering_requested = enabled; }
+    // Copies every published frame into `tap` as well (see FrameExchange::set_tap), nullptr to stop
+    void set_frame_tap(FrameExchange* tap);
+    inline bool rendering() const { return m_rendering_requested; }
+    inline uint64_t frames_skipped() const { return m_frames_skipped; }
+
+    inline uint64_t cycle_count() const { return m_cycle_count; }
+    // Number of times the PPU has entered VBLANK
+    inline uint64_t frame_count() const { return m_frame_count; }
+
+    void save_state(State& state) const;
+    void load_state(const State& state);
+
 private:
-    uint8_t m_lcd_control = 0x91;
-    uint8_t m_lcd_status;
-    uint8_t m_scroll_y = 0;
-    uint8_t m_scroll_x = 0;
-    uint8_t m_ly = 0;
-    uint8_t m_ly_compare = 0;
-    uint8_t m_bg_pallet = 0xFC;
-    uint8_t m_obj_pallet0 = 0xFF;
-    uint8_t m_obj_pallet1 = 0xFF;
-    uint8_t m_winy = 0;
-    uint8_t m_winx = 0;
+    PPURegisters m_regs;
 
     int m_scanline_counter;
-    Framebuffer m_framebuffer;
+    uint64_t m_cycle_count = 0;
+    uint64_t m_frame_count = 0;
+    bool m_rendering_requested = true;
+    bool m_rendering_frame = true;
+    uint64_t m_frames_skipped = 0;
+    FrameExchange m_frames;
+    std::unique_ptr<PPUWorker> m_ppu_worker;
 
     MMU& m_mmu;
 
@@ -45,24 +79,12 @@ private:
     static constexpr int CYCLES_FOR_LCD_TRANSFER = 172;
     static constexpr int CYCLES_FOR_HBLANK = CYCLES_PER_SCANLINE - (CYCLES_FOR_LCD_TRANSFER + CYCLES_FOR_OBJ_ATTRB_SEARCH);
 
-    static constexpr uint8_t LCD_CTRL_ENABLE = (1 << 7);
-    static constexpr uint8_t LCD_CTRL_WIN_TILEMAP_DISP_SELECT = (1 << 6);
-    static constexpr uint8_t LCD_CTRL_WIN_EN = (1 << 5);
-    static constexpr uint8_t LCD_CTRL_BG_WIN_TILE_DATA_SELECT = (1 << 4);
-    static constexpr uint8_t LCD_CTRL_BG_TILEMAP_DISP_SELECT = (1 << 3);
-    static constexpr uint8_t LCD_CTRL_OBJ_SIZE = (1 << 2);
-    static constexpr uint8_t LCD_CTRL_OBJ_EN = (1 << 1);
-    static constexpr uint8_t LCD_CTRL_BG_EN = 1;
-
-    bool is_lcd_enabled();
     void ppu_set_state(PPUState state);
     PPUState ppu_get_state();
     bool is_interrupt_enabled(PPUState state);
     void set_coincidence_bit(bool coincidence);
     void draw_scanline();
-    void render_tiles();
-    void render_sprites();
-    FB_COLOR get_color_from_pallet(uint8_t color, uint8_t pallet);
+    void end_frame();
 };
 
 #endif // VIDEO_H